@@ -0,0 +1,12 @@
+/* citus--6.2-2--6.2-3.sql */
+
+SET search_path = 'pg_catalog';
+
+CREATE FUNCTION citus_task_hedging_stats(OUT hedged_tasks bigint, OUT hedges_won bigint)
+    RETURNS record
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_task_hedging_stats$$;
+COMMENT ON FUNCTION citus_task_hedging_stats(OUT hedged_tasks bigint, OUT hedges_won bigint)
+    IS 'get the number of real-time tasks hedged by this session, and how many of those hedges won';
+
+RESET search_path;
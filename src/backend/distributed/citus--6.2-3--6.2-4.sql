@@ -0,0 +1,18 @@
+/* citus--6.2-3--6.2-4.sql */
+
+SET search_path = 'pg_catalog';
+
+CREATE FUNCTION citus_connection_pool_stats(OUT node_name text, OUT node_port int,
+											OUT user_name text, OUT database_name text,
+											OUT connection_count int,
+											OUT idle_connection_count int,
+											OUT established_count bigint,
+											OUT reused_count bigint,
+											OUT discarded_count bigint)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_connection_pool_stats$$;
+COMMENT ON FUNCTION citus_connection_pool_stats()
+    IS 'get the number of connections all sessions hold to each worker node';
+
+RESET search_path;
@@ -0,0 +1,18 @@
+/* citus--6.2-4--6.2-5.sql */
+
+SET search_path = 'pg_catalog';
+
+CREATE FUNCTION citus_node_connection_usage(OUT node_name text, OUT node_port int,
+											OUT connection_count int,
+											OUT max_connection_count int)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_node_connection_usage$$;
+COMMENT ON FUNCTION citus_node_connection_usage()
+    IS 'get the number of connections all sessions use on each node, and the budget';
+
+CREATE VIEW citus_node_connections AS
+    SELECT * FROM citus_node_connection_usage();
+GRANT SELECT ON pg_catalog.citus_node_connections TO public;
+
+RESET search_path;
@@ -0,0 +1,17 @@
+/* citus--6.2-5--6.2-6.sql */
+
+SET search_path = 'pg_catalog';
+
+CREATE FUNCTION task_tracker_task_status_changes(job_ids bigint[],
+												 since_version bigint,
+												 OUT job_id bigint,
+												 OUT task_id integer,
+												 OUT task_status integer,
+												 OUT status_version bigint)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$task_tracker_task_status_changes$$;
+COMMENT ON FUNCTION task_tracker_task_status_changes(bigint[], bigint)
+    IS 'get the statuses of the given jobs'' tasks that changed after the given version';
+
+RESET search_path;
@@ -0,0 +1,19 @@
+/* citus--6.2-6--6.2-7.sql */
+
+SET search_path = 'pg_catalog';
+
+DROP FUNCTION citus_connection_pool_stats();
+
+CREATE FUNCTION citus_connection_pool_stats(OUT node_name text, OUT node_port int,
+											OUT connection_count int,
+											OUT idle_connection_count int,
+											OUT established_count bigint,
+											OUT reused_count bigint,
+											OUT discarded_count bigint)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_connection_pool_stats$$;
+COMMENT ON FUNCTION citus_connection_pool_stats()
+    IS 'get the number of connections all sessions hold to each worker node';
+
+RESET search_path;
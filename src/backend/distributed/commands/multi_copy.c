@@ -708,7 +708,8 @@ RemoveMasterOptions(CopyStmt *copyStatement)
  * OpenCopyConnections opens a connection for each placement of a shard and
  * starts a COPY transaction if necessary. If a connection cannot be opened,
  * then the shard placement is marked as inactive and the COPY continues with the remaining
- * shard placements.
+ * shard placements. Connections to the placements are established, and COPY
+ * is started on them, concurrently.
  */
 static void
 OpenCopyConnections(CopyStmt *copyStatement, ShardConnections *shardConnections,
@@ -717,6 +718,8 @@ OpenCopyConnections(CopyStmt *copyStatement, ShardConnections *shardConnections,
 	List *finalizedPlacementList = NIL;
 	int failedPlacementCount = 0;
 	ListCell *placementCell = NULL;
+	ListCell *connectionCell = NULL;
+	List *placementConnectionList = NIL;
 	List *connectionList = NULL;
 	int64 shardId = shardConnections->shardId;
 
@@ -741,16 +744,23 @@ OpenCopyConnections(CopyStmt *copyStatement, ShardConnections *shardConnections,
 							   "modifications")));
 	}
 
+	/* establish connections to all placements concurrently */
 	foreach(placementCell, finalizedPlacementList)
 	{
 		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
 		char *nodeUser = CurrentUserName();
 		MultiConnection *connection = NULL;
 		uint32 connectionFlags = FOR_DML;
-		StringInfo copyCommand = NULL;
-		PGresult *result = NULL;
 
-		connection = GetPlacementConnection(connectionFlags, placement, nodeUser);
+		connection = StartPlacementConnection(connectionFlags, placement, nodeUser);
+		placementConnectionList = lappend(placementConnectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(placementConnectionList);
+
+	foreach(connectionCell, placementConnectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
 
 		if (PQstatus(connection->pgConn) != CONNECTION_OK)
 		{
@@ -775,10 +785,34 @@ OpenCopyConnections(CopyStmt *copyStatement, ShardConnections *shardConnections,
 		 */
 		MarkRemoteTransactionCritical(connection);
 		ClaimConnectionExclusively(connection);
-		RemoteTransactionBeginIfNecessary(connection);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	/* BEGIN is sent along with the COPY command, in a single round-trip */
+	RemoteTransactionsDeferBeginIfNecessary(connectionList);
+
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		StringInfo copyCommand = NULL;
+
+		/* earlier deferred modifications on the placement are sent first as well */
 		copyCommand = ConstructCopyStatement(copyStatement, shardConnections->shardId,
 											 useBinaryCopyFormat);
-		result = PQexec(connection->pgConn, copyCommand->data);
+
+		if (!SendRemoteCommand(connection, copyCommand->data))
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+	}
+
+	/* wait for all placements to be ready to receive data */
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		bool raiseInterrupts = true;
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
 
 		if (PQresultStatus(result) != PGRES_COPY_IN)
 		{
@@ -786,7 +820,6 @@ OpenCopyConnections(CopyStmt *copyStatement, ShardConnections *shardConnections,
 		}
 
 		PQclear(result);
-		connectionList = lappend(connectionList, connection);
 	}
 
 	/* if all placements failed, error out */
@@ -24,7 +24,10 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/hash_helpers.h"
 #include "distributed/placement_connection.h"
+#include "distributed/remote_commands.h"
+#include "distributed/shared_connection_stats.h"
 #include "mb/pg_wchar.h"
+#include "storage/ipc.h"
 #include "utils/hsearch.h"
 #include "utils/memutils.h"
 
@@ -38,6 +41,8 @@ static int ConnectionHashCompare(const void *a, const void *b, Size keysize);
 static MultiConnection * StartConnectionEstablishment(ConnectionHashKey *key);
 static void AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit);
 static MultiConnection * FindAvailableConnection(dlist_head *connections, uint32 flags);
+static void ReleaseSharedConnectionsAtExit(int code, Datum arg);
+static int NodeConnectionsInUse(const char *hostname, int32 port);
 
 
 /*
@@ -219,6 +224,8 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 		connection = FindAvailableConnection(entry->connections, flags);
 		if (connection)
 		{
+			TakeConnectionFromSharedPool(connection);
+
 			if (flags & SESSION_LIFESPAN)
 			{
 				connection->sessionLifespan = true;
@@ -361,12 +368,15 @@ CloseConnection(MultiConnection *connection)
 
 	if (found)
 	{
+		SharedConnectionClosed(connection);
+
 		/* unlink from list of open connections */
 		dlist_delete(&connection->connectionNode);
 
 		/* same for transaction state and shard/placement machinery */
 		CloseRemoteTransaction(connection);
 		CloseShardPlacementAssociation(connection);
+		ClearPreparedStatementCache(connection);
 
 		/* we leave the per-host entry alive */
 		pfree(connection);
@@ -404,148 +414,220 @@ CloseConnectionByPGconn(PGconn *pqConn)
 
 
 /*
- * FinishConnectionListEstablishment is a wrapper around FinishConnectionEstablishment.
- * The function iterates over the multiConnectionList and finishes the connection
- * establishment for each multi connection.
+ * FinishConnectionListEstablishment synchronously finishes connection
+ * establishment of all connections in multiConnectionList. The connections
+ * are polled together, so establishing many connections takes about as long
+ * as establishing the slowest of them, rather than the sum of all.
  */
 void
 FinishConnectionListEstablishment(List *multiConnectionList)
 {
+	static int checkIntervalMS = 200;
+	int connectionCount = list_length(multiConnectionList);
+	MultiConnection **pendingConnections = NULL;
+	bool *readyForPoll = NULL;
+	PostgresPollingStatusType *pollModes = NULL;
+	struct pollfd *pollFileDescriptors = NULL;
+	int pendingCount = 0;
 	ListCell *multiConnectionCell = NULL;
 
-	foreach(multiConnectionCell, multiConnectionList)
+	if (connectionCount == 0)
 	{
-		MultiConnection *multiConnection = (MultiConnection *) lfirst(
-			multiConnectionCell);
-
-		/* TODO: consider making connection establishment fully in parallel */
-		FinishConnectionEstablishment(multiConnection);
+		return;
 	}
-}
 
+	pendingConnections = palloc0(connectionCount * sizeof(MultiConnection *));
+	readyForPoll = palloc0(connectionCount * sizeof(bool));
+	pollModes = palloc0(connectionCount * sizeof(PostgresPollingStatusType));
+	pollFileDescriptors = palloc0(connectionCount * sizeof(struct pollfd));
 
-/*
- * Synchronously finish connection establishment of an individual connection.
- *
- * TODO: Replace with variant waiting for multiple connections.
- */
-void
-FinishConnectionEstablishment(MultiConnection *connection)
-{
-	static int checkIntervalMS = 200;
+	foreach(multiConnectionCell, multiConnectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(multiConnectionCell);
+
+		pendingConnections[pendingCount] = connection;
+		readyForPoll[pendingCount] = true;
+		pendingCount++;
+	}
 
 	/*
-	 * Loop until connection is established, or failed (possibly just timed
-	 * out).
+	 * Loop until all connections are established, or failed (possibly just
+	 * timed out).
 	 */
-	while (true)
+	while (pendingCount > 0)
 	{
-		ConnStatusType status = PQstatus(connection->pgConn);
-		PostgresPollingStatusType pollmode;
+		int connectionIndex = 0;
+		int pollResult = 0;
 
-		if (status == CONNECTION_OK)
+		/* advance establishment of all connections that made progress */
+		connectionIndex = 0;
+		while (connectionIndex < pendingCount)
 		{
-			return;
-		}
+			MultiConnection *connection = pendingConnections[connectionIndex];
+			ConnStatusType status = CONNECTION_BAD;
+			bool finished = false;
 
-		/* FIXME: retries? */
-		if (status == CONNECTION_BAD)
-		{
-			return;
-		}
+			if (!readyForPoll[connectionIndex])
+			{
+				connectionIndex++;
+				continue;
+			}
 
-		pollmode = PQconnectPoll(connection->pgConn);
+			status = PQstatus(connection->pgConn);
 
-		/*
-		 * FIXME: Do we want to add transparent retry support here?
-		 */
-		if (pollmode == PGRES_POLLING_FAILED)
-		{
-			return;
-		}
-		else if (pollmode == PGRES_POLLING_OK)
-		{
-			return;
+			/* FIXME: retries? */
+			if (status == CONNECTION_OK || status == CONNECTION_BAD)
+			{
+				finished = true;
+			}
+			else
+			{
+				PostgresPollingStatusType pollmode = PQconnectPoll(connection->pgConn);
+
+				/*
+				 * FIXME: Do we want to add transparent retry support here?
+				 */
+				if (pollmode == PGRES_POLLING_FAILED || pollmode == PGRES_POLLING_OK)
+				{
+					finished = true;
+				}
+				else
+				{
+					Assert(pollmode == PGRES_POLLING_WRITING ||
+						   pollmode == PGRES_POLLING_READING);
+
+					pollModes[connectionIndex] = pollmode;
+					readyForPoll[connectionIndex] = false;
+				}
+			}
+
+			if (finished)
+			{
+				/* move the last pending connection into this slot */
+				pendingCount--;
+				pendingConnections[connectionIndex] = pendingConnections[pendingCount];
+				readyForPoll[connectionIndex] = readyForPoll[pendingCount];
+				pollModes[connectionIndex] = pollModes[pendingCount];
+				continue;
+			}
+
+			connectionIndex++;
 		}
-		else
+
+		if (pendingCount == 0)
 		{
-			Assert(pollmode == PGRES_POLLING_WRITING ||
-				   pollmode == PGRES_POLLING_READING);
+			break;
 		}
 
-		/* Loop, to handle poll() being interrupted by signals (EINTR) */
-		while (true)
+		for (connectionIndex = 0; connectionIndex < pendingCount; connectionIndex++)
 		{
-			struct pollfd pollFileDescriptor;
-			int pollResult = 0;
+			MultiConnection *connection = pendingConnections[connectionIndex];
+			struct pollfd *pollFileDescriptor = &pollFileDescriptors[connectionIndex];
 
-			pollFileDescriptor.fd = PQsocket(connection->pgConn);
-			if (pollmode == PGRES_POLLING_READING)
+			pollFileDescriptor->fd = PQsocket(connection->pgConn);
+			if (pollModes[connectionIndex] == PGRES_POLLING_READING)
 			{
-				pollFileDescriptor.events = POLLIN;
+				pollFileDescriptor->events = POLLIN;
 			}
 			else
 			{
-				pollFileDescriptor.events = POLLOUT;
+				pollFileDescriptor->events = POLLOUT;
 			}
-			pollFileDescriptor.revents = 0;
+			pollFileDescriptor->revents = 0;
+		}
 
+		/*
+		 * Only sleep for a limited amount of time, so we can react to
+		 * interrupts in time, even if the platform doesn't interrupt poll()
+		 * after signal arrival.
+		 */
+		pollResult = poll(pollFileDescriptors, pendingCount, checkIntervalMS);
+
+		if (pollResult > 0)
+		{
 			/*
-			 * Only sleep for a limited amount of time, so we can react to
-			 * interrupts in time, even if the platform doesn't interrupt
-			 * poll() after signal arrival.
+			 * IO possible, continue establishment of the connections that
+			 * are ready. We could check for timeouts here as well, but if
+			 * there's progress there seems little point.
 			 */
-			pollResult = poll(&pollFileDescriptor, 1, checkIntervalMS);
-
-			if (pollResult == 0)
+			for (connectionIndex = 0; connectionIndex < pendingCount; connectionIndex++)
 			{
-				/*
-				 * Timeout exceeded. Two things to do:
-				 * - check whether any interrupts arrived and handle them
-				 * - check whether establishment for connection already has
-				 *   lasted for too long, stop waiting if so.
-				 */
-				CHECK_FOR_INTERRUPTS();
-
-				if (TimestampDifferenceExceeds(connection->connectionStart,
-											   GetCurrentTimestamp(),
-											   NodeConnectionTimeout))
+				if (pollFileDescriptors[connectionIndex].revents != 0)
 				{
-					ereport(WARNING, (errmsg("could not establish connection after %u ms",
-											 NodeConnectionTimeout)));
-
-					/* close connection, otherwise we take up resource on the other side */
-					PQfinish(connection->pgConn);
-					connection->pgConn = NULL;
-					break;
+					readyForPoll[connectionIndex] = true;
 				}
 			}
-			else if (pollResult > 0)
-			{
-				/*
-				 * IO possible, continue connection establishment. We could
-				 * check for timeouts here as well, but if there's progress
-				 * there seems little point.
-				 */
-				break;
-			}
-			else if (pollResult != EINTR)
-			{
-				/* Retrying, signal interrupted. So check. */
-				CHECK_FOR_INTERRUPTS();
-			}
-			else
+		}
+		else if (pollResult == 0)
+		{
+			TimestampTz currentTime = 0;
+
+			/*
+			 * Timeout exceeded. Two things to do:
+			 * - check whether any interrupts arrived and handle them
+			 * - check whether establishment of the connections already has
+			 *   lasted for too long, stop waiting for them if so.
+			 */
+			CHECK_FOR_INTERRUPTS();
+
+			currentTime = GetCurrentTimestamp();
+
+			connectionIndex = 0;
+			while (connectionIndex < pendingCount)
 			{
-				/*
-				 * We ERROR here, instead of just returning a failed
-				 * connection, because this shouldn't happen, and indicates a
-				 * programming error somewhere, not a network etc. issue.
-				 */
-				ereport(ERROR, (errcode_for_socket_access(),
-								errmsg("poll() failed: %m")));
+				MultiConnection *connection = pendingConnections[connectionIndex];
+
+				if (!TimestampDifferenceExceeds(connection->connectionStart,
+												currentTime, NodeConnectionTimeout))
+				{
+					connectionIndex++;
+					continue;
+				}
+
+				ereport(WARNING, (errmsg("could not establish connection after %u ms",
+										 NodeConnectionTimeout)));
+
+				/* close connection, otherwise we take up resource on the other side */
+				PQfinish(connection->pgConn);
+				connection->pgConn = NULL;
+
+				pendingCount--;
+				pendingConnections[connectionIndex] = pendingConnections[pendingCount];
+				readyForPoll[connectionIndex] = readyForPoll[pendingCount];
+				pollModes[connectionIndex] = pollModes[pendingCount];
 			}
 		}
+		else if (errno == EINTR)
+		{
+			/* Retrying, signal interrupted. So check. */
+			CHECK_FOR_INTERRUPTS();
+		}
+		else
+		{
+			/*
+			 * We ERROR here, instead of just returning a failed
+			 * connection, because this shouldn't happen, and indicates a
+			 * programming error somewhere, not a network etc. issue.
+			 */
+			ereport(ERROR, (errcode_for_socket_access(),
+							errmsg("poll() failed: %m")));
+		}
 	}
+
+	pfree(pendingConnections);
+	pfree(readyForPoll);
+	pfree(pollModes);
+	pfree(pollFileDescriptors);
+}
+
+
+/*
+ * Synchronously finish connection establishment of an individual connection.
+ */
+void
+FinishConnectionEstablishment(MultiConnection *connection)
+{
+	FinishConnectionListEstablishment(list_make1(connection));
 }
 
 
@@ -617,9 +699,12 @@ ConnectionHashCompare(const void *a, const void *b, Size keysize)
 static MultiConnection *
 StartConnectionEstablishment(ConnectionHashKey *key)
 {
+	static bool registeredExitCallback = false;
 	char nodePortString[12];
 	const char *clientEncoding = GetDatabaseEncodingName();
 	MultiConnection *connection = NULL;
+	int ownConnectionCount = 0;
+	bool sharedStatsCounted = false;
 
 	const char *keywords[] = {
 		"host", "port", "dbname", "user",
@@ -631,7 +716,20 @@ StartConnectionEstablishment(ConnectionHashKey *key)
 		clientEncoding, "citus", NULL
 	};
 
+	/* make sure other backends see the connection until this one exits */
+	if (!registeredExitCallback)
+	{
+		before_shmem_exit(ReleaseSharedConnectionsAtExit, 0);
+		registeredExitCallback = true;
+	}
+
+	/* wait until the node's connection budget allows another connection */
+	ownConnectionCount = NodeConnectionsInUse(key->hostname, key->port);
+	sharedStatsCounted = ReserveSharedConnection(key->hostname, key->port,
+												 ownConnectionCount);
+
 	connection = MemoryContextAllocZero(ConnectionContext, sizeof(MultiConnection));
+	connection->sharedStatsCounted = sharedStatsCounted;
 	sprintf(nodePortString, "%d", key->port);
 
 	strlcpy(connection->hostname, key->hostname, MAX_NODE_LENGTH);
@@ -646,6 +744,71 @@ StartConnectionEstablishment(ConnectionHashKey *key)
 }
 
 
+/*
+ * NodeConnectionsInUse returns the number of connections this backend uses on
+ * the given node, for any user and database, that count towards the node's
+ * connection budget.
+ */
+static int
+NodeConnectionsInUse(const char *hostname, int32 port)
+{
+	HASH_SEQ_STATUS status;
+	ConnectionHashEntry *entry;
+	int connectionCount = 0;
+
+	hash_seq_init(&status, ConnectionHash);
+	while ((entry = (ConnectionHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		dlist_iter iter;
+
+		if (entry->key.port != port ||
+			strncmp(entry->key.hostname, hostname, MAX_NODE_LENGTH) != 0)
+		{
+			continue;
+		}
+
+		dlist_foreach(iter, entry->connections)
+		{
+			MultiConnection *connection =
+				dlist_container(MultiConnection, connectionNode, iter.cur);
+
+			if (connection->sharedStatsCounted && !connection->idleInSharedPool)
+			{
+				connectionCount++;
+			}
+		}
+	}
+
+	return connectionCount;
+}
+
+
+/*
+ * ReleaseSharedConnectionsAtExit removes the connections of an exiting
+ * backend from the shared connection statistics.
+ */
+static void
+ReleaseSharedConnectionsAtExit(int code, Datum arg)
+{
+	HASH_SEQ_STATUS status;
+	ConnectionHashEntry *entry;
+
+	hash_seq_init(&status, ConnectionHash);
+	while ((entry = (ConnectionHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		dlist_iter iter;
+
+		dlist_foreach(iter, entry->connections)
+		{
+			MultiConnection *connection =
+				dlist_container(MultiConnection, connectionNode, iter.cur);
+
+			SharedConnectionClosed(connection);
+		}
+	}
+}
+
+
 /*
  * Close all remote connections if necessary anymore (i.e. not session
  * lifetime), or if in a failed state.
@@ -673,18 +836,23 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
 		}
 
 		/*
-		 * Preserve session lifespan connections if they are still healthy.
+		 * Preserve session lifespan connections if they are still healthy,
+		 * and the pool of idle connections to the node isn't full yet.
 		 */
 		if (!connection->sessionLifespan ||
 			PQstatus(connection->pgConn) != CONNECTION_OK ||
-			PQtransactionStatus(connection->pgConn) != PQTRANS_IDLE)
+			PQtransactionStatus(connection->pgConn) != PQTRANS_IDLE ||
+			!ReturnConnectionToSharedPool(connection))
 		{
 			PQfinish(connection->pgConn);
 			connection->pgConn = NULL;
 
+			SharedConnectionClosed(connection);
+
 			/* unlink from list */
 			dlist_delete(iter.cur);
 
+			ClearPreparedStatementCache(connection);
 			pfree(connection);
 		}
 		else
@@ -14,13 +14,55 @@
 
 #include "distributed/connection_management.h"
 #include "distributed/remote_commands.h"
+#include "distributed/remote_transaction.h"
+#include "lib/stringinfo.h"
 #include "miscadmin.h"
 #include "storage/latch.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+
+/*
+ * PreparedStatementEntry maps the parameter types and text of a command to the
+ * name of the statement prepared for it on a connection.
+ */
+typedef struct PreparedStatementEntry
+{
+	char *statementKey;
+	char statementName[NAMEDATALEN];
+} PreparedStatementEntry;
 
 
 /* GUC, determining whether statements sent to remote nodes are logged */
 bool LogRemoteCommands = false;
 
+/* GUC, determining whether parameterized queries are prepared on remote nodes */
+bool EnableRemotePreparedStatements = false;
+
+/* incremented whenever prepared statements may refer to outdated metadata */
+static uint64 PreparedStatementGeneration = 0;
+
+/* counter used to generate unique prepared statement names */
+static uint64 PreparedStatementCounter = 0;
+
+
+static const char * LookupPreparedStatement(MultiConnection *connection,
+											const char *command, int parameterCount,
+											const Oid *parameterTypes,
+											char **statementKey);
+static void AppendPrepareCommand(StringInfo command, const char *statementName,
+								 const char *queryString, int parameterCount,
+								 const Oid *parameterTypes);
+static void AppendExecuteCommand(StringInfo command, const char *statementName,
+								 int parameterCount,
+								 const char *const *parameterValues);
+static void CreatePreparedStatementHash(MultiConnection *connection);
+static uint32 PreparedStatementKeyHash(const void *key, Size keysize);
+static int PreparedStatementKeyCompare(const void *a, const void *b, Size keysize);
+static PGresult * ReceiveRemoteCommandResult(MultiConnection *connection,
+											bool raiseInterrupts);
+
 
 /* simple helpers */
 
@@ -280,6 +322,24 @@ SendRemoteCommandParams(MultiConnection *connection, const char *command,
 	bool wasNonblocking = false;
 	int rc = 0;
 
+	/*
+	 * Commands deferred in the remote transaction have to run first. Without
+	 * parameters, the command can be sent along with them in a single
+	 * multi-statement query; otherwise they have to be flushed separately.
+	 */
+	if (connection->remoteTransaction.deferredCommands != NULL)
+	{
+		if (parameterCount == 0)
+		{
+			const char *commandBatch =
+				RemoteTransactionPipelineCommand(connection, command);
+
+			return SendRemoteCommandBatch(connection, commandBatch);
+		}
+
+		RemoteTransactionFlush(connection);
+	}
+
 	LogRemoteCommand(connection, command);
 
 	/*
@@ -325,6 +385,410 @@ SendRemoteCommand(MultiConnection *connection, const char *command)
 }
 
 
+/*
+ * SendRemoteCommandBatch sends a string of semicolon separated commands over
+ * the connection. Unlike SendRemoteCommand, it uses the simple query protocol,
+ * as the extended protocol only accepts a single command per query. A result
+ * is returned for each command in the batch, up to the first one that fails.
+ */
+int
+SendRemoteCommandBatch(MultiConnection *connection, const char *commandBatch)
+{
+	PGconn *pgConn = connection->pgConn;
+	bool wasNonblocking = false;
+	int rc = 0;
+
+	LogRemoteCommand(connection, commandBatch);
+
+	/*
+	 * Don't try to send command if connection is entirely gone
+	 * (PQisnonblocking() would crash).
+	 */
+	if (!pgConn)
+	{
+		return 0;
+	}
+
+	wasNonblocking = PQisnonblocking(pgConn);
+
+	/* make sure not to block anywhere */
+	if (!wasNonblocking)
+	{
+		PQsetnonblocking(pgConn, true);
+	}
+
+	rc = PQsendQuery(pgConn, commandBatch);
+
+	/* reset nonblocking connection to its original state */
+	if (!wasNonblocking)
+	{
+		PQsetnonblocking(pgConn, false);
+	}
+
+	return rc;
+}
+
+
+/*
+ * SendRemoteCommandPrepared is a PQsendQueryPrepared wrapper that executes the
+ * given command as a named prepared statement on the connection. The statement
+ * is prepared the first time the command is sent over the connection, and then
+ * reused in later transactions, so that the remote node doesn't have to parse
+ * and plan the command every time. If the connection already holds too many
+ * prepared statements, the command is sent as is.
+ *
+ * The PREPARE isn't waited for separately: it is sent along with an EXECUTE of
+ * the new statement in a single multi-statement query, and GetRemoteCommandResult
+ * consumes its result before that of the EXECUTE. Commands deferred in the
+ * remote transaction are sent along in the same way.
+ */
+int
+SendRemoteCommandPrepared(MultiConnection *connection, const char *command,
+						  int parameterCount, const Oid *parameterTypes,
+						  const char *const *parameterValues)
+{
+	PGconn *pgConn = connection->pgConn;
+	const char *statementName = NULL;
+	char *statementKey = NULL;
+	StringInfo executeCommand = NULL;
+	const char *commandBatch = NULL;
+	bool wasNonblocking = false;
+	int rc = 0;
+
+	/*
+	 * Don't try to send command if connection is entirely gone
+	 * (PQisnonblocking() would crash).
+	 */
+	if (!pgConn)
+	{
+		return 0;
+	}
+
+	statementName = LookupPreparedStatement(connection, command, parameterCount,
+											parameterTypes, &statementKey);
+	if (statementName == NULL)
+	{
+		return SendRemoteCommandParams(connection, command, parameterCount,
+									   parameterTypes, parameterValues);
+	}
+
+	if (statementKey == NULL && connection->remoteTransaction.deferredCommands == NULL)
+	{
+		LogRemoteCommand(connection, command);
+
+		wasNonblocking = PQisnonblocking(pgConn);
+
+		/* make sure not to block anywhere */
+		if (!wasNonblocking)
+		{
+			PQsetnonblocking(pgConn, true);
+		}
+
+		rc = PQsendQueryPrepared(pgConn, statementName, parameterCount,
+								 parameterValues, NULL, NULL, 0);
+
+		/* reset nonblocking connection to its original state */
+		if (!wasNonblocking)
+		{
+			PQsetnonblocking(pgConn, false);
+		}
+
+		return rc;
+	}
+
+	/* otherwise, send PREPARE and EXECUTE along with the deferred commands */
+	executeCommand = makeStringInfo();
+
+	if (statementKey != NULL)
+	{
+		AppendPrepareCommand(executeCommand, statementName, command, parameterCount,
+							 parameterTypes);
+	}
+
+	AppendExecuteCommand(executeCommand, statementName, parameterCount,
+						 parameterValues);
+
+	commandBatch = RemoteTransactionPipelineCommand(connection, executeCommand->data);
+
+	/* the statement only counts as prepared once the PREPARE succeeded */
+	connection->pendingPreparedStatementKey = statementKey;
+
+	rc = SendRemoteCommandBatch(connection, commandBatch);
+	if (rc == 0)
+	{
+		connection->remoteTransaction.pipelinedResultCount = 0;
+		ForgetPendingPreparedStatement(connection);
+	}
+
+	return rc;
+}
+
+
+/*
+ * LookupPreparedStatement returns the name of the statement prepared for the
+ * given command on the connection. If there is no such statement yet, the
+ * function enters a new statement name into the connection's cache, and sets
+ * statementKey to the cache key of the statement, which the caller then has to
+ * prepare. Statements prepared before the metadata changed are deallocated
+ * first. The function returns NULL if no more statements can be prepared on
+ * the connection, or if deallocating stale statements failed.
+ */
+static const char *
+LookupPreparedStatement(MultiConnection *connection, const char *command,
+						int parameterCount, const Oid *parameterTypes,
+						char **statementKey)
+{
+	PreparedStatementEntry *statementEntry = NULL;
+	StringInfo statementKeyString = makeStringInfo();
+	char *statementKeyData = NULL;
+	bool found = false;
+	int parameterIndex = 0;
+
+	*statementKey = NULL;
+
+	/* statements may have become stale, e.g. due to DDL or moved shards */
+	if (connection->preparedStatementHash != NULL &&
+		connection->preparedStatementGeneration != PreparedStatementGeneration)
+	{
+		PGresult *result = NULL;
+		int resultCode = ExecuteOptionalRemoteCommand(connection, "DEALLOCATE ALL",
+													  &result);
+		if (resultCode != 0)
+		{
+			/* keep the cache, so that we try to deallocate again next time */
+			return NULL;
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+
+		ClearPreparedStatementCache(connection);
+	}
+
+	if (connection->preparedStatementHash == NULL)
+	{
+		CreatePreparedStatementHash(connection);
+	}
+
+	/* statements can only be reused for parameters of the same types */
+	for (parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
+	{
+		appendStringInfo(statementKeyString, "%u,", parameterTypes[parameterIndex]);
+	}
+
+	appendStringInfo(statementKeyString, ";%s", command);
+	statementKeyData = statementKeyString->data;
+
+	statementEntry = hash_search(connection->preparedStatementHash, &statementKeyData,
+								 HASH_FIND, &found);
+	if (found)
+	{
+		return statementEntry->statementName;
+	}
+
+	if (hash_get_num_entries(connection->preparedStatementHash) >=
+		MAX_PREPARED_STATEMENTS_PER_CONNECTION)
+	{
+		return NULL;
+	}
+
+	statementEntry = hash_search(connection->preparedStatementHash, &statementKeyData,
+								 HASH_ENTER, &found);
+	statementEntry->statementKey =
+		MemoryContextStrdup(connection->preparedStatementContext, statementKeyData);
+
+	PreparedStatementCounter++;
+	snprintf(statementEntry->statementName, NAMEDATALEN,
+			 "citus_statement_" UINT64_FORMAT, PreparedStatementCounter);
+
+	*statementKey = statementEntry->statementKey;
+
+	return statementEntry->statementName;
+}
+
+
+/*
+ * AppendPrepareCommand appends a PREPARE command for the given statement to the
+ * given string. Parameters of types which the remote node has to infer are
+ * declared as unknown.
+ */
+static void
+AppendPrepareCommand(StringInfo command, const char *statementName,
+					 const char *queryString, int parameterCount,
+					 const Oid *parameterTypes)
+{
+	int parameterIndex = 0;
+
+	appendStringInfo(command, "PREPARE %s", quote_identifier(statementName));
+
+	for (parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
+	{
+		Oid parameterType = parameterTypes[parameterIndex];
+
+		appendStringInfoString(command, (parameterIndex == 0) ? " (" : ", ");
+
+		if (parameterType == InvalidOid)
+		{
+			appendStringInfoString(command, "unknown");
+		}
+		else
+		{
+			appendStringInfoString(command, format_type_be_qualified(parameterType));
+		}
+	}
+
+	if (parameterCount > 0)
+	{
+		appendStringInfoChar(command, ')');
+	}
+
+	appendStringInfo(command, " AS %s;", queryString);
+}
+
+
+/*
+ * AppendExecuteCommand appends an EXECUTE command for the given statement to
+ * the given string, passing the parameter values as literals.
+ */
+static void
+AppendExecuteCommand(StringInfo command, const char *statementName,
+					 int parameterCount, const char *const *parameterValues)
+{
+	int parameterIndex = 0;
+
+	appendStringInfo(command, "EXECUTE %s", quote_identifier(statementName));
+
+	for (parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
+	{
+		const char *parameterValue = parameterValues[parameterIndex];
+
+		appendStringInfoString(command, (parameterIndex == 0) ? " (" : ", ");
+
+		if (parameterValue == NULL)
+		{
+			appendStringInfoString(command, "NULL");
+		}
+		else
+		{
+			appendStringInfoString(command, quote_literal_cstr(parameterValue));
+		}
+	}
+
+	if (parameterCount > 0)
+	{
+		appendStringInfoChar(command, ')');
+	}
+}
+
+
+/*
+ * ForgetPendingPreparedStatement removes the statement whose PREPARE was sent
+ * over the connection, but didn't succeed yet, from the connection's cache.
+ * This is called when the PREPARE failed, or when its result was discarded.
+ */
+void
+ForgetPendingPreparedStatement(MultiConnection *connection)
+{
+	char *statementKey = connection->pendingPreparedStatementKey;
+	bool found = false;
+
+	if (statementKey == NULL)
+	{
+		return;
+	}
+
+	connection->pendingPreparedStatementKey = NULL;
+
+	if (connection->preparedStatementHash != NULL)
+	{
+		hash_search(connection->preparedStatementHash, &statementKey, HASH_REMOVE,
+					&found);
+	}
+}
+
+
+/*
+ * InvalidateRemotePreparedStatements makes sure statements prepared on remote
+ * nodes are deallocated before they are used again. This is called whenever
+ * the metadata of a distributed table changes, after which the statements may
+ * refer to shards that changed or moved.
+ */
+void
+InvalidateRemotePreparedStatements(void)
+{
+	PreparedStatementGeneration++;
+}
+
+
+/*
+ * ClearPreparedStatementCache forgets about the statements prepared on the
+ * given connection. Note that this does not deallocate the statements on the
+ * remote node.
+ */
+void
+ClearPreparedStatementCache(MultiConnection *connection)
+{
+	if (connection->preparedStatementContext != NULL)
+	{
+		MemoryContextDelete(connection->preparedStatementContext);
+	}
+
+	connection->preparedStatementContext = NULL;
+	connection->preparedStatementHash = NULL;
+	connection->pendingPreparedStatementKey = NULL;
+}
+
+
+/*
+ * CreatePreparedStatementHash creates the hash which maps commands to the
+ * statements prepared for them on the given connection.
+ */
+static void
+CreatePreparedStatementHash(MultiConnection *connection)
+{
+	HASHCTL info;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+
+	connection->preparedStatementContext =
+		AllocSetContextCreate(ConnectionContext, "Prepared Statement Context",
+							  ALLOCSET_SMALL_MINSIZE,
+							  ALLOCSET_SMALL_INITSIZE,
+							  ALLOCSET_SMALL_MAXSIZE);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(char *);
+	info.entrysize = sizeof(PreparedStatementEntry);
+	info.hash = PreparedStatementKeyHash;
+	info.match = PreparedStatementKeyCompare;
+	info.hcxt = connection->preparedStatementContext;
+
+	connection->preparedStatementHash = hash_create("Prepared Statement Hash", 32,
+													&info, hashFlags);
+	connection->preparedStatementGeneration = PreparedStatementGeneration;
+}
+
+
+/* hashes the statement key string a hash key points to */
+static uint32
+PreparedStatementKeyHash(const void *key, Size keysize)
+{
+	const char *statementKey = *((const char **) key);
+
+	return string_hash(statementKey, strlen(statementKey) + 1);
+}
+
+
+/* compares the statement key strings two hash keys point to */
+static int
+PreparedStatementKeyCompare(const void *a, const void *b, Size keysize)
+{
+	const char *firstKey = *((const char **) a);
+	const char *secondKey = *((const char **) b);
+
+	return strcmp(firstKey, secondKey);
+}
+
+
 /*
  * GetRemoteCommandResult is a wrapper around PQgetResult() that handles interrupts.
  *
@@ -343,6 +807,70 @@ SendRemoteCommand(MultiConnection *connection, const char *command)
  */
 PGresult *
 GetRemoteCommandResult(MultiConnection *connection, bool raiseInterrupts)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
+	transaction->pipelinedCommandFailed = false;
+
+	/*
+	 * If deferred commands were sent along with the current command, their
+	 * results come first. Skip them, unless one failed: then the current
+	 * command didn't run, and the failed result is returned in its place.
+	 * pipelinedCommandFailed tells callers that it belongs to a deferred
+	 * command, which the executor already accepted, so that they can abort
+	 * the transaction rather than treat it as a failure of the current
+	 * command on this placement.
+	 */
+	while (transaction->pipelinedResultCount > 0)
+	{
+		PGresult *result = ReceiveRemoteCommandResult(connection, raiseInterrupts);
+
+		transaction->pipelinedResultCount--;
+
+		if (!IsResponseOK(result))
+		{
+			transaction->pipelinedResultCount = 0;
+			transaction->pipelinedCommandFailed = true;
+			MarkRemoteTransactionFailed(connection, false);
+
+			/* a PREPARE sent along didn't run either */
+			ForgetPendingPreparedStatement(connection);
+
+			return result;
+		}
+
+		PQclear(result);
+	}
+
+	/*
+	 * A PREPARE sent along with the current command comes next. If it failed,
+	 * the current command didn't run, and the PREPARE's error is reported as
+	 * the result of the current command.
+	 */
+	if (connection->pendingPreparedStatementKey != NULL)
+	{
+		PGresult *result = ReceiveRemoteCommandResult(connection, raiseInterrupts);
+
+		if (!IsResponseOK(result))
+		{
+			ForgetPendingPreparedStatement(connection);
+			return result;
+		}
+
+		connection->pendingPreparedStatementKey = NULL;
+		PQclear(result);
+	}
+
+	return ReceiveRemoteCommandResult(connection, raiseInterrupts);
+}
+
+
+/*
+ * ReceiveRemoteCommandResult waits for the next result on the connection, as
+ * described for GetRemoteCommandResult.
+ */
+static PGresult *
+ReceiveRemoteCommandResult(MultiConnection *connection, bool raiseInterrupts)
 {
 	PGconn *pgConn = connection->pgConn;
 	int socket = 0;
@@ -487,3 +1015,34 @@ GetRemoteCommandResult(MultiConnection *connection, bool raiseInterrupts)
 
 	return result;
 }
+
+
+/*
+ * SendCancelationRequest asks the remote node to cancel the command currently
+ * running on the given connection. Returns true if the request was sent. The
+ * results of the cancelled command still have to be consumed by the caller.
+ */
+bool
+SendCancelationRequest(MultiConnection *connection)
+{
+	PGcancel *cancelObject = NULL;
+	char errorBuffer[256];
+	int cancelSent = 0;
+
+	cancelObject = PQgetCancel(connection->pgConn);
+	if (cancelObject == NULL)
+	{
+		return false;
+	}
+
+	cancelSent = PQcancel(cancelObject, errorBuffer, sizeof(errorBuffer));
+	if (cancelSent == 0)
+	{
+		ereport(WARNING, (errmsg("could not issue cancel request"),
+						  errdetail("Client error: %s", errorBuffer)));
+	}
+
+	PQfreeCancel(cancelObject);
+
+	return (cancelSent != 0);
+}
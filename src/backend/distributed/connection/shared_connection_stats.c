@@ -0,0 +1,614 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_connection_stats.c
+ *   Accounting of connections to worker nodes across all backends
+ *
+ * Every backend caches its own connections to worker nodes. This file keeps
+ * track, in shared memory, of how many connections all backends together hold
+ * to each node, for any user and database, and treats the connections that
+ * are kept open between transactions as a pool of bounded size: once the
+ * pool for a node is full, backends close their connections at transaction
+ * end instead of keeping them around.
+ *
+ * The same counters enforce a budget on the number of connections all
+ * backends together use at a time on a node. Idle pooled connections, which
+ * the pool already bounds, don't count towards it, as they cannot be taken
+ * away from the backend that keeps them. Backends that would exceed the
+ * budget wait until another backend is done with one of its connections to
+ * the node, so that many concurrent sessions degrade to fewer connections
+ * rather than exhausting max_connections on the node. A backend that itself
+ * uses up the whole budget would wait for itself, so it reuses its own
+ * connections where it can, and only opens more beyond the budget where
+ * they are needed at the same time.
+ *
+ * Copyright (c) 2017, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "distributed/connection_management.h"
+#include "distributed/shared_connection_stats.h"
+#include "distributed/worker_manager.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+
+/* number of columns returned by citus_connection_pool_stats() */
+#define CONNECTION_POOL_STATS_COLUMNS 7
+
+/* number of columns returned by citus_node_connection_usage() */
+#define NODE_CONNECTION_USAGE_COLUMNS 4
+
+/* time to wait between checks whether a connection to a node can be opened */
+#define SHARED_CONNECTION_RETRY_INTERVAL_MS 10
+
+
+int MaxIdleConnectionsPerNode = -1; /* max idle connections per node, -1 for no limit */
+int MaxSharedConnectionsPerNode = -1; /* max connections per node, -1 for no limit */
+
+static SharedConnectionStatsData *SharedConnectionStats = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static Size SharedConnectionStatsShmemSize(void);
+static void SharedConnectionStatsShmemInit(void);
+static SharedConnectionStatsHashEntry * SharedConnectionStatsEntry(const char *hostname,
+																  int32 port,
+																  HASHACTION action);
+static bool TryReserveSharedConnection(const char *hostname, int32 port,
+									   bool exceedBudget, bool *counted);
+
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(citus_connection_pool_stats);
+PG_FUNCTION_INFO_V1(citus_node_connection_usage);
+
+
+/*
+ * InitializeSharedConnectionStats organizes, at startup, that the shared
+ * memory used for connection statistics is allocated.
+ */
+void
+InitializeSharedConnectionStats(void)
+{
+	RequestAddinShmemSpace(SharedConnectionStatsShmemSize());
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = SharedConnectionStatsShmemInit;
+}
+
+
+/* Estimates the shared memory size used for connection statistics. */
+static Size
+SharedConnectionStatsShmemSize(void)
+{
+	Size size = 0;
+	Size hashSize = 0;
+
+	size = add_size(size, sizeof(SharedConnectionStatsData));
+
+	hashSize = hash_estimate_size(MaxWorkerNodesTracked,
+								  sizeof(SharedConnectionStatsHashEntry));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/* Initializes the shared memory used for connection statistics. */
+static void
+SharedConnectionStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+	int hashFlags = 0;
+	long maxTableSize = 0;
+	long initTableSize = 0;
+
+	maxTableSize = (long) MaxWorkerNodesTracked;
+	initTableSize = maxTableSize / 8;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SharedConnectionStatsHashKey);
+	info.entrysize = sizeof(SharedConnectionStatsHashEntry);
+	info.hash = tag_hash;
+	hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	SharedConnectionStats =
+		(SharedConnectionStatsData *) ShmemInitStruct("Shared Connection Stats Control",
+													  sizeof(SharedConnectionStatsData),
+													  &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		/* initialize lwlock protecting the connection statistics hash */
+		LWLockTranche *tranche = &SharedConnectionStats->connectionStatsLockTranche;
+
+		SharedConnectionStats->connectionStatsTrancheId = LWLockNewTrancheId();
+		tranche->array_base = &SharedConnectionStats->connectionStatsLock;
+		tranche->array_stride = sizeof(LWLock);
+		tranche->name = "Shared Connection Stats Tranche";
+		LWLockRegisterTranche(SharedConnectionStats->connectionStatsTrancheId, tranche);
+		LWLockInitialize(&SharedConnectionStats->connectionStatsLock,
+						 SharedConnectionStats->connectionStatsTrancheId);
+	}
+
+	SharedConnectionStats->connectionStatsHash =
+		ShmemInitHash("Shared Connection Stats Hash",
+					  initTableSize, maxTableSize,
+					  &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(SharedConnectionStats->connectionStatsHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * SharedConnectionStatsEntry looks up the statistics entry for the given node,
+ * creating it if action is HASH_ENTER_NULL. Returns NULL if there is no entry,
+ * or if the hash is full. The caller is expected to hold the statistics lock
+ * in the appropriate mode.
+ */
+static SharedConnectionStatsHashEntry *
+SharedConnectionStatsEntry(const char *hostname, int32 port, HASHACTION action)
+{
+	HTAB *connectionStatsHash = SharedConnectionStats->connectionStatsHash;
+	SharedConnectionStatsHashEntry *entry = NULL;
+	SharedConnectionStatsHashKey key;
+	bool found = false;
+
+	/* the key is hashed as a blob, so zero the padding */
+	memset(&key, 0, sizeof(key));
+	strlcpy(key.hostname, hostname, MAX_NODE_LENGTH);
+	key.port = port;
+
+	entry = (SharedConnectionStatsHashEntry *) hash_search(connectionStatsHash, &key,
+														   action, &found);
+	if (entry != NULL && !found)
+	{
+		entry->connectionCount = 0;
+		entry->idleConnectionCount = 0;
+		entry->establishedCount = 0;
+		entry->reusedCount = 0;
+		entry->discardedCount = 0;
+	}
+
+	return entry;
+}
+
+
+/*
+ * ReserveSharedConnection records that a connection to the given node is
+ * about to be opened, by a backend that already uses ownConnectionCount
+ * connections to it. If citus.max_shared_connections_per_node connections to
+ * the node are already in use across all backends, the function waits for
+ * one of them to be released, and errors out if that does not happen within
+ * citus.node_connection_timeout. The caller only opens a new connection after
+ * finding none of its own it can reuse, so if the backend uses all of the
+ * budget itself, waiting would be futile, and the connection is opened beyond
+ * the budget instead. Returns true if the connection is accounted for, and
+ * false if there is no room left to keep track of its node while no budget
+ * is enforced.
+ */
+bool
+ReserveSharedConnection(const char *hostname, int32 port, int ownConnectionCount)
+{
+	TimestampTz waitStart = 0;
+	bool exceedBudget = false;
+	bool counted = false;
+
+	if (MaxSharedConnectionsPerNode >= 0 &&
+		ownConnectionCount >= MaxSharedConnectionsPerNode)
+	{
+		ereport(DEBUG1, (errmsg("opening a connection to %s:%d beyond "
+								"citus.max_shared_connections_per_node",
+								hostname, port),
+						 errdetail("This session already uses all %d connections "
+								   "to the node, and needs all of them at the "
+								   "same time.", MaxSharedConnectionsPerNode)));
+
+		exceedBudget = true;
+	}
+
+	while (!TryReserveSharedConnection(hostname, port, exceedBudget, &counted))
+	{
+		int rc = 0;
+
+		if (waitStart == 0)
+		{
+			waitStart = GetCurrentTimestamp();
+		}
+		else if (TimestampDifferenceExceeds(waitStart, GetCurrentTimestamp(),
+											NodeConnectionTimeout))
+		{
+			ereport(ERROR, (errcode(ERRCODE_TOO_MANY_CONNECTIONS),
+							errmsg("could not open a connection to %s:%d",
+								   hostname, port),
+							errdetail("All %d connections to the node allowed by "
+									  "citus.max_shared_connections_per_node "
+									  "remained in use for %d ms.",
+									  MaxSharedConnectionsPerNode,
+									  NodeConnectionTimeout),
+							errhint("Consider increasing "
+									"citus.max_shared_connections_per_node.")));
+		}
+
+		/* wait on the latch, so that interrupts are processed while waiting */
+		rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   SHARED_CONNECTION_RETRY_INTERVAL_MS);
+		ResetLatch(MyLatch);
+
+		if (rc & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	return counted;
+}
+
+
+/*
+ * TryReserveSharedConnection accounts for a new connection to the given node
+ * if that does not exceed the node's connection budget, or if exceedBudget
+ * is set, and returns whether it did so. counted is set to false if the
+ * connection can be opened, but cannot be accounted for. That is only allowed
+ * if no budget is enforced, as the budget could otherwise be exceeded
+ * unnoticed, so the function errors out in that case.
+ */
+static bool
+TryReserveSharedConnection(const char *hostname, int32 port, bool exceedBudget,
+						   bool *counted)
+{
+	SharedConnectionStatsHashEntry *entry = NULL;
+	bool reserved = true;
+	bool statsHashFull = false;
+
+	*counted = false;
+
+	LWLockAcquire(&SharedConnectionStats->connectionStatsLock, LW_EXCLUSIVE);
+
+	entry = SharedConnectionStatsEntry(hostname, port, HASH_ENTER_NULL);
+
+	if (entry == NULL)
+	{
+		statsHashFull = true;
+	}
+	else if (!exceedBudget && MaxSharedConnectionsPerNode >= 0 &&
+			 entry->connectionCount - entry->idleConnectionCount >=
+			 MaxSharedConnectionsPerNode)
+	{
+		reserved = false;
+	}
+	else
+	{
+		entry->connectionCount++;
+		entry->establishedCount++;
+
+		*counted = true;
+	}
+
+	LWLockRelease(&SharedConnectionStats->connectionStatsLock);
+
+	if (statsHashFull && MaxSharedConnectionsPerNode >= 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+						errmsg("could not open a connection to %s:%d",
+							   hostname, port),
+						errdetail("There is no room left to keep track of the "
+								  "connections to the node, so its connection "
+								  "budget cannot be enforced."),
+						errhint("Consider increasing "
+								"citus.max_worker_nodes_tracked.")));
+	}
+
+	return reserved;
+}
+
+
+/*
+ * SharedConnectionBudgetExhausted returns whether using another connection
+ * to the given node would exceed citus.max_shared_connections_per_node, so
+ * that callers which can make do with the connections they already hold may
+ * avoid waiting for one.
+ */
+bool
+SharedConnectionBudgetExhausted(const char *hostname, int32 port)
+{
+	SharedConnectionStatsHashEntry *entry = NULL;
+	bool budgetExhausted = false;
+
+	if (MaxSharedConnectionsPerNode < 0)
+	{
+		return false;
+	}
+
+	LWLockAcquire(&SharedConnectionStats->connectionStatsLock, LW_SHARED);
+
+	entry = SharedConnectionStatsEntry(hostname, port, HASH_FIND);
+	if (entry != NULL &&
+		entry->connectionCount - entry->idleConnectionCount >=
+		MaxSharedConnectionsPerNode)
+	{
+		budgetExhausted = true;
+	}
+
+	LWLockRelease(&SharedConnectionStats->connectionStatsLock);
+
+	return budgetExhausted;
+}
+
+
+/*
+ * SharedConnectionClosed records that the given connection was closed.
+ */
+void
+SharedConnectionClosed(MultiConnection *connection)
+{
+	SharedConnectionStatsHashEntry *entry = NULL;
+
+	if (!connection->sharedStatsCounted)
+	{
+		return;
+	}
+
+	LWLockAcquire(&SharedConnectionStats->connectionStatsLock, LW_EXCLUSIVE);
+
+	entry = SharedConnectionStatsEntry(connection->hostname, connection->port,
+									   HASH_FIND);
+	if (entry != NULL)
+	{
+		entry->connectionCount--;
+
+		if (connection->idleInSharedPool)
+		{
+			entry->idleConnectionCount--;
+		}
+	}
+
+	LWLockRelease(&SharedConnectionStats->connectionStatsLock);
+
+	connection->sharedStatsCounted = false;
+	connection->idleInSharedPool = false;
+}
+
+
+/*
+ * ReturnConnectionToSharedPool is called at transaction end for connections
+ * that are meant to outlive the transaction. It returns true if the
+ * connection may be kept open, which is the case as long as fewer than
+ * citus.max_idle_connections_per_node connections to the same node, for any
+ * user and database, are idle across all backends. Otherwise the caller
+ * should close the connection.
+ */
+bool
+ReturnConnectionToSharedPool(MultiConnection *connection)
+{
+	SharedConnectionStatsHashEntry *entry = NULL;
+	bool keepConnection = true;
+
+	if (!connection->sharedStatsCounted || connection->idleInSharedPool)
+	{
+		return true;
+	}
+
+	LWLockAcquire(&SharedConnectionStats->connectionStatsLock, LW_EXCLUSIVE);
+
+	entry = SharedConnectionStatsEntry(connection->hostname, connection->port,
+									   HASH_FIND);
+	if (entry != NULL)
+	{
+		if (MaxIdleConnectionsPerNode >= 0 &&
+			entry->idleConnectionCount >= MaxIdleConnectionsPerNode)
+		{
+			entry->discardedCount++;
+			keepConnection = false;
+		}
+		else
+		{
+			/* idle connections no longer count towards the node's budget */
+			entry->idleConnectionCount++;
+			connection->idleInSharedPool = true;
+		}
+	}
+
+	LWLockRelease(&SharedConnectionStats->connectionStatsLock);
+
+	return keepConnection;
+}
+
+
+/*
+ * TakeConnectionFromSharedPool records that a connection kept open between
+ * transactions is used again. As the connection is open already, it is used
+ * even if that exceeds the node's connection budget for a while.
+ */
+void
+TakeConnectionFromSharedPool(MultiConnection *connection)
+{
+	SharedConnectionStatsHashEntry *entry = NULL;
+
+	if (!connection->idleInSharedPool)
+	{
+		return;
+	}
+
+	LWLockAcquire(&SharedConnectionStats->connectionStatsLock, LW_EXCLUSIVE);
+
+	entry = SharedConnectionStatsEntry(connection->hostname, connection->port,
+									   HASH_FIND);
+	if (entry != NULL)
+	{
+		entry->idleConnectionCount--;
+		entry->reusedCount++;
+	}
+
+	LWLockRelease(&SharedConnectionStats->connectionStatsLock);
+
+	connection->idleInSharedPool = false;
+}
+
+
+/*
+ * citus_connection_pool_stats returns, for every node this node's backends
+ * connected to, the number of connections that are currently open and idle,
+ * together with counters of how connections were used since startup.
+ */
+Datum
+citus_connection_pool_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext perQueryContext = NULL;
+	MemoryContext oldContext = NULL;
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = NULL;
+	HASH_SEQ_STATUS status;
+	SharedConnectionStatsHashEntry *entry = NULL;
+	bool randomAccess = true;
+	bool interTransactions = false;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (!rsinfo || !(rsinfo->allowedModes & SFRM_Materialize))
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not "
+						"allowed in this context")));
+	}
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		ereport(ERROR, (errmsg("return type must be a row type")));
+	}
+
+	perQueryContext = rsinfo->econtext->ecxt_per_query_memory;
+	oldContext = MemoryContextSwitchTo(perQueryContext);
+
+	tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
+	tupleStore = tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+
+	LWLockAcquire(&SharedConnectionStats->connectionStatsLock, LW_SHARED);
+
+	hash_seq_init(&status, SharedConnectionStats->connectionStatsHash);
+	while ((entry = (SharedConnectionStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		Datum values[CONNECTION_POOL_STATS_COLUMNS];
+		bool isNulls[CONNECTION_POOL_STATS_COLUMNS];
+
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = CStringGetTextDatum(entry->key.hostname);
+		values[1] = Int32GetDatum(entry->key.port);
+		values[2] = Int32GetDatum(entry->connectionCount);
+		values[3] = Int32GetDatum(entry->idleConnectionCount);
+		values[4] = Int64GetDatum(entry->establishedCount);
+		values[5] = Int64GetDatum(entry->reusedCount);
+		values[6] = Int64GetDatum(entry->discardedCount);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&SharedConnectionStats->connectionStatsLock);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupleStore;
+	rsinfo->setDesc = tupleDescriptor;
+
+	MemoryContextSwitchTo(oldContext);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_node_connection_usage returns, for every node this node's backends
+ * connected to, the number of connections all backends together use on it,
+ * and how many they may use at most. Idle pooled connections are not
+ * included, as they don't count towards the budget.
+ */
+Datum
+citus_node_connection_usage(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext perQueryContext = NULL;
+	MemoryContext oldContext = NULL;
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = NULL;
+	HASH_SEQ_STATUS status;
+	SharedConnectionStatsHashEntry *entry = NULL;
+	bool randomAccess = true;
+	bool interTransactions = false;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (!rsinfo || !(rsinfo->allowedModes & SFRM_Materialize))
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not "
+						"allowed in this context")));
+	}
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		ereport(ERROR, (errmsg("return type must be a row type")));
+	}
+
+	perQueryContext = rsinfo->econtext->ecxt_per_query_memory;
+	oldContext = MemoryContextSwitchTo(perQueryContext);
+
+	tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
+	tupleStore = tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+
+	LWLockAcquire(&SharedConnectionStats->connectionStatsLock, LW_SHARED);
+
+	hash_seq_init(&status, SharedConnectionStats->connectionStatsHash);
+	while ((entry = (SharedConnectionStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		Datum values[NODE_CONNECTION_USAGE_COLUMNS];
+		bool isNulls[NODE_CONNECTION_USAGE_COLUMNS];
+
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = CStringGetTextDatum(entry->key.hostname);
+		values[1] = Int32GetDatum(entry->key.port);
+		values[2] = Int32GetDatum(entry->connectionCount - entry->idleConnectionCount);
+		values[3] = Int32GetDatum(MaxSharedConnectionsPerNode);
+
+		/* there is no maximum if the budget is not enforced */
+		if (MaxSharedConnectionsPerNode < 0)
+		{
+			isNulls[3] = true;
+		}
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&SharedConnectionStats->connectionStatsLock);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupleStore;
+	rsinfo->setDesc = tupleDescriptor;
+
+	MemoryContextSwitchTo(oldContext);
+
+	PG_RETURN_VOID();
+}
@@ -14,6 +14,7 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "funcapi.h"
 #include "libpq-fe.h"
 #include "miscadmin.h"
 
@@ -23,6 +24,9 @@
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/remote_commands.h"
+#include "storage/latch.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
 
 #include <errno.h>
 #include <unistd.h>
@@ -52,6 +56,13 @@ static PostgresPollingStatusType ClientPollingStatusArray[MAX_CONNECTION_COUNT];
 static void ClearRemainingResults(MultiConnection *connection);
 static bool ClientConnectionReady(MultiConnection *connection,
 								  PostgresPollingStatusType pollingStatus);
+static int WaitForConnections(WaitInfo *waitInfo, long timeout);
+static void UpdateWaiterEvents(WaitInfo *waitInfo, int32 connectionId,
+							   uint32 waitEvents);
+#if (PG_VERSION_NUM >= 90600)
+static void RebuildWaitEventSet(WaitInfo *waitInfo);
+static void WaitInfoCleanupCallback(void *arg);
+#endif
 
 
 /* AllocateConnectionId returns a connection id from the connection pool. */
@@ -322,6 +333,37 @@ MultiClientSendQuery(int32 connectionId, const char *query)
 }
 
 
+/*
+ * MultiClientSendSingleRowQuery sends the given query over the given connection,
+ * and switches the connection into single-row mode. Results of the query can
+ * then be read incrementally with MultiClientReceiveTuples.
+ */
+bool
+MultiClientSendSingleRowQuery(int32 connectionId, const char *query)
+{
+	MultiConnection *connection = NULL;
+	bool querySent = false;
+	int singleRowMode = 0;
+
+	querySent = MultiClientSendQuery(connectionId, query);
+	if (!querySent)
+	{
+		return false;
+	}
+
+	connection = ClientConnectionArray[connectionId];
+	singleRowMode = PQsetSingleRowMode(connection->pgConn);
+	if (singleRowMode == 0)
+	{
+		ereport(WARNING, (errmsg("could not set single-row mode for remote query "
+								 "\"%s\"", query)));
+		return false;
+	}
+
+	return true;
+}
+
+
 /* MultiClientCancel cancels the running query on the given connection. */
 bool
 MultiClientCancel(int32 connectionId)
@@ -704,123 +746,658 @@ MultiClientCopyData(int32 connectionId, int32 fileDescriptor)
 }
 
 
+/*
+ * MultiClientReceiveTuples reads the rows that have arrived so far for a query
+ * sent with MultiClientSendSingleRowQuery, builds tuples from them, and appends
+ * these tuples to the destination's tuple store. Like MultiClientCopyData, the
+ * function doesn't block, and returns CLIENT_COPY_MORE if the query has more
+ * rows to send. The number of tuples stored is added to tupleCount.
+ */
+CopyStatus
+MultiClientReceiveTuples(int32 connectionId, TupleDestination *tupleDestination,
+						 uint64 *tupleCount)
+{
+	MultiConnection *connection = NULL;
+	AttInMetadata *attributeInputMetadata = tupleDestination->attributeInputMetadata;
+	uint32 expectedColumnCount = attributeInputMetadata->tupdesc->natts;
+	char **columnArray = NULL;
+	int consumed = 0;
+	CopyStatus copyStatus = CLIENT_COPY_MORE;
+
+	Assert(connectionId != INVALID_CONNECTION_ID);
+	connection = ClientConnectionArray[connectionId];
+	Assert(connection != NULL);
+
+	consumed = PQconsumeInput(connection->pgConn);
+	if (consumed == 0)
+	{
+		ereport(WARNING, (errmsg("could not read data from worker node")));
+		return CLIENT_COPY_FAILED;
+	}
+
+	columnArray = (char **) palloc0(expectedColumnCount * sizeof(char *));
+
+	/* read all results we can get without blocking */
+	while (PQisBusy(connection->pgConn) == 0)
+	{
+		PGresult *result = PQgetResult(connection->pgConn);
+		ExecStatusType resultStatus = PGRES_COMMAND_OK;
+		uint32 rowIndex = 0;
+		uint32 rowCount = 0;
+
+		if (result == NULL)
+		{
+			/* the query finished, and we received all of its rows */
+			copyStatus = CLIENT_COPY_DONE;
+			break;
+		}
+
+		resultStatus = PQresultStatus(result);
+		if (resultStatus != PGRES_SINGLE_TUPLE && resultStatus != PGRES_TUPLES_OK)
+		{
+			ReportResultError(connection, result, WARNING);
+			PQclear(result);
+
+			/* make sure we drain all results from libpq */
+			ClearRemainingResults(connection);
+
+			copyStatus = CLIENT_COPY_FAILED;
+			break;
+		}
+
+		rowCount = PQntuples(result);
+		Assert(PQnfields(result) == expectedColumnCount);
+
+		for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			HeapTuple heapTuple = NULL;
+			MemoryContext oldContext = NULL;
+			uint32 columnIndex = 0;
+
+			for (columnIndex = 0; columnIndex < expectedColumnCount; columnIndex++)
+			{
+				if (PQgetisnull(result, rowIndex, columnIndex))
+				{
+					columnArray[columnIndex] = NULL;
+				}
+				else
+				{
+					columnArray[columnIndex] = PQgetvalue(result, rowIndex, columnIndex);
+				}
+			}
+
+			/* protect against leaks in type input functions */
+			oldContext = MemoryContextSwitchTo(tupleDestination->tupleContext);
+
+			heapTuple = BuildTupleFromCStrings(attributeInputMetadata, columnArray);
+
+			MemoryContextSwitchTo(oldContext);
+
+			tuplestore_puttuple(tupleDestination->tupleStore, heapTuple);
+			MemoryContextReset(tupleDestination->tupleContext);
+			tupleDestination->tupleCount++;
+			(*tupleCount)++;
+		}
+
+		PQclear(result);
+	}
+
+	pfree(columnArray);
+
+	return copyStatus;
+}
+
+
 /*
  * MultiClientCreateWaitInfo creates a WaitInfo structure, capable of keeping
  * track of what maxConnections connections are waiting for; to allow
  * efficiently waiting for all of them at once.
  *
- * Connections can be added using MultiClientRegisterWait(). All added
+ * Connections can be added using MultiClientRegisterWait(), and stay registered
+ * until they are removed using MultiClientUnregisterWait(). All registered
  * connections can then be waited upon together using MultiClientWait().
  */
 WaitInfo *
 MultiClientCreateWaitInfo(int maxConnections)
 {
-	WaitInfo *waitInfo = palloc(sizeof(WaitInfo));
+	WaitInfo *waitInfo = NULL;
+	int32 connectionId = 0;
+#if (PG_VERSION_NUM >= 90600)
+	MemoryContext waitInfoContext = NULL;
+	MemoryContext oldContext = NULL;
+
+	/*
+	 * The wait event set holds a file descriptor, which has to be released on
+	 * error as well, by a reset callback of the memory context it lives in.
+	 * The WaitInfo therefore gets a context of its own, which is deleted when
+	 * the WaitInfo is freed.
+	 */
+	waitInfoContext = AllocSetContextCreate(CurrentMemoryContext,
+											"Wait Info Context",
+											ALLOCSET_SMALL_MINSIZE,
+											ALLOCSET_SMALL_INITSIZE,
+											ALLOCSET_DEFAULT_MAXSIZE);
+	oldContext = MemoryContextSwitchTo(waitInfoContext);
+#endif
 
+	waitInfo = palloc0(sizeof(WaitInfo));
 	waitInfo->maxWaiters = maxConnections;
-	waitInfo->pollfds = palloc(maxConnections * sizeof(struct pollfd));
+	waitInfo->connectionWaiters = palloc0(MAX_CONNECTION_COUNT *
+										  sizeof(ConnectionWaiter));
+	waitInfo->waiterConnectionIds = palloc0(maxConnections * sizeof(int32));
+	waitInfo->readyConnectionIds = palloc0(maxConnections * sizeof(int32));
+
+	for (connectionId = 0; connectionId < MAX_CONNECTION_COUNT; connectionId++)
+	{
+		ConnectionWaiter *waiter = &waitInfo->connectionWaiters[connectionId];
+
+		waiter->waiterIndex = -1;
+		waiter->eventPosition = -1;
+		waiter->socket = PGINVALID_SOCKET;
+	}
+
+#if (PG_VERSION_NUM >= 90600)
+
+	/*
+	 * Closed sockets may leave stale entries behind in the wait event set, so
+	 * leave room for as many of them as there are live ones; the set is then
+	 * compacted when it fills up. Two more entries are used for the latch and
+	 * for postmaster death.
+	 */
+	waitInfo->waitEventSetSize = 2 * maxConnections + 2;
+	waitInfo->occurredEvents = palloc0(waitInfo->waitEventSetSize *
+									   sizeof(WaitEvent));
+
+	waitInfo->memoryContext = waitInfoContext;
+	waitInfo->cleanupCallback.func = WaitInfoCleanupCallback;
+	waitInfo->cleanupCallback.arg = (void *) waitInfo;
+	MemoryContextRegisterResetCallback(waitInfoContext, &waitInfo->cleanupCallback);
+#else
+	waitInfo->pollfds = palloc0(maxConnections * sizeof(struct pollfd));
+#endif
+
+	waitInfo->readyConnectionCount = 0;
+	waitInfo->processAllWaiters = true;
+	waitInfo->waitersChanged = true;
 
 	/* initialize remaining fields */
 	MultiClientResetWaitInfo(waitInfo);
 
+#if (PG_VERSION_NUM >= 90600)
+	MemoryContextSwitchTo(oldContext);
+#endif
+
 	return waitInfo;
 }
 
 
-/* MultiClientResetWaitInfo clears all pending waits from a WaitInfo. */
+/*
+ * MultiClientResetWaitInfo clears the per-cycle state of a WaitInfo. Registered
+ * connections stay registered.
+ */
 void
 MultiClientResetWaitInfo(WaitInfo *waitInfo)
 {
-	waitInfo->registeredWaiters = 0;
 	waitInfo->haveReadyWaiter = false;
 	waitInfo->haveFailedWaiter = false;
 }
 
 
-/* MultiClientFreeWaitInfo frees a resources associated with a waitInfo struct. */
+/*
+ * MultiClientFreeWaitInfo frees resources associated with a waitInfo struct,
+ * and the struct itself.
+ */
 void
 MultiClientFreeWaitInfo(WaitInfo *waitInfo)
 {
+#if (PG_VERSION_NUM >= 90600)
+
+	/* the reset callback releases the wait event set */
+	MemoryContextDelete(waitInfo->memoryContext);
+#else
 	pfree(waitInfo->pollfds);
+	pfree(waitInfo->connectionWaiters);
+	pfree(waitInfo->waiterConnectionIds);
+	pfree(waitInfo->readyConnectionIds);
 	pfree(waitInfo);
+#endif
 }
 
 
 /*
- * MultiClientRegisterWait adds a connection to be waited upon, waiting for
- * executionStatus.
+ * MultiClientRegisterWait records that the given connection is waiting for
+ * executionStatus. If the connection is already registered, only its wait
+ * condition is updated.
  */
 void
 MultiClientRegisterWait(WaitInfo *waitInfo, TaskExecutionStatus executionStatus,
 						int32 connectionId)
 {
 	MultiConnection *connection = NULL;
-	struct pollfd *pollfd = NULL;
-
-	Assert(waitInfo->registeredWaiters < waitInfo->maxWaiters);
+	ConnectionWaiter *waiter = NULL;
+	int socket = PGINVALID_SOCKET;
 
 	if (executionStatus == TASK_STATUS_READY)
 	{
 		waitInfo->haveReadyWaiter = true;
-		return;
 	}
 	else if (executionStatus == TASK_STATUS_ERROR)
 	{
 		waitInfo->haveFailedWaiter = true;
+	}
+
+	if (connectionId == INVALID_CONNECTION_ID)
+	{
 		return;
 	}
 
 	connection = ClientConnectionArray[connectionId];
-	pollfd = &waitInfo->pollfds[waitInfo->registeredWaiters];
-	pollfd->fd = PQsocket(connection->pgConn);
+	Assert(connection != NULL);
+
+	socket = PQsocket(connection->pgConn);
+	waiter = &waitInfo->connectionWaiters[connectionId];
+
+	if (waiter->waiterIndex < 0)
+	{
+		Assert(waitInfo->registeredWaiters < waitInfo->maxWaiters);
+
+		waiter->waiterIndex = waitInfo->registeredWaiters;
+		waiter->socket = socket;
+		waiter->waitEvents = 0;
+		waiter->eventPosition = -1;
+		waiter->ready = false;
+
+		waitInfo->waiterConnectionIds[waitInfo->registeredWaiters] = connectionId;
+		waitInfo->registeredWaiters++;
+	}
+	else if (waiter->socket != socket)
+	{
+		/* the connection id got reused for another connection, start over */
+		waiter->socket = socket;
+		waiter->eventPosition = -1;
+		waitInfo->waitersChanged = true;
+	}
+
+	waiter->waitStatus = executionStatus;
+
+	/*
+	 * We only change the socket events we listen for when the connection
+	 * waits on its socket. Connections that are ready keep their previous
+	 * events; those get processed on every cycle anyway.
+	 */
 	if (executionStatus == TASK_STATUS_SOCKET_READ)
 	{
-		pollfd->events = POLLERR | POLLIN;
+		UpdateWaiterEvents(waitInfo, connectionId, WL_SOCKET_READABLE);
 	}
 	else if (executionStatus == TASK_STATUS_SOCKET_WRITE)
 	{
-		pollfd->events = POLLERR | POLLOUT;
+		UpdateWaiterEvents(waitInfo, connectionId, WL_SOCKET_WRITEABLE);
+	}
+}
+
+
+/*
+ * MultiClientUnregisterWait removes the given connection from the connections
+ * waited upon. Callers should unregister a connection once they stop using
+ * it, and in particular after disconnecting it.
+ */
+void
+MultiClientUnregisterWait(WaitInfo *waitInfo, int32 connectionId)
+{
+	ConnectionWaiter *waiter = NULL;
+	int lastWaiterIndex = 0;
+	int32 lastConnectionId = INVALID_CONNECTION_ID;
+
+	if (connectionId == INVALID_CONNECTION_ID)
+	{
+		return;
+	}
+
+	waiter = &waitInfo->connectionWaiters[connectionId];
+	if (waiter->waiterIndex < 0)
+	{
+		return;
+	}
+
+	if (waiter->eventPosition >= 0)
+	{
+#if (PG_VERSION_NUM >= 90600) && defined(HAVE_SYS_EPOLL_H)
+		MultiConnection *connection = ClientConnectionArray[connectionId];
+
+		/*
+		 * The kernel drops closed sockets from an epoll set by itself, so a
+		 * stale entry for a closed connection is harmless and gets compacted
+		 * away once the set fills up. Sockets that stay open need to leave
+		 * the set right away.
+		 */
+		if (connection != NULL && PQsocket(connection->pgConn) == waiter->socket)
+		{
+			waitInfo->waitersChanged = true;
+		}
+#else
+		waitInfo->waitersChanged = true;
+#endif
+	}
+
+	/* move the last registered waiter into the freed up slot */
+	lastWaiterIndex = waitInfo->registeredWaiters - 1;
+	lastConnectionId = waitInfo->waiterConnectionIds[lastWaiterIndex];
+	waitInfo->waiterConnectionIds[waiter->waiterIndex] = lastConnectionId;
+	waitInfo->connectionWaiters[lastConnectionId].waiterIndex = waiter->waiterIndex;
+	waitInfo->registeredWaiters--;
+
+	waiter->waitStatus = TASK_STATUS_INVALID;
+	waiter->waiterIndex = -1;
+	waiter->socket = PGINVALID_SOCKET;
+	waiter->waitEvents = 0;
+	waiter->eventPosition = -1;
+}
+
+
+/*
+ * MultiClientWaitReady returns whether the given connection needs to be
+ * processed after the most recent MultiClientWait(). That is the case unless
+ * the connection is waiting on its socket and the wait did not report that
+ * socket as ready.
+ */
+bool
+MultiClientWaitReady(WaitInfo *waitInfo, int32 connectionId)
+{
+	ConnectionWaiter *waiter = NULL;
+
+	if (connectionId == INVALID_CONNECTION_ID || waitInfo->processAllWaiters)
+	{
+		return true;
 	}
-	waitInfo->registeredWaiters++;
+
+	waiter = &waitInfo->connectionWaiters[connectionId];
+	if (waiter->waiterIndex < 0)
+	{
+		return true;
+	}
+
+	if (waiter->waitStatus != TASK_STATUS_SOCKET_READ &&
+		waiter->waitStatus != TASK_STATUS_SOCKET_WRITE)
+	{
+		return true;
+	}
+
+	return waiter->ready;
 }
 
 
 /*
- * MultiClientWait waits until at least one connection added with
+ * MultiClientWait waits until at least one connection registered with
  * MultiClientRegisterWait is ready to be processed again.
  */
 void
 MultiClientWait(WaitInfo *waitInfo)
 {
 	/*
-	 * If we had a failure, we always want to sleep for a bit, to prevent
-	 * flooding the other system, probably making the situation worse.
+	 * Limit the maximum time spent waiting in one wait cycle, as insurance
+	 * against edge cases. For efficiency we don't want wake up quite as often
+	 * as citus.remote_task_check_interval, so rather arbitrarily sleep ten
+	 * times as long.
+	 */
+	long timeout = RemoteTaskCheckInterval * 10;
+
+	/*
+	 * If there are tasks that already need attention again, only check which
+	 * other connections became ready in the meantime. Failed tasks back off on
+	 * their own, but we need to wake up in time for their retries. We don't
+	 * sleep across the board anymore after a failure, so that the other tasks
+	 * can still progress.
 	 */
-	if (waitInfo->haveFailedWaiter)
+	if (waitInfo->haveReadyWaiter)
+	{
+		timeout = 0;
+	}
+	else if (waitInfo->haveFailedWaiter)
+	{
+		timeout = RemoteTaskCheckInterval;
+	}
+
+	MultiClientWaitWithTimeout(waitInfo, timeout);
+}
+
+
+/*
+ * MultiClientWaitWithTimeout waits for at most timeout milliseconds until at
+ * least one registered connection is ready to be processed again, and records
+ * which connections became ready. If the wait ends without any connection
+ * becoming ready, all connections are considered to need processing.
+ */
+void
+MultiClientWaitWithTimeout(WaitInfo *waitInfo, long timeout)
+{
+	int readyIndex = 0;
+	int readyCount = 0;
+
+	/* forget about connections reported as ready by the previous wait */
+	for (readyIndex = 0; readyIndex < waitInfo->readyConnectionCount; readyIndex++)
 	{
-		long sleepIntervalPerCycle = RemoteTaskCheckInterval * 1000L;
+		int32 connectionId = waitInfo->readyConnectionIds[readyIndex];
+		waitInfo->connectionWaiters[connectionId].ready = false;
+	}
+
+	waitInfo->readyConnectionCount = 0;
+	waitInfo->processAllWaiters = false;
+
+	readyCount = WaitForConnections(waitInfo, timeout);
+	if (readyCount == 0 && timeout > 0)
+	{
+		ereport(DEBUG5, (errmsg("waiting for activity on tasks took longer than "
+								"%ld ms", timeout)));
+
+		waitInfo->processAllWaiters = true;
+	}
+}
+
+
+#if (PG_VERSION_NUM >= 90600)
 
-		pg_usleep(sleepIntervalPerCycle);
+
+/*
+ * WaitForConnections waits on the WaitInfo's wait event set, rebuilding the
+ * set first if registered sockets were replaced or removed, and marks the
+ * connections whose sockets became ready. The function returns the number of
+ * ready connections.
+ */
+static int
+WaitForConnections(WaitInfo *waitInfo, long timeout)
+{
+	int eventCount = 0;
+	int eventIndex = 0;
+
+	if (waitInfo->waitEventSet == NULL || waitInfo->waitersChanged)
+	{
+		RebuildWaitEventSet(waitInfo);
+	}
+
+	eventCount = WaitEventSetWait(waitInfo->waitEventSet, timeout,
+								  waitInfo->occurredEvents,
+								  waitInfo->waitEventSetSize);
+
+	for (eventIndex = 0; eventIndex < eventCount; eventIndex++)
+	{
+		WaitEvent *event = &waitInfo->occurredEvents[eventIndex];
+		int32 connectionId = INVALID_CONNECTION_ID;
+		ConnectionWaiter *waiter = NULL;
+
+		if (event->events & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
+
+		if (event->events & WL_LATCH_SET)
+		{
+			/* the executor checks for pending interrupts after we return */
+			ResetLatch(MyLatch);
+			continue;
+		}
+
+		connectionId = (int32) (intptr_t) event->user_data;
+		waiter = &waitInfo->connectionWaiters[connectionId];
+
+		/* skip events for connections that left the set in the meantime */
+		if (waiter->eventPosition != event->pos || waiter->ready)
+		{
+			continue;
+		}
+
+		waiter->ready = true;
+		waitInfo->readyConnectionIds[waitInfo->readyConnectionCount] = connectionId;
+		waitInfo->readyConnectionCount++;
+	}
+
+	return waitInfo->readyConnectionCount;
+}
+
+
+/*
+ * RebuildWaitEventSet replaces the WaitInfo's wait event set with a new one,
+ * holding the latch, postmaster death, and the sockets of all registered
+ * connections that wait for socket events.
+ */
+static void
+RebuildWaitEventSet(WaitInfo *waitInfo)
+{
+	WaitEventSet *waitEventSet = NULL;
+	int waiterIndex = 0;
+
+	if (waitInfo->waitEventSet != NULL)
+	{
+		FreeWaitEventSet(waitInfo->waitEventSet);
+		waitInfo->waitEventSet = NULL;
+	}
+
+	waitEventSet = CreateWaitEventSet(waitInfo->memoryContext,
+									  waitInfo->waitEventSetSize);
+	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL,
+					  NULL);
+
+	waitInfo->waitEventSet = waitEventSet;
+	waitInfo->waitEventCount = 2;
+
+	for (waiterIndex = 0; waiterIndex < waitInfo->registeredWaiters; waiterIndex++)
+	{
+		int32 connectionId = waitInfo->waiterConnectionIds[waiterIndex];
+		ConnectionWaiter *waiter = &waitInfo->connectionWaiters[connectionId];
+
+		waiter->eventPosition = -1;
+		if (waiter->waitEvents != 0)
+		{
+			waiter->eventPosition = AddWaitEventToSet(waitEventSet, waiter->waitEvents,
+													  waiter->socket, NULL,
+													  (void *) (intptr_t) connectionId);
+			waitInfo->waitEventCount++;
+		}
+	}
+
+	waitInfo->waitersChanged = false;
+}
+
+
+/*
+ * UpdateWaiterEvents changes the socket events the given connection waits for.
+ * Where possible, the existing wait event set is adjusted in place; otherwise
+ * the change is picked up when the set is rebuilt before the next wait.
+ */
+static void
+UpdateWaiterEvents(WaitInfo *waitInfo, int32 connectionId, uint32 waitEvents)
+{
+	ConnectionWaiter *waiter = &waitInfo->connectionWaiters[connectionId];
+
+	if (waiter->waitEvents == waitEvents && waiter->eventPosition >= 0)
+	{
 		return;
 	}
 
-	/* if there are tasks that already need attention again, don't wait */
-	if (waitInfo->haveReadyWaiter)
+	waiter->waitEvents = waitEvents;
+
+	if (waitInfo->waitEventSet == NULL || waitInfo->waitersChanged)
 	{
 		return;
 	}
 
+	if (waiter->eventPosition >= 0)
+	{
+		ModifyWaitEvent(waitInfo->waitEventSet, waiter->eventPosition, waitEvents,
+						NULL);
+	}
+	else if (waitInfo->waitEventCount < waitInfo->waitEventSetSize)
+	{
+		waiter->eventPosition = AddWaitEventToSet(waitInfo->waitEventSet, waitEvents,
+												  waiter->socket, NULL,
+												  (void *) (intptr_t) connectionId);
+		waitInfo->waitEventCount++;
+	}
+	else
+	{
+		/* the set is full of stale entries, compact it before the next wait */
+		waitInfo->waitersChanged = true;
+	}
+}
+
+
+/*
+ * WaitInfoCleanupCallback releases the wait event set of a WaitInfo whose
+ * memory context gets reset, in case the executor errored out before freeing
+ * it.
+ */
+static void
+WaitInfoCleanupCallback(void *arg)
+{
+	WaitInfo *waitInfo = (WaitInfo *) arg;
+
+	if (waitInfo->waitEventSet != NULL)
+	{
+		FreeWaitEventSet(waitInfo->waitEventSet);
+		waitInfo->waitEventSet = NULL;
+	}
+}
+
+
+#else
+
+
+/*
+ * WaitForConnections fills the poll() array from the registered connections,
+ * polls them, and marks the connections whose sockets became ready. The
+ * function returns the number of ready connections.
+ */
+static int
+WaitForConnections(WaitInfo *waitInfo, long timeout)
+{
+	int waiterIndex = 0;
+
+	for (waiterIndex = 0; waiterIndex < waitInfo->registeredWaiters; waiterIndex++)
+	{
+		int32 connectionId = waitInfo->waiterConnectionIds[waiterIndex];
+		ConnectionWaiter *waiter = &waitInfo->connectionWaiters[connectionId];
+		struct pollfd *pollfd = &waitInfo->pollfds[waiterIndex];
+
+		/* poll() ignores negative file descriptors */
+		pollfd->fd = -1;
+		pollfd->events = 0;
+		pollfd->revents = 0;
+
+		if (waiter->waitEvents == WL_SOCKET_READABLE)
+		{
+			pollfd->fd = waiter->socket;
+			pollfd->events = POLLERR | POLLIN;
+		}
+		else if (waiter->waitEvents == WL_SOCKET_WRITEABLE)
+		{
+			pollfd->fd = waiter->socket;
+			pollfd->events = POLLERR | POLLOUT;
+		}
+	}
+
 	while (true)
 	{
-		/*
-		 * Wait for activity on any of the sockets. Limit the maximum time
-		 * spent waiting in one wait cycle, as insurance against edge
-		 * cases. For efficiency we don't want wake up quite as often as
-		 * citus.remote_task_check_interval, so rather arbitrarily sleep ten
-		 * times as long.
-		 */
-		int rc = poll(waitInfo->pollfds, waitInfo->registeredWaiters,
-					  RemoteTaskCheckInterval * 10);
+		int rc = poll(waitInfo->pollfds, waitInfo->registeredWaiters, timeout);
 
 		if (rc < 0)
 		{
@@ -842,22 +1419,47 @@ MultiClientWait(WaitInfo *waitInfo)
 								errmsg("poll failed: %m")));
 			}
 		}
-		else if (rc == 0)
+
+		break;
+	}
+
+	for (waiterIndex = 0; waiterIndex < waitInfo->registeredWaiters; waiterIndex++)
+	{
+		int32 connectionId = waitInfo->waiterConnectionIds[waiterIndex];
+		ConnectionWaiter *waiter = &waitInfo->connectionWaiters[connectionId];
+		struct pollfd *pollfd = &waitInfo->pollfds[waiterIndex];
+
+		if (pollfd->revents != 0)
 		{
-			ereport(DEBUG5,
-					(errmsg("waiting for activity on tasks took longer than %ld ms",
-							(long) RemoteTaskCheckInterval * 10)));
+			waiter->ready = true;
+			waitInfo->readyConnectionIds[waitInfo->readyConnectionCount] = connectionId;
+			waitInfo->readyConnectionCount++;
 		}
-
-		/*
-		 * At least one fd changed received a readiness notification, time to
-		 * process tasks again.
-		 */
-		return;
 	}
+
+	waitInfo->waitersChanged = false;
+
+	return waitInfo->readyConnectionCount;
+}
+
+
+/*
+ * UpdateWaiterEvents changes the socket events the given connection waits for.
+ * The poll() array is rebuilt before every wait, so there is nothing else to
+ * do.
+ */
+static void
+UpdateWaiterEvents(WaitInfo *waitInfo, int32 connectionId, uint32 waitEvents)
+{
+	ConnectionWaiter *waiter = &waitInfo->connectionWaiters[connectionId];
+
+	waiter->waitEvents = waitEvents;
 }
 
 
+#endif /* (PG_VERSION_NUM >= 90600) */
+
+
 /*
  * ClearRemainingResults reads result objects from the connection until we get
  * null, and clears these results. This is the last step in completing an async
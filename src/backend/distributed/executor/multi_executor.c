@@ -10,6 +10,7 @@
 
 #include "postgres.h"
 
+#include "funcapi.h"
 #include "miscadmin.h"
 
 #include "access/xact.h"
@@ -84,6 +85,11 @@ static CustomExecMethods RouterSelectCustomExecMethods = {
 /* local function forward declarations */
 static void PrepareMasterJobDirectory(Job *workerJob);
 static void LoadTuplesIntoTupleStore(CitusScanState *citusScanState, Job *workerJob);
+static void ExecuteJobIntoTupleStore(CitusScanState *citusScanState, Job *workerJob);
+static TupleDestination * CreateTupleDestination(CitusScanState *citusScanState);
+static void BeginStreamingScan(CitusScanState *citusScanState, Job *workerJob);
+static TupleTableSlot * ReturnStreamedTuple(CitusScanState *citusScanState);
+static void EndStreamingScan(CitusScanState *citusScanState);
 static Relation StubRelation(TupleDesc tupleDescriptor);
 
 
@@ -189,12 +195,17 @@ DelayedErrorCreateScan(CustomScan *scan)
 
 
 /*
- * CitusSelectBeginScan is an empty function for BeginCustomScan callback.
+ * CitusSelectBeginScan is the BeginCustomScan callback of select queries. It
+ * only remembers whether the scan may have to move backwards or be rewound,
+ * in which case results cannot be streamed.
  */
 void
 CitusSelectBeginScan(CustomScanState *node, EState *estate, int eflags)
 {
-	/* just an empty function */
+	CitusScanState *scanState = (CitusScanState *) node;
+	int randomAccessFlags = EXEC_FLAG_BACKWARD | EXEC_FLAG_REWIND | EXEC_FLAG_MARK;
+
+	scanState->randomAccess = ((eflags & randomAccessFlags) != 0);
 }
 
 
@@ -202,7 +213,12 @@ CitusSelectBeginScan(CustomScanState *node, EState *estate, int eflags)
  * RealTimeExecScan is a callback function which returns next tuple from a real-time
  * execution. In the first call, it executes distributed real-time plan and loads
  * results from temporary files into custom scan's tuple store. Then, it returns
- * tuples one by one from this tuple store.
+ * tuples one by one from this tuple store. If citus.real_time_results_in_memory
+ * is set, task results are stored in the tuple store without temporary files.
+ * If citus.stream_real_time_results is set, tuples are returned as soon as any
+ * task delivers them, while the remaining tasks are still running. If
+ * citus.combine_real_time_tasks is set, tasks that run on the same workers are
+ * combined before execution.
  */
 TupleTableSlot *
 RealTimeExecScan(CustomScanState *node)
@@ -215,10 +231,35 @@ RealTimeExecScan(CustomScanState *node)
 		MultiPlan *multiPlan = scanState->multiPlan;
 		Job *workerJob = multiPlan->workerJob;
 
-		PrepareMasterJobDirectory(workerJob);
-		MultiRealTimeExecute(workerJob);
+		if (scanState->realTimeExecution == NULL)
+		{
+			if (CombineRealTimeTasks)
+			{
+				workerJob = CombineTasksPerWorker(workerJob);
+			}
 
-		LoadTuplesIntoTupleStore(scanState, workerJob);
+			if (StreamRealTimeResults)
+			{
+				BeginStreamingScan(scanState, workerJob);
+			}
+		}
+
+		if (scanState->realTimeExecution != NULL)
+		{
+			return ReturnStreamedTuple(scanState);
+		}
+
+		if (RealTimeResultsInMemory)
+		{
+			ExecuteJobIntoTupleStore(scanState, workerJob);
+		}
+		else
+		{
+			PrepareMasterJobDirectory(workerJob);
+			MultiRealTimeExecute(workerJob, NULL);
+
+			LoadTuplesIntoTupleStore(scanState, workerJob);
+		}
 
 		scanState->finishedRemoteScan = true;
 	}
@@ -245,6 +286,166 @@ PrepareMasterJobDirectory(Job *workerJob)
 }
 
 
+/*
+ * ExecuteJobIntoTupleStore executes the given job using the real-time executor,
+ * and has the executor store task results directly into the tuple store of the
+ * given scan state. This avoids writing the results into files in the master
+ * job directory, and parsing them again afterwards.
+ */
+static void
+ExecuteJobIntoTupleStore(CitusScanState *citusScanState, Job *workerJob)
+{
+	TupleDestination *tupleDestination = CreateTupleDestination(citusScanState);
+
+	MultiRealTimeExecute(workerJob, tupleDestination);
+
+	MemoryContextDelete(tupleDestination->tupleContext);
+	pfree(tupleDestination);
+}
+
+
+/*
+ * CreateTupleDestination creates the tuple store of the given scan state, and
+ * returns a tuple destination through which the real-time executor can store
+ * task results in this tuple store.
+ */
+static TupleDestination *
+CreateTupleDestination(CitusScanState *citusScanState)
+{
+	CustomScanState *customScanState = &citusScanState->customScanState;
+	TupleDesc tupleDescriptor =
+		customScanState->ss.ps.ps_ResultTupleSlot->tts_tupleDescriptor;
+	TupleDestination *tupleDestination = palloc0(sizeof(TupleDestination));
+	bool randomAccess = true;
+	bool interTransactions = false;
+
+	Assert(citusScanState->tuplestorestate == NULL);
+	citusScanState->tuplestorestate =
+		tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+
+	tupleDestination->attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
+	tupleDestination->tupleStore = citusScanState->tuplestorestate;
+	tupleDestination->tupleContext = AllocSetContextCreate(CurrentMemoryContext,
+														   "TupleDestination",
+														   ALLOCSET_DEFAULT_MINSIZE,
+														   ALLOCSET_DEFAULT_INITSIZE,
+														   ALLOCSET_DEFAULT_MAXSIZE);
+	tupleDestination->tupleCount = 0;
+
+	return tupleDestination;
+}
+
+
+/*
+ * BeginStreamingScan starts executing the given job with the real-time
+ * executor, without waiting for any of its tasks to complete. Tasks store
+ * their results into the scan's tuple store, from which ReturnStreamedTuple
+ * then returns them as they arrive.
+ */
+static void
+BeginStreamingScan(CitusScanState *citusScanState, Job *workerJob)
+{
+	TupleDestination *tupleDestination = CreateTupleDestination(citusScanState);
+	Tuplestorestate *tupleStore = citusScanState->tuplestorestate;
+
+	/*
+	 * Tasks append to the tuple store while we are reading from it. We read
+	 * through a separate read pointer, which the tuple store moves forward
+	 * whenever tuples are appended after it reached the end of the store.
+	 * Writes go through the default read pointer, which we never read from.
+	 */
+	citusScanState->readPointer =
+		tuplestore_alloc_read_pointer(tupleStore, EXEC_FLAG_BACKWARD | EXEC_FLAG_REWIND);
+
+	citusScanState->realTimeExecution = BeginRealTimeExecution(workerJob,
+															   tupleDestination);
+}
+
+
+/*
+ * ReturnStreamedTuple returns the next tuple of a streaming scan. If no tuple
+ * is available yet, the function advances the real-time execution until one
+ * of the tasks delivers new tuples or all tasks completed.
+ */
+static TupleTableSlot *
+ReturnStreamedTuple(CitusScanState *citusScanState)
+{
+	RealTimeExecution *execution = citusScanState->realTimeExecution;
+	TupleDestination *tupleDestination = execution->tupleDestination;
+	Tuplestorestate *tupleStore = citusScanState->tuplestorestate;
+	EState *executorState = citusScanState->customScanState.ss.ps.state;
+	TupleTableSlot *resultSlot = NULL;
+
+	for (;;)
+	{
+		uint64 storedTupleCount = 0;
+		bool executionFinished = false;
+
+		tuplestore_select_read_pointer(tupleStore, citusScanState->readPointer);
+
+		resultSlot = ReturnTupleFromTuplestore(citusScanState);
+		if (!TupIsNull(resultSlot) ||
+			ScanDirectionIsBackward(executorState->es_direction))
+		{
+			return resultSlot;
+		}
+
+		if (RealTimeExecutionFinished(execution))
+		{
+			/* all tasks completed, and we returned all of their tuples */
+			EndStreamingScan(citusScanState);
+			citusScanState->finishedRemoteScan = true;
+
+			return resultSlot;
+		}
+
+		/* tasks store their tuples through the default read pointer */
+		tuplestore_select_read_pointer(tupleStore, 0);
+
+		storedTupleCount = tupleDestination->tupleCount;
+		executionFinished = RealTimeExecutionStep(execution);
+
+		/* report failures right away, rather than after returning more rows */
+		if (execution->taskFailed || QueryCancelPending)
+		{
+			EndStreamingScan(citusScanState);
+			citusScanState->finishedRemoteScan = true;
+
+			return resultSlot;
+		}
+
+		if (!executionFinished && tupleDestination->tupleCount == storedTupleCount)
+		{
+			RealTimeExecutionWait(execution);
+		}
+	}
+}
+
+
+/*
+ * EndStreamingScan ends the real-time execution of a streaming scan. Tasks
+ * that are still running at this point are cancelled; this happens when the
+ * master plan stops pulling tuples before all tasks completed.
+ */
+static void
+EndStreamingScan(CitusScanState *citusScanState)
+{
+	RealTimeExecution *execution = citusScanState->realTimeExecution;
+	TupleDestination *tupleDestination = execution->tupleDestination;
+
+	/* make sure we don't end the execution twice if we error out below */
+	citusScanState->realTimeExecution = NULL;
+
+	/* later reads continue from where the streaming scan left off */
+	tuplestore_select_read_pointer(citusScanState->tuplestorestate,
+								   citusScanState->readPointer);
+
+	MemoryContextDelete(tupleDestination->tupleContext);
+
+	EndRealTimeExecution(execution);
+}
+
+
 /*
  * Load data collected by real-time or task-tracker executors into the tuplestore
  * of CitusScanState. For that, we first create a tuple store, and then copy the
@@ -421,6 +622,18 @@ CitusEndScan(CustomScanState *node)
 {
 	CitusScanState *scanState = (CitusScanState *) node;
 
+	/* the master plan may stop pulling tuples before all tasks completed */
+	if (scanState->realTimeExecution != NULL)
+	{
+		EndStreamingScan(scanState);
+	}
+
+	/* same for router scans that stream rows from a worker */
+	if (scanState->streamingConnection != NULL)
+	{
+		EndStreamingSelectTask(scanState);
+	}
+
 	if (scanState->tuplestorestate)
 	{
 		tuplestore_end(scanState->tuplestorestate);
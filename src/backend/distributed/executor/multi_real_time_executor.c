@@ -3,11 +3,11 @@
  * multi_real_time_executor.c
  *
  * Routines for executing remote tasks as part of a distributed execution plan
- * in real-time. These routines open up a separate connection for each task they
- * need to execute, and therefore return their results faster. However, they can
- * only handle as many tasks as the number of file descriptors (connections)
- * available. They also can't handle execution primitives that need to write
- * their results to intermediate files.
+ * in real-time. These routines run tasks concurrently over a pool of connections
+ * to each worker node, and therefore return their results faster. However, they
+ * can only handle as many concurrent tasks as the number of file descriptors
+ * (connections) available. They also can't handle execution primitives that need
+ * to write their results to intermediate files.
  *
  * Copyright (c) 2013-2016, Citus Data, Inc.
  *
@@ -17,29 +17,57 @@
  */
 
 #include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
 #include "miscadmin.h"
 
 #include <sys/stat.h>
 #include <unistd.h>
 #include <poll.h>
 
+#include "access/htup_details.h"
 #include "commands/dbcommands.h"
 #include "distributed/connection_management.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/shared_connection_stats.h"
 #include "distributed/worker_protocol.h"
 #include "storage/fd.h"
 #include "utils/timestamp.h"
 
 
+/* counters for how often tasks were hedged, and how often the hedge won */
+static uint64 HedgedTaskCount = 0;
+static uint64 HedgedTaskWinCount = 0;
+
+
 /* Local functions forward declarations */
+static bool TasksHaveSamePlacementNodes(Task *firstTask, Task *secondTask);
+static Task * CombineTaskGroup(List *taskGroup);
+static void ManageRealTimeTaskExecution(RealTimeExecution *execution, Task *task,
+										TaskExecution *taskExecution,
+										TimestampTz currentTime);
+static void HedgeLaggingTasks(RealTimeExecution *execution);
+static int32 HedgeNodeIndex(TaskExecution *taskExecution);
+static void AbandonTaskExecution(RealTimeExecution *execution, Task *task,
+								 TaskExecution *taskExecution);
+static StringInfo TaskExecutionFilename(Task *task, TaskExecution *taskExecution);
+static bool InstallHedgedTaskFile(Task *task, TaskExecution *taskExecution);
 static ConnectAction ManageTaskExecution(Task *task, TaskExecution *taskExecution,
-										 TaskExecutionStatus *executionStatus);
+										 WorkerNodeState *workerNodeState,
+										 TaskExecutionStatus *executionStatus,
+										 TupleDestination *tupleDestination);
+static void ManageTupleReceive(TaskExecution *taskExecution,
+							   WorkerNodeState *workerNodeState,
+							   TupleDestination *tupleDestination,
+							   TaskExecutionStatus *executionStatus);
+static void SetTaskExecutionRetryTime(TaskExecution *taskExecution);
 static bool TaskExecutionReadyToStart(TaskExecution *taskExecution);
 static bool TaskExecutionCompleted(TaskExecution *taskExecution);
 static void CancelTaskExecutionIfActive(TaskExecution *taskExecution);
 static void CancelRequestIfActive(TaskExecStatus taskStatus, int connectionId);
+static void CleanupTaskExecutionAttempts(TaskExecution *taskExecution);
 
 /* Worker node state hash functions */
 static HTAB * WorkerHash(const char *workerHashName, List *workerNodeList);
@@ -51,6 +79,14 @@ static WorkerNodeState * WorkerHashLookup(HTAB *workerHash,
 static WorkerNodeState * LookupWorkerForTask(HTAB *workerHash, Task *task,
 											 TaskExecution *taskExecution);
 
+/* Connection pooling functions */
+static int32 TakeIdleConnection(WorkerNodeState *workerNodeState);
+static void ReleaseIdleConnection(WorkerNodeState *workerNodeState, int32 connectionId);
+static bool RealTimeConnectionPoolEnabled(void);
+static void CloseIdleConnections(HTAB *workerHash);
+static void AdjustConnectionLimits(HTAB *workerHash);
+static void ReduceConnectionLimit(WorkerNodeState *workerNodeState);
+
 /* Throttling functions */
 static bool WorkerConnectionsExhausted(WorkerNodeState *workerNodeState);
 static bool MasterConnectionsExhausted(HTAB *workerHash);
@@ -59,31 +95,207 @@ static void UpdateConnectionCounter(WorkerNodeState *workerNode,
 									ConnectAction connectAction);
 
 
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(citus_task_hedging_stats);
+
+
 /*
  * MultiRealTimeExecute loops over the given tasks, and manages their execution
  * until either one task permanently fails or all tasks successfully complete.
- * The function opens up a connection for each task it needs to execute, and
+ * The function runs tasks over a pool of connections to each worker node, and
  * manages these tasks' execution in real-time.
+ *
+ * If a tuple destination is given, task results are read in single-row mode
+ * and stored directly into the destination's tuple store. Otherwise, each task
+ * copies its results into a file in the master job directory.
  */
 void
-MultiRealTimeExecute(Job *job)
+MultiRealTimeExecute(Job *job, TupleDestination *tupleDestination)
 {
-	List *taskList = job->taskList;
-	List *taskExecutionList = NIL;
-	ListCell *taskExecutionCell = NULL;
+	RealTimeExecution *execution = BeginRealTimeExecution(job, tupleDestination);
+
+	/* loop around until all tasks complete, one task fails, or user cancels */
+	while (!RealTimeExecutionStep(execution))
+	{
+		/*
+		 * Wait as appropriate to avoid a tight loop. That means we immediately
+		 * continue if tasks are ready to be processed further, and block when
+		 * we're waiting for network IO.
+		 */
+		RealTimeExecutionWait(execution);
+	}
+
+	EndRealTimeExecution(execution);
+}
+
+
+/*
+ * CombineTasksPerWorker returns a copy of the given job in which compute tasks
+ * that run on the same placement nodes are combined into a single task. The
+ * combined task's query is the UNION ALL of the original tasks' queries, so
+ * that each worker receives one query and returns one result stream, instead
+ * of paying round trip and planning overhead for every shard. Tasks that
+ * depend on other tasks are left as they are.
+ */
+Job *
+CombineTasksPerWorker(Job *job)
+{
+	Job *combinedJob = NULL;
+	List *taskGroupList = NIL;
+	List *combinedTaskList = NIL;
+	ListCell *taskCell = NULL;
+	ListCell *taskGroupCell = NULL;
+
+	/* group tasks by the nodes their placements are on */
+	foreach(taskCell, job->taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		bool groupFound = false;
+
+		if (task->dependedTaskList != NIL || task->taskPlacementList == NIL)
+		{
+			taskGroupList = lappend(taskGroupList, list_make1(task));
+			continue;
+		}
+
+		foreach(taskGroupCell, taskGroupList)
+		{
+			List *taskGroup = (List *) lfirst(taskGroupCell);
+			Task *groupTask = (Task *) linitial(taskGroup);
+
+			if (groupTask->dependedTaskList == NIL &&
+				TasksHaveSamePlacementNodes(groupTask, task))
+			{
+				lfirst(taskGroupCell) = lappend(taskGroup, task);
+				groupFound = true;
+				break;
+			}
+		}
+
+		if (!groupFound)
+		{
+			taskGroupList = lappend(taskGroupList, list_make1(task));
+		}
+	}
+
+	foreach(taskGroupCell, taskGroupList)
+	{
+		List *taskGroup = (List *) lfirst(taskGroupCell);
+		Task *combinedTask = CombineTaskGroup(taskGroup);
+
+		combinedTaskList = lappend(combinedTaskList, combinedTask);
+	}
+
+	combinedJob = palloc0(sizeof(Job));
+	memcpy(combinedJob, job, sizeof(Job));
+	combinedJob->taskList = combinedTaskList;
+
+	return combinedJob;
+}
+
+
+/*
+ * TasksHaveSamePlacementNodes returns whether the placements of the given tasks
+ * are on the same nodes, in the same order. Such tasks can run as one task,
+ * and still fail over to the same nodes as before.
+ */
+static bool
+TasksHaveSamePlacementNodes(Task *firstTask, Task *secondTask)
+{
+	List *firstPlacementList = firstTask->taskPlacementList;
+	List *secondPlacementList = secondTask->taskPlacementList;
+	ListCell *firstPlacementCell = NULL;
+	ListCell *secondPlacementCell = NULL;
+
+	if (list_length(firstPlacementList) != list_length(secondPlacementList))
+	{
+		return false;
+	}
+
+	forboth(firstPlacementCell, firstPlacementList,
+			secondPlacementCell, secondPlacementList)
+	{
+		ShardPlacement *firstPlacement = (ShardPlacement *) lfirst(firstPlacementCell);
+		ShardPlacement *secondPlacement = (ShardPlacement *) lfirst(secondPlacementCell);
+
+		if (firstPlacement->nodePort != secondPlacement->nodePort ||
+			strncmp(firstPlacement->nodeName, secondPlacement->nodeName,
+					WORKER_LENGTH) != 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CombineTaskGroup combines the given tasks into a single task that runs the
+ * UNION ALL of their queries. If the group only has one task, the function
+ * returns that task.
+ */
+static Task *
+CombineTaskGroup(List *taskGroup)
+{
+	Task *firstTask = (Task *) linitial(taskGroup);
+	Task *combinedTask = NULL;
+	StringInfo combinedQueryString = NULL;
 	ListCell *taskCell = NULL;
-	uint32 failedTaskId = 0;
-	bool allTasksCompleted = false;
-	bool taskCompleted = false;
-	bool taskFailed = false;
 
+	if (list_length(taskGroup) == 1)
+	{
+		return firstTask;
+	}
+
+	combinedQueryString = makeStringInfo();
+	foreach(taskCell, taskGroup)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		if (combinedQueryString->len > 0)
+		{
+			appendStringInfoString(combinedQueryString, " UNION ALL ");
+		}
+
+		appendStringInfo(combinedQueryString, "(%s)", task->queryString);
+	}
+
+	combinedTask = CitusMakeNode(Task);
+	combinedTask->taskType = firstTask->taskType;
+	combinedTask->jobId = firstTask->jobId;
+	combinedTask->taskId = firstTask->taskId;
+	combinedTask->queryString = combinedQueryString->data;
+	combinedTask->anchorShardId = firstTask->anchorShardId;
+	combinedTask->taskPlacementList = firstTask->taskPlacementList;
+	combinedTask->dependedTaskList = NIL;
+
+	return combinedTask;
+}
+
+
+/*
+ * BeginRealTimeExecution sets up the state needed to execute the given job's
+ * tasks with the real-time executor. The execution is then advanced with
+ * RealTimeExecutionStep and RealTimeExecutionWait, and has to be finished with
+ * EndRealTimeExecution. Callers that consume results as they arrive use these
+ * functions directly, and can end the execution before all tasks completed.
+ */
+RealTimeExecution *
+BeginRealTimeExecution(Job *job, TupleDestination *tupleDestination)
+{
+	List *taskList = job->taskList;
+	ListCell *taskCell = NULL;
 	List *workerNodeList = NIL;
-	HTAB *workerHash = NULL;
 	const char *workerHashName = "Worker node hash";
-	WaitInfo *waitInfo = MultiClientCreateWaitInfo(list_length(taskList));
+	RealTimeExecution *execution = palloc0(sizeof(RealTimeExecution));
+
+	execution->job = job;
+	execution->tupleDestination = tupleDestination;
+	execution->waitInfo = MultiClientCreateWaitInfo(list_length(taskList));
 
 	workerNodeList = WorkerNodeList();
-	workerHash = WorkerHash(workerHashName, workerNodeList);
+	execution->workerHash = WorkerHash(workerHashName, workerNodeList);
 
 	/* initialize task execution structures for remote execution */
 	foreach(taskCell, taskList)
@@ -91,108 +303,380 @@ MultiRealTimeExecute(Job *job)
 		Task *task = (Task *) lfirst(taskCell);
 
 		TaskExecution *taskExecution = InitTaskExecution(task, EXEC_TASK_CONNECT_START);
-		taskExecutionList = lappend(taskExecutionList, taskExecution);
+		execution->taskExecutionList = lappend(execution->taskExecutionList,
+											   taskExecution);
 	}
 
-	/* loop around until all tasks complete, one task fails, or user cancels */
-	while (!(allTasksCompleted || taskFailed || QueryCancelPending))
-	{
-		uint32 taskCount = list_length(taskList);
-		uint32 completedTaskCount = 0;
-
-		/* loop around all tasks and manage them */
-		ListCell *taskCell = NULL;
-		ListCell *taskExecutionCell = NULL;
+	return execution;
+}
 
-		MultiClientResetWaitInfo(waitInfo);
 
-		forboth(taskCell, taskList, taskExecutionCell, taskExecutionList)
-		{
-			Task *task = (Task *) lfirst(taskCell);
-			TaskExecution *taskExecution = (TaskExecution *) lfirst(taskExecutionCell);
-			ConnectAction connectAction = CONNECT_ACTION_NONE;
-			WorkerNodeState *workerNodeState = NULL;
-			TaskExecutionStatus executionStatus;
+/*
+ * RealTimeExecutionStep makes one pass over the given execution's tasks, and
+ * manages those that are ready to make progress. The function returns true
+ * once the execution is finished; that is, when all tasks completed, one task
+ * permanently failed, or the user requested cancellation.
+ */
+bool
+RealTimeExecutionStep(RealTimeExecution *execution)
+{
+	List *taskList = execution->job->taskList;
+	List *taskExecutionList = execution->taskExecutionList;
+	TupleDestination *tupleDestination = execution->tupleDestination;
+	uint32 taskCount = list_length(taskList);
+	uint32 completedTaskCount = 0;
+	TimestampTz currentTime = GetCurrentTimestamp();
+
+	/* loop around all tasks and manage them */
+	ListCell *taskCell = NULL;
+	ListCell *taskExecutionCell = NULL;
 
-			workerNodeState = LookupWorkerForTask(workerHash, task, taskExecution);
+	if (RealTimeExecutionFinished(execution))
+	{
+		return true;
+	}
 
-			/* in case the task is about to start, throttle if necessary */
-			if (TaskExecutionReadyToStart(taskExecution) &&
-				(WorkerConnectionsExhausted(workerNodeState) ||
-				 MasterConnectionsExhausted(workerHash)))
-			{
-				continue;
-			}
+	MultiClientResetWaitInfo(execution->waitInfo);
 
-			/* call the function that performs the core task execution logic */
-			connectAction = ManageTaskExecution(task, taskExecution, &executionStatus);
+	forboth(taskCell, taskList, taskExecutionCell, taskExecutionList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		TaskExecution *taskExecution = (TaskExecution *) lfirst(taskExecutionCell);
+		TaskExecution *hedgeExecution = taskExecution->hedgeExecution;
 
-			/* update the connection counter for throttling */
-			UpdateConnectionCounter(workerNodeState, connectAction);
+		ManageRealTimeTaskExecution(execution, task, taskExecution, currentTime);
 
-			/*
-			 * If this task failed, we need to iterate over task executions, and
-			 * manually clean out their client-side resources. Hence, we record
-			 * the failure here instead of immediately erroring out.
-			 */
-			taskFailed = TaskExecutionFailed(taskExecution);
-			if (taskFailed)
+		/* if the task was hedged, the attempt that completes first wins */
+		if (hedgeExecution != NULL)
+		{
+			if (!TaskExecutionCompleted(taskExecution))
 			{
-				failedTaskId = taskExecution->taskId;
-				break;
+				ManageRealTimeTaskExecution(execution, task, hedgeExecution,
+											currentTime);
 			}
 
-			taskCompleted = TaskExecutionCompleted(taskExecution);
-			if (taskCompleted)
+			if (TaskExecutionCompleted(hedgeExecution))
 			{
-				completedTaskCount++;
+				AbandonTaskExecution(execution, task, taskExecution);
+
+				lfirst(taskExecutionCell) = hedgeExecution;
+				taskExecution = hedgeExecution;
+				HedgedTaskWinCount++;
 			}
-			else
+			else if (TaskExecutionCompleted(taskExecution) ||
+					 hedgeExecution->failureCount > 0 ||
+					 taskExecution->currentNodeIndex == hedgeExecution->currentNodeIndex)
 			{
-				uint32 currentIndex = taskExecution->currentNodeIndex;
-				int32 *connectionIdArray = taskExecution->connectionIdArray;
-				int32 connectionId = connectionIdArray[currentIndex];
-
 				/*
-				 * If not done with the task yet, make note of what this task
-				 * and its associated connection is waiting for.
+				 * Hedges don't fail over; the original attempt already does. Once
+				 * it failed over to the hedge's placement, the hedge is redundant.
 				 */
-				MultiClientRegisterWait(waitInfo, executionStatus, connectionId);
+				AbandonTaskExecution(execution, task, hedgeExecution);
+				taskExecution->hedgeExecution = NULL;
 			}
 		}
 
 		/*
-		 * Check if all tasks completed; otherwise wait as appropriate to
-		 * avoid a tight loop. That means we immediately continue if tasks are
-		 * ready to be processed further, and block when we're waiting for
-		 * network IO.
+		 * If this task failed, we need to iterate over task executions, and
+		 * manually clean out their client-side resources. Hence, we record
+		 * the failure here instead of immediately erroring out.
 		 */
-		if (completedTaskCount == taskCount)
+		execution->taskFailed = TaskExecutionFailed(taskExecution);
+		if (execution->taskFailed)
 		{
-			allTasksCompleted = true;
+			execution->failedTaskId = taskExecution->taskId;
+			return true;
 		}
-		else
+
+		if (TaskExecutionCompleted(taskExecution))
+		{
+			completedTaskCount++;
+		}
+	}
+
+	/* check if all tasks completed */
+	if (completedTaskCount == taskCount)
+	{
+		execution->allTasksCompleted = true;
+	}
+	else
+	{
+		AdjustConnectionLimits(execution->workerHash);
+
+		/*
+		 * Once most tasks completed, the remaining ones are likely held up by
+		 * a slow worker. We then also run them on another placement. Results
+		 * kept in memory can't be discarded, so we only hedge tasks that copy
+		 * their results into files.
+		 */
+		if (TaskHedgingCompletedPercentage > 0 && tupleDestination == NULL &&
+			completedTaskCount * 100 >= TaskHedgingCompletedPercentage * taskCount)
+		{
+			HedgeLaggingTasks(execution);
+		}
+	}
+
+	return RealTimeExecutionFinished(execution);
+}
+
+
+/*
+ * ManageRealTimeTaskExecution advances the given task execution if it is ready
+ * to make progress, and makes note of what the execution waits for next. The
+ * task execution is either a task's original attempt, or its hedged attempt.
+ */
+static void
+ManageRealTimeTaskExecution(RealTimeExecution *execution, Task *task,
+							TaskExecution *taskExecution, TimestampTz currentTime)
+{
+	HTAB *workerHash = execution->workerHash;
+	WaitInfo *waitInfo = execution->waitInfo;
+	ConnectAction connectAction = CONNECT_ACTION_NONE;
+	WorkerNodeState *workerNodeState = NULL;
+	TaskExecutionStatus executionStatus;
+	int32 *connectionIdArray = taskExecution->connectionIdArray;
+	uint32 currentIndex = taskExecution->currentNodeIndex;
+	int32 connectionId = connectionIdArray[currentIndex];
+
+	/* tasks still waiting for network IO keep their registered wait */
+	if (!MultiClientWaitReady(waitInfo, connectionId))
+	{
+		return;
+	}
+
+	workerNodeState = LookupWorkerForTask(workerHash, task, taskExecution);
+
+	if (TaskExecutionReadyToStart(taskExecution))
+	{
+		/* after a failure, back off before retrying this task */
+		if (taskExecution->retryTime > currentTime)
+		{
+			MultiClientRegisterWait(waitInfo, TASK_STATUS_ERROR, INVALID_CONNECTION_ID);
+			return;
+		}
+
+		/*
+		 * In case the task is about to start, throttle if necessary. Tasks
+		 * that can reuse an idle connection to their worker never wait.
+		 */
+		if (workerNodeState->idleConnectionList == NIL &&
+			(WorkerConnectionsExhausted(workerNodeState) ||
+			 MasterConnectionsExhausted(workerHash)))
+		{
+			workerNodeState->connectionLimitReached = true;
+			return;
+		}
+	}
+
+	/* call the function that performs the core task execution logic */
+	connectAction = ManageTaskExecution(task, taskExecution, workerNodeState,
+										&executionStatus, execution->tupleDestination);
+
+	/* update the connection counter for throttling */
+	UpdateConnectionCounter(workerNodeState, connectAction);
+
+	/* stop waiting on connections the task closed or moved away from */
+	currentIndex = taskExecution->currentNodeIndex;
+	if (connectionIdArray[currentIndex] != connectionId)
+	{
+		MultiClientUnregisterWait(waitInfo, connectionId);
+	}
+
+	if (TaskExecutionFailed(taskExecution))
+	{
+		return;
+	}
+
+	if (TaskExecutionCompleted(taskExecution))
+	{
+		/* don't block, tasks may be waiting for the connection we released */
+		if (connectionId != INVALID_CONNECTION_ID)
+		{
+			MultiClientRegisterWait(waitInfo, TASK_STATUS_READY, INVALID_CONNECTION_ID);
+		}
+	}
+	else
+	{
+		/*
+		 * If not done with the task yet, make note of what this task
+		 * and its associated connection is waiting for.
+		 */
+		connectionId = connectionIdArray[currentIndex];
+		MultiClientRegisterWait(waitInfo, executionStatus, connectionId);
+	}
+}
+
+
+/*
+ * HedgeLaggingTasks starts a second attempt for each task that is still running,
+ * on the task's next placement that hasn't failed yet. Whichever attempt
+ * completes first provides the task's results, and the other attempt is then
+ * cancelled. Tasks are hedged at most once, and only if they have another
+ * placement to run on and no data fetch tasks.
+ */
+static void
+HedgeLaggingTasks(RealTimeExecution *execution)
+{
+	List *taskList = execution->job->taskList;
+	List *taskExecutionList = execution->taskExecutionList;
+	ListCell *taskCell = NULL;
+	ListCell *taskExecutionCell = NULL;
+	bool startedHedge = false;
+
+	forboth(taskCell, taskList, taskExecutionCell, taskExecutionList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		TaskExecution *taskExecution = (TaskExecution *) lfirst(taskExecutionCell);
+		TaskExecution *hedgeExecution = NULL;
+		int32 hedgeNodeIndex = -1;
+
+		if (taskExecution->hedged || taskExecution->hedgeAttempt ||
+			task->dependedTaskList != NIL ||
+			TaskExecutionReadyToStart(taskExecution) ||
+			TaskExecutionCompleted(taskExecution))
 		{
-			MultiClientWait(waitInfo);
+			continue;
 		}
+
+		/* don't hedge if the straggler is the only placement left */
+		hedgeNodeIndex = HedgeNodeIndex(taskExecution);
+		if (hedgeNodeIndex < 0)
+		{
+			continue;
+		}
+
+		hedgeExecution = InitTaskExecution(task, EXEC_TASK_CONNECT_START);
+		hedgeExecution->currentNodeIndex = (uint32) hedgeNodeIndex;
+		hedgeExecution->hedgeAttempt = true;
+
+		taskExecution->hedgeExecution = hedgeExecution;
+		taskExecution->hedged = true;
+		HedgedTaskCount++;
+
+		ereport(DEBUG2, (errmsg("hedging task %u on another placement",
+								task->taskId)));
+
+		startedHedge = true;
 	}
 
-	MultiClientFreeWaitInfo(waitInfo);
+	/* start the hedged attempts right away */
+	if (startedHedge)
+	{
+		MultiClientRegisterWait(execution->waitInfo, TASK_STATUS_READY,
+								INVALID_CONNECTION_ID);
+	}
+}
+
+
+/*
+ * HedgeNodeIndex returns the index of the placement on which to hedge the given
+ * task execution. This is the placement after the one the execution currently
+ * runs on, skipping placements on which an attempt of the task already failed.
+ * If there is no such placement, the function returns -1.
+ */
+static int32
+HedgeNodeIndex(TaskExecution *taskExecution)
+{
+	uint32 nodeCount = taskExecution->nodeCount;
+	uint32 currentIndex = taskExecution->currentNodeIndex;
+	uint32 nodeOffset = 0;
+
+	for (nodeOffset = 1; nodeOffset < nodeCount; nodeOffset++)
+	{
+		uint32 nodeIndex = (currentIndex + nodeOffset) % nodeCount;
+
+		if (!taskExecution->failedNodeArray[nodeIndex])
+		{
+			return (int32) nodeIndex;
+		}
+	}
+
+	return -1;
+}
+
+
+/*
+ * AbandonTaskExecution cancels the given attempt of a task, and releases its
+ * client-side resources. The function is used to give up on the slower one of
+ * a hedged task's two attempts.
+ */
+static void
+AbandonTaskExecution(RealTimeExecution *execution, Task *task,
+					 TaskExecution *taskExecution)
+{
+	uint32 currentIndex = taskExecution->currentNodeIndex;
+	int32 connectionId = taskExecution->connectionIdArray[currentIndex];
+
+	if (connectionId != INVALID_CONNECTION_ID)
+	{
+		WorkerNodeState *workerNodeState =
+			LookupWorkerForTask(execution->workerHash, task, taskExecution);
+
+		MultiClientUnregisterWait(execution->waitInfo, connectionId);
+		CancelTaskExecutionIfActive(taskExecution);
+		UpdateConnectionCounter(workerNodeState, CONNECT_ACTION_CLOSED);
+	}
+
+	CleanupTaskExecution(taskExecution);
+}
+
+
+/*
+ * RealTimeExecutionWait blocks until one of the execution's tasks is ready to
+ * make progress, or until the wait times out.
+ */
+void
+RealTimeExecutionWait(RealTimeExecution *execution)
+{
+	MultiClientWait(execution->waitInfo);
+}
+
+
+/*
+ * RealTimeExecutionFinished returns whether the given execution is finished,
+ * and no further calls to RealTimeExecutionStep are needed.
+ */
+bool
+RealTimeExecutionFinished(RealTimeExecution *execution)
+{
+	return execution->allTasksCompleted || execution->taskFailed || QueryCancelPending;
+}
+
+
+/*
+ * EndRealTimeExecution cancels the execution's tasks that are still running,
+ * and releases all client-side resources held by the execution. If a task
+ * failed or the user requested cancellation, the function then errors out.
+ * Ending an execution whose tasks are still running, for example when the
+ * master plan doesn't need any more rows, is not an error.
+ */
+void
+EndRealTimeExecution(RealTimeExecution *execution)
+{
+	List *taskExecutionList = execution->taskExecutionList;
+	ListCell *taskExecutionCell = NULL;
+	bool taskFailed = execution->taskFailed;
+
+	MultiClientFreeWaitInfo(execution->waitInfo);
 
 	/*
 	 * We prevent cancel/die interrupts until we clean up connections to worker
-	 * nodes. Note that for the above while loop, if the user Ctrl+C's a query
-	 * and we emit a warning before looping to the beginning of the while loop,
-	 * we will get canceled away before we can hold any interrupts.
+	 * nodes. Note that for the execution loop, if the user Ctrl+C's a query
+	 * and we emit a warning before looping to the beginning of the loop, we
+	 * will get canceled away before we can hold any interrupts.
 	 */
 	HOLD_INTERRUPTS();
 
 	/* cancel any active task executions */
-	taskExecutionCell = NULL;
 	foreach(taskExecutionCell, taskExecutionList)
 	{
 		TaskExecution *taskExecution = (TaskExecution *) lfirst(taskExecutionCell);
 		CancelTaskExecutionIfActive(taskExecution);
+
+		if (taskExecution->hedgeExecution != NULL)
+		{
+			CancelTaskExecutionIfActive(taskExecution->hedgeExecution);
+		}
 	}
 
 	/*
@@ -209,13 +693,14 @@ MultiRealTimeExecute(Job *job)
 	}
 
 	/* close connections and open files */
-	taskExecutionCell = NULL;
 	foreach(taskExecutionCell, taskExecutionList)
 	{
 		TaskExecution *taskExecution = (TaskExecution *) lfirst(taskExecutionCell);
-		CleanupTaskExecution(taskExecution);
+		CleanupTaskExecutionAttempts(taskExecution);
 	}
 
+	CloseIdleConnections(execution->workerHash);
+
 	RESUME_INTERRUPTS();
 
 	/*
@@ -225,8 +710,10 @@ MultiRealTimeExecute(Job *job)
 	 */
 	if (taskFailed)
 	{
-		ereport(ERROR, (errmsg("failed to execute job " UINT64_FORMAT, job->jobId),
-						errdetail("Failure due to failed task %u", failedTaskId)));
+		ereport(ERROR, (errmsg("failed to execute job " UINT64_FORMAT,
+							   execution->job->jobId),
+						errdetail("Failure due to failed task %u",
+								  execution->failedTaskId)));
 	}
 	else if (QueryCancelPending)
 	{
@@ -239,15 +726,20 @@ MultiRealTimeExecute(Job *job)
  * ManageTaskExecution manages all execution logic for the given task. For this,
  * the function starts a new "execution" on a node, and tracks this execution's
  * progress. On failure, the function restarts this execution on another node.
- * Note that this function directly manages a task's execution by opening up a
- * separate connection to the worker node for each execution. The function
- * returns a ConnectAction enum indicating whether a connection has been opened
- * or closed in this call.  Via the executionStatus parameter this function returns
- * what a Task is blocked on.
+ * Note that this function directly manages a task's execution over a connection
+ * to the worker node. Connections are taken from the given worker node state's
+ * pool of idle connections when possible, and returned to it once the task
+ * completes. The function returns a ConnectAction enum indicating whether a
+ * connection has been opened or closed in this call.  Via the executionStatus
+ * parameter this function returns what a Task is blocked on. If a tuple
+ * destination is given, the task's results are stored there instead of in the
+ * master job directory.
  */
 static ConnectAction
 ManageTaskExecution(Task *task, TaskExecution *taskExecution,
-					TaskExecutionStatus *executionStatus)
+					WorkerNodeState *workerNodeState,
+					TaskExecutionStatus *executionStatus,
+					TupleDestination *tupleDestination)
 {
 	TaskExecStatus *taskStatusArray = taskExecution->taskStatusArray;
 	int32 *connectionIdArray = taskExecution->connectionIdArray;
@@ -270,6 +762,16 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 			int32 connectionId = INVALID_CONNECTION_ID;
 			char *nodeDatabase = NULL;
 
+			/* run the task on an idle connection to the worker if we have one */
+			connectionId = TakeIdleConnection(workerNodeState);
+			if (connectionId != INVALID_CONNECTION_ID)
+			{
+				connectionIdArray[currentIndex] = connectionId;
+				taskExecution->dataFetchTaskIndex = -1;
+				taskStatusArray[currentIndex] = EXEC_FETCH_TASK_LOOP;
+				break;
+			}
+
 			/* we use the same database name on the master and worker nodes */
 			nodeDatabase = get_database_name(MyDatabaseId);
 
@@ -286,7 +788,9 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 			else
 			{
 				*executionStatus = TASK_STATUS_ERROR;
+				ReduceConnectionLimit(workerNodeState);
 				AdjustStateForFailure(taskExecution);
+				SetTaskExecutionRetryTime(taskExecution);
 				break;
 			}
 
@@ -325,6 +829,7 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 			else if (pollStatus == CLIENT_CONNECTION_BAD)
 			{
 				taskStatusArray[currentIndex] = EXEC_TASK_FAILED;
+				ReduceConnectionLimit(workerNodeState);
 			}
 
 			/* now check if we have been trying to connect for too long */
@@ -340,6 +845,7 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 											 NodeConnectionTimeout)));
 
 					taskStatusArray[currentIndex] = EXEC_TASK_FAILED;
+					ReduceConnectionLimit(workerNodeState);
 				}
 			}
 
@@ -360,14 +866,17 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 			connectAction = CONNECT_ACTION_CLOSED;
 
 			taskStatusArray[currentIndex] = EXEC_TASK_CONNECT_START;
+			taskExecution->failedNodeArray[currentIndex] = true;
 
 			/* try next worker node */
 			AdjustStateForFailure(taskExecution);
 
 			/*
 			 * Add a delay, to avoid potentially excerbating problems by
-			 * looping quickly
+			 * looping quickly. Only this task backs off; other tasks continue
+			 * to make progress in the meantime.
 			 */
+			SetTaskExecutionRetryTime(taskExecution);
 			*executionStatus = TASK_STATUS_ERROR;
 
 			break;
@@ -462,22 +971,31 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 		{
 			int32 connectionId = connectionIdArray[currentIndex];
 			bool querySent = false;
-
-			/* construct new query to copy query results to stdout */
 			char *queryString = task->queryString;
-			StringInfo computeTaskQuery = makeStringInfo();
-			if (BinaryMasterCopyFormat)
+
+			if (tupleDestination != NULL)
 			{
-				appendStringInfo(computeTaskQuery, COPY_QUERY_TO_STDOUT_BINARY,
-								 queryString);
+				/* results are read row by row, and stored directly in memory */
+				querySent = MultiClientSendSingleRowQuery(connectionId, queryString);
 			}
 			else
 			{
-				appendStringInfo(computeTaskQuery, COPY_QUERY_TO_STDOUT_TEXT,
-								 queryString);
+				/* construct new query to copy query results to stdout */
+				StringInfo computeTaskQuery = makeStringInfo();
+				if (BinaryMasterCopyFormat)
+				{
+					appendStringInfo(computeTaskQuery, COPY_QUERY_TO_STDOUT_BINARY,
+									 queryString);
+				}
+				else
+				{
+					appendStringInfo(computeTaskQuery, COPY_QUERY_TO_STDOUT_TEXT,
+									 queryString);
+				}
+
+				querySent = MultiClientSendQuery(connectionId, computeTaskQuery->data);
 			}
 
-			querySent = MultiClientSendQuery(connectionId, computeTaskQuery->data);
 			if (querySent)
 			{
 				taskStatusArray[currentIndex] = EXEC_COMPUTE_TASK_RUNNING;
@@ -511,12 +1029,18 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 
 			Assert(resultStatus == CLIENT_RESULT_READY);
 
+			/* rows are arriving; start storing them in the tuple store */
+			if (tupleDestination != NULL)
+			{
+				taskStatusArray[currentIndex] = EXEC_COMPUTE_TASK_COPYING;
+				break;
+			}
+
 			/* check if our request to copy query results has been acknowledged */
 			queryStatus = MultiClientQueryStatus(connectionId);
 			if (queryStatus == CLIENT_QUERY_COPY)
 			{
-				StringInfo jobDirectoryName = MasterJobDirectoryName(task->jobId);
-				StringInfo taskFilename = TaskFilename(jobDirectoryName, task->taskId);
+				StringInfo taskFilename = TaskExecutionFilename(task, taskExecution);
 
 				char *filename = taskFilename->data;
 				int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
@@ -558,9 +1082,17 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 			int32 connectionId = connectionIdArray[currentIndex];
 			int32 fileDesc = fileDescriptorArray[currentIndex];
 			int closed = -1;
+			CopyStatus copyStatus = CLIENT_INVALID_COPY;
+
+			if (tupleDestination != NULL)
+			{
+				ManageTupleReceive(taskExecution, workerNodeState, tupleDestination,
+								   executionStatus);
+				break;
+			}
 
 			/* copy data from worker node, and write to local file */
-			CopyStatus copyStatus = MultiClientCopyData(connectionId, fileDesc);
+			copyStatus = MultiClientCopyData(connectionId, fileDesc);
 
 			/* if worker node will continue to send more data, keep reading */
 			if (copyStatus == CLIENT_COPY_MORE)
@@ -573,21 +1105,25 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 				closed = close(fileDesc);
 				fileDescriptorArray[currentIndex] = -1;
 
-				if (closed >= 0)
+				if (closed < 0)
 				{
-					taskStatusArray[currentIndex] = EXEC_TASK_DONE;
+					ereport(WARNING, (errcode_for_file_access(),
+									  errmsg("could not close copied file: %m")));
 
-					/* we are done executing; we no longer need the connection */
-					MultiClientDisconnect(connectionId);
-					connectionIdArray[currentIndex] = INVALID_CONNECTION_ID;
-					connectAction = CONNECT_ACTION_CLOSED;
+					taskStatusArray[currentIndex] = EXEC_TASK_FAILED;
+				}
+				else if (taskExecution->hedgeAttempt &&
+						 !InstallHedgedTaskFile(task, taskExecution))
+				{
+					taskStatusArray[currentIndex] = EXEC_TASK_FAILED;
 				}
 				else
 				{
-					ereport(WARNING, (errcode_for_file_access(),
-									  errmsg("could not close copied file: %m")));
+					taskStatusArray[currentIndex] = EXEC_TASK_DONE;
 
-					taskStatusArray[currentIndex] = EXEC_TASK_FAILED;
+					/* we are done executing; let the next task use the connection */
+					ReleaseIdleConnection(workerNodeState, connectionId);
+					connectionIdArray[currentIndex] = INVALID_CONNECTION_ID;
 				}
 			}
 			else if (copyStatus == CLIENT_COPY_FAILED)
@@ -625,6 +1161,115 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 }
 
 
+/*
+ * ManageTupleReceive stores the rows that arrived for the given task execution
+ * into the tuple destination, and updates the execution's state once all rows
+ * have been received or the query failed. As rows are stored as soon as they
+ * arrive, a task that fails after storing some of them cannot be retried on
+ * another placement without duplicating rows. In that case we give up on the
+ * task altogether.
+ */
+static void
+ManageTupleReceive(TaskExecution *taskExecution, WorkerNodeState *workerNodeState,
+				   TupleDestination *tupleDestination,
+				   TaskExecutionStatus *executionStatus)
+{
+	TaskExecStatus *taskStatusArray = taskExecution->taskStatusArray;
+	int32 *connectionIdArray = taskExecution->connectionIdArray;
+	uint32 currentIndex = taskExecution->currentNodeIndex;
+	int32 connectionId = connectionIdArray[currentIndex];
+
+	CopyStatus copyStatus = MultiClientReceiveTuples(connectionId, tupleDestination,
+													 &taskExecution->storedTupleCount);
+	if (copyStatus == CLIENT_COPY_MORE)
+	{
+		taskStatusArray[currentIndex] = EXEC_COMPUTE_TASK_COPYING;
+		*executionStatus = TASK_STATUS_SOCKET_READ;
+	}
+	else if (copyStatus == CLIENT_COPY_DONE)
+	{
+		taskStatusArray[currentIndex] = EXEC_TASK_DONE;
+
+		/* we are done executing; let the next task use the connection */
+		ReleaseIdleConnection(workerNodeState, connectionId);
+		connectionIdArray[currentIndex] = INVALID_CONNECTION_ID;
+	}
+	else if (copyStatus == CLIENT_COPY_FAILED)
+	{
+		taskStatusArray[currentIndex] = EXEC_TASK_FAILED;
+
+		if (taskExecution->storedTupleCount > 0)
+		{
+			ereport(WARNING, (errmsg("could not retry task %u after storing part "
+									 "of its results", taskExecution->taskId)));
+
+			taskExecution->failureCount = MAX_TASK_EXECUTION_FAILURES;
+		}
+	}
+}
+
+
+/*
+ * SetTaskExecutionRetryTime makes the given task execution back off before its
+ * next connection attempt. The delay grows with the number of failures the
+ * task has seen so far.
+ */
+static void
+SetTaskExecutionRetryTime(TaskExecution *taskExecution)
+{
+	int retryDelay = RemoteTaskCheckInterval * taskExecution->failureCount;
+
+	taskExecution->retryTime = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+														   retryDelay);
+}
+
+
+/*
+ * TaskExecutionFilename returns the name of the file into which the given task
+ * execution copies its results. Hedged attempts copy into a separate file, which
+ * replaces the task's file once the attempt completes.
+ */
+static StringInfo
+TaskExecutionFilename(Task *task, TaskExecution *taskExecution)
+{
+	StringInfo jobDirectoryName = MasterJobDirectoryName(task->jobId);
+	StringInfo taskFilename = TaskFilename(jobDirectoryName, task->taskId);
+
+	if (taskExecution->hedgeAttempt)
+	{
+		appendStringInfoString(taskFilename, HEDGED_TASK_FILE_SUFFIX);
+	}
+
+	return taskFilename;
+}
+
+
+/*
+ * InstallHedgedTaskFile moves the results of a completed hedged attempt into
+ * the task's file, where the master query expects them. The function returns
+ * false if the file could not be moved.
+ */
+static bool
+InstallHedgedTaskFile(Task *task, TaskExecution *taskExecution)
+{
+	StringInfo hedgedFilename = TaskExecutionFilename(task, taskExecution);
+	StringInfo jobDirectoryName = MasterJobDirectoryName(task->jobId);
+	StringInfo taskFilename = TaskFilename(jobDirectoryName, task->taskId);
+
+	int renamed = rename(hedgedFilename->data, taskFilename->data);
+	if (renamed < 0)
+	{
+		ereport(WARNING, (errcode_for_file_access(),
+						  errmsg("could not rename file \"%s\" to \"%s\": %m",
+								 hedgedFilename->data, taskFilename->data)));
+
+		return false;
+	}
+
+	return true;
+}
+
+
 /* Determines if the given task is ready to start. */
 static bool
 TaskExecutionReadyToStart(TaskExecution *taskExecution)
@@ -707,6 +1352,24 @@ CancelRequestIfActive(TaskExecStatus taskStatus, int connectionId)
 }
 
 
+/*
+ * CleanupTaskExecutionAttempts releases the client-side resources of the given
+ * task execution, and of its hedged attempt if the task has one.
+ */
+static void
+CleanupTaskExecutionAttempts(TaskExecution *taskExecution)
+{
+	TaskExecution *hedgeExecution = taskExecution->hedgeExecution;
+
+	CleanupTaskExecution(taskExecution);
+
+	if (hedgeExecution != NULL)
+	{
+		CleanupTaskExecution(hedgeExecution);
+	}
+}
+
+
 /*
  * WorkerHash creates a worker node hash with the given name. The function
  * then inserts one entry for each worker node in the given worker node
@@ -786,6 +1449,15 @@ WorkerHashEnter(HTAB *workerHash, char *nodeName, uint32 nodePort)
 
 	memcpy(workerNodeState, &workerNodeKey, sizeof(WorkerNodeState));
 	workerNodeState->openConnectionCount = 0;
+	workerNodeState->idleConnectionList = NIL;
+	workerNodeState->connectionLimit = INITIAL_WORKER_CONNECTION_LIMIT;
+	if (RealTimeConnectionPoolEnabled())
+	{
+		workerNodeState->connectionLimit = Min(INITIAL_WORKER_CONNECTION_LIMIT,
+											   MaxRealTimeConnectionsPerWorker);
+	}
+	workerNodeState->connectionLimitChangeTime = GetCurrentTimestamp();
+	workerNodeState->connectionLimitReached = false;
 
 	return workerNodeState;
 }
@@ -837,6 +1509,148 @@ LookupWorkerForTask(HTAB *workerHash, Task *task, TaskExecution *taskExecution)
 }
 
 
+/*
+ * TakeIdleConnection removes an idle connection from the given worker's pool,
+ * and returns its connection id. If the worker has no idle connections, the
+ * function returns INVALID_CONNECTION_ID.
+ */
+static int32
+TakeIdleConnection(WorkerNodeState *workerNodeState)
+{
+	int32 connectionId = INVALID_CONNECTION_ID;
+
+	if (workerNodeState->idleConnectionList != NIL)
+	{
+		connectionId = linitial_int(workerNodeState->idleConnectionList);
+		workerNodeState->idleConnectionList =
+			list_delete_first(workerNodeState->idleConnectionList);
+	}
+
+	return connectionId;
+}
+
+
+/*
+ * ReleaseIdleConnection adds the connection of a completed task to the given
+ * worker's pool of idle connections. The connection stays open, and counts
+ * towards the worker's open connections, until the execution ends. If pooling
+ * is disabled, the function closes the connection instead.
+ */
+static void
+ReleaseIdleConnection(WorkerNodeState *workerNodeState, int32 connectionId)
+{
+	if (!RealTimeConnectionPoolEnabled())
+	{
+		MultiClientDisconnect(connectionId);
+		UpdateConnectionCounter(workerNodeState, CONNECT_ACTION_CLOSED);
+		return;
+	}
+
+	workerNodeState->idleConnectionList =
+		lappend_int(workerNodeState->idleConnectionList, connectionId);
+}
+
+
+/*
+ * RealTimeConnectionPoolEnabled returns true if real-time tasks share a pool of
+ * connections per worker, and false if each task opens its own connection.
+ */
+static bool
+RealTimeConnectionPoolEnabled(void)
+{
+	return MaxRealTimeConnectionsPerWorker != REAL_TIME_CONNECTION_POOL_DISABLED;
+}
+
+
+/* CloseIdleConnections closes the idle connections to all workers. */
+static void
+CloseIdleConnections(HTAB *workerHash)
+{
+	WorkerNodeState *workerNodeState = NULL;
+	HASH_SEQ_STATUS status;
+
+	hash_seq_init(&status, workerHash);
+
+	workerNodeState = (WorkerNodeState *) hash_seq_search(&status);
+	while (workerNodeState != NULL)
+	{
+		ListCell *connectionIdCell = NULL;
+		foreach(connectionIdCell, workerNodeState->idleConnectionList)
+		{
+			int32 connectionId = lfirst_int(connectionIdCell);
+
+			MultiClientDisconnect(connectionId);
+			UpdateConnectionCounter(workerNodeState, CONNECT_ACTION_CLOSED);
+		}
+
+		list_free(workerNodeState->idleConnectionList);
+		workerNodeState->idleConnectionList = NIL;
+
+		workerNodeState = (WorkerNodeState *) hash_seq_search(&status);
+	}
+}
+
+
+/*
+ * AdjustConnectionLimits grows the connection pool of workers on which tasks
+ * had to wait for a connection. To avoid opening many connections for tasks
+ * that finish quickly enough to share a few connections, a pool only doubles
+ * in size if tasks kept waiting for the remote task check interval.
+ */
+static void
+AdjustConnectionLimits(HTAB *workerHash)
+{
+	WorkerNodeState *workerNodeState = NULL;
+	TimestampTz currentTime = GetCurrentTimestamp();
+	HASH_SEQ_STATUS status;
+
+	/* without a pool, each task opens its own connection */
+	if (!RealTimeConnectionPoolEnabled())
+	{
+		return;
+	}
+
+	hash_seq_init(&status, workerHash);
+
+	workerNodeState = (WorkerNodeState *) hash_seq_search(&status);
+	while (workerNodeState != NULL)
+	{
+		uint32 connectionLimit = workerNodeState->connectionLimit;
+
+		if (!workerNodeState->connectionLimitReached)
+		{
+			/* tasks didn't wait; restart the interval on the next wait */
+			workerNodeState->connectionLimitChangeTime = currentTime;
+		}
+		else if (connectionLimit < MaxRealTimeConnectionsPerWorker &&
+				 TimestampDifferenceExceeds(workerNodeState->connectionLimitChangeTime,
+											currentTime, RemoteTaskCheckInterval))
+		{
+			workerNodeState->connectionLimit =
+				Min(connectionLimit * 2, MaxRealTimeConnectionsPerWorker);
+			workerNodeState->connectionLimitChangeTime = currentTime;
+		}
+
+		workerNodeState->connectionLimitReached = false;
+
+		workerNodeState = (WorkerNodeState *) hash_seq_search(&status);
+	}
+}
+
+
+/*
+ * ReduceConnectionLimit halves the connection pool size of the given worker
+ * after we failed to connect to it, as the worker may be running out of
+ * connection slots.
+ */
+static void
+ReduceConnectionLimit(WorkerNodeState *workerNodeState)
+{
+	workerNodeState->connectionLimit = Max(workerNodeState->connectionLimit / 2, 1);
+	workerNodeState->connectionLimitChangeTime = GetCurrentTimestamp();
+}
+
+
 /*
  * WorkerConnectionsExhausted determines if the current query has exhausted the
  * maximum number of open connections that can be made to a worker.
@@ -858,6 +1672,26 @@ WorkerConnectionsExhausted(WorkerNodeState *workerNodeState)
 		reachedLimit = true;
 	}
 
+	/* also stay within the current size of the worker's connection pool */
+	if (RealTimeConnectionPoolEnabled() &&
+		workerNodeState->openConnectionCount >= workerNodeState->connectionLimit)
+	{
+		reachedLimit = true;
+	}
+
+	/*
+	 * Once all backends together use as many connections to the worker as
+	 * citus.max_shared_connections_per_node allows, make do with the
+	 * connections we already have instead of waiting for another one. Only
+	 * the first connection to a worker waits for a slot to become free.
+	 */
+	if (workerNodeState->openConnectionCount > 0 &&
+		SharedConnectionBudgetExhausted(workerNodeState->workerName,
+										workerNodeState->workerPort))
+	{
+		reachedLimit = true;
+	}
+
 	return reachedLimit;
 }
 
@@ -922,3 +1756,34 @@ UpdateConnectionCounter(WorkerNodeState *workerNode, ConnectAction connectAction
 		workerNode->openConnectionCount--;
 	}
 }
+
+
+/*
+ * citus_task_hedging_stats returns the number of real-time tasks for which
+ * this backend started a hedged attempt, and the number of those tasks for
+ * which the hedged attempt completed first.
+ */
+Datum
+citus_task_hedging_stats(PG_FUNCTION_ARGS)
+{
+	TypeFuncClass resultTypeClass = 0;
+	TupleDesc statsDescriptor = NULL;
+	HeapTuple statsTuple = NULL;
+	Datum values[2];
+	bool isNulls[2];
+
+	resultTypeClass = get_call_result_type(fcinfo, NULL, &statsDescriptor);
+	if (resultTypeClass != TYPEFUNC_COMPOSITE)
+	{
+		ereport(ERROR, (errmsg("return type must be a row type")));
+	}
+
+	memset(isNulls, false, sizeof(isNulls));
+
+	values[0] = Int64GetDatum(HedgedTaskCount);
+	values[1] = Int64GetDatum(HedgedTaskWinCount);
+
+	statsTuple = heap_form_tuple(statsDescriptor, values, isNulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(statsTuple));
+}
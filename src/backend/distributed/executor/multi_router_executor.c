@@ -44,9 +44,11 @@
 #include "distributed/remote_commands.h"
 #include "distributed/remote_transaction.h"
 #include "distributed/resource_lock.h"
+#include "distributed/worker_manager.h"
 #include "executor/execdesc.h"
 #include "executor/executor.h"
 #include "executor/instrument.h"
+#include "executor/tstoreReceiver.h"
 #include "executor/tuptable.h"
 #include "lib/stringinfo.h"
 #include "nodes/execnodes.h"
@@ -58,6 +60,7 @@
 #include "storage/ipc.h"
 #include "storage/lock.h"
 #include "tcop/dest.h"
+#include "tcop/tcopprot.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
 #include "utils/hsearch.h"
@@ -65,6 +68,7 @@
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/palloc.h"
+#include "utils/snapmgr.h"
 #include "utils/tuplestore.h"
 
 
@@ -72,11 +76,28 @@
 bool AllModificationsCommutative = false;
 bool EnableDeadlockPrevention = true;
 
+/* controls in-process execution of select tasks with a local placement */
+bool EnableLocalExecution = false;
+
+/* controls batching of single-shard modifications in transaction blocks */
+bool DeferRouterModifications = false;
+
+/* controls returning router select rows as they arrive */
+bool StreamRouterResults = false;
+
 /* functions needed during run phase */
 static void ReacquireMetadataLocks(List *taskList);
 static void ExecuteSingleModifyTask(CitusScanState *scanState, Task *task,
 									bool expectResults);
 static void ExecuteSingleSelectTask(CitusScanState *scanState, Task *task);
+static bool CanExecuteTaskLocally(Task *task);
+static bool CanStreamSelectTask(CitusScanState *scanState, Task *task);
+static void BeginStreamingSelectTask(CitusScanState *scanState, Task *task);
+static TupleTableSlot * ReturnStreamedSelectTuple(CitusScanState *scanState);
+static void ExecuteLocalSelectTask(CitusScanState *scanState, Task *task,
+								   ParamListInfo paramListInfo);
+static bool CanDeferModifyTask(Task *task, bool expectResults,
+							   ParamListInfo paramListInfo);
 static List * GetModifyConnections(List *taskPlacementList, bool markCritical,
 								   bool startedInTransaction);
 static void ExecuteMultipleTasks(CitusScanState *scanState, List *taskList,
@@ -87,7 +108,7 @@ static List * TaskShardIntervalList(List *taskList);
 static void AcquireExecutorShardLock(Task *task, CmdType commandType);
 static void AcquireExecutorMultiShardLocks(List *taskList);
 static bool RequiresConsistentSnapshot(Task *task);
-static void ProcessMasterEvaluableFunctions(Job *workerJob);
+static void ProcessMasterEvaluableFunctions(CitusScanState *scanState, Job *workerJob);
 static void ExtractParametersFromParamListInfo(ParamListInfo paramListInfo,
 											   Oid **parameterTypes,
 											   const char ***parameterValues);
@@ -449,7 +470,7 @@ RouterSingleModifyExecScan(CustomScanState *node)
 		List *taskList = workerJob->taskList;
 		Task *task = (Task *) linitial(taskList);
 
-		ProcessMasterEvaluableFunctions(workerJob);
+		ProcessMasterEvaluableFunctions(scanState, workerJob);
 
 		ExecuteSingleModifyTask(scanState, task, hasReturning);
 
@@ -464,18 +485,24 @@ RouterSingleModifyExecScan(CustomScanState *node)
 
 /*
  * ProcessMasterEvaluableFunctions executes evaluable functions and rebuilds
- * the query strings in task lists.
+ * the query strings in task lists. Query strings are cached per plan, such
+ * that executions whose functions evaluate to the same values as in the
+ * previous execution of the plan skip deparsing. Plans are identified by the
+ * plan id assigned to them when they were created, which is never reused.
  */
 static void
-ProcessMasterEvaluableFunctions(Job *workerJob)
+ProcessMasterEvaluableFunctions(CitusScanState *scanState, Job *workerJob)
 {
 	if (workerJob->requiresMasterEvaluation)
 	{
+		CustomScan *customScan = (CustomScan *) scanState->customScanState.ss.ps.plan;
+		Const *planIdConst = (Const *) lsecond(customScan->custom_private);
+		uint64 planId = (uint64) DatumGetInt64(planIdConst->constvalue);
 		Query *jobQuery = workerJob->jobQuery;
 		List *taskList = workerJob->taskList;
 
 		ExecuteMasterEvaluableFunctions(jobQuery);
-		RebuildQueryStrings(jobQuery, taskList);
+		RebuildQueryStringsCached(planId, jobQuery, taskList);
 	}
 }
 
@@ -499,7 +526,7 @@ RouterMultiModifyExecScan(CustomScanState *node)
 		bool hasReturning = multiPlan->hasReturning;
 		bool isModificationQuery = true;
 
-		ProcessMasterEvaluableFunctions(workerJob);
+		ProcessMasterEvaluableFunctions(scanState, workerJob);
 
 		ExecuteMultipleTasks(scanState, taskList, isModificationQuery, hasReturning);
 
@@ -515,7 +542,9 @@ RouterMultiModifyExecScan(CustomScanState *node)
 /*
  * RouterSelectExecScan executes a single select task on the remote node,
  * retrieves the results and stores them in custom scan's tuple store. Then, it
- * returns tuples one by one from this tuple store.
+ * returns tuples one by one from this tuple store. If citus.stream_router_results
+ * is set, tuples are instead returned one by one as they arrive from the remote
+ * node, without storing them.
  */
 TupleTableSlot *
 RouterSelectExecScan(CustomScanState *node)
@@ -530,7 +559,19 @@ RouterSelectExecScan(CustomScanState *node)
 		List *taskList = workerJob->taskList;
 		Task *task = (Task *) linitial(taskList);
 
-		ProcessMasterEvaluableFunctions(workerJob);
+		if (scanState->streamingConnection != NULL)
+		{
+			return ReturnStreamedSelectTuple(scanState);
+		}
+
+		ProcessMasterEvaluableFunctions(scanState, workerJob);
+
+		if (CanStreamSelectTask(scanState, task))
+		{
+			BeginStreamingSelectTask(scanState, task);
+
+			return ReturnStreamedSelectTuple(scanState);
+		}
 
 		ExecuteSingleSelectTask(scanState, task);
 
@@ -566,6 +607,13 @@ ExecuteSingleSelectTask(CitusScanState *scanState, Task *task)
 							   "which contain multi-shard data modifications")));
 	}
 
+	/* skip the loopback connection if the shard is stored on this node */
+	if (CanExecuteTaskLocally(task))
+	{
+		ExecuteLocalSelectTask(scanState, task, paramListInfo);
+		return;
+	}
+
 	/*
 	 * Try to run the query to completion on one placement. If the query fails
 	 * attempt the query on the next placement.
@@ -598,9 +646,374 @@ ExecuteSingleSelectTask(CitusScanState *scanState, Task *task)
 }
 
 
+/*
+ * CanStreamSelectTask returns whether the rows of the given select task can be
+ * returned as they arrive. That's only done outside of transaction blocks, as
+ * the connection is unavailable to other commands while rows are streamed,
+ * and for scans that never have to revisit rows.
+ */
+static bool
+CanStreamSelectTask(CitusScanState *scanState, Task *task)
+{
+	if (!StreamRouterResults || scanState->randomAccess)
+	{
+		return false;
+	}
+
+	if (IsTransactionBlock() || XactModificationLevel != XACT_MODIFICATION_NONE)
+	{
+		return false;
+	}
+
+	/* local execution doesn't go through a connection */
+	if (CanExecuteTaskLocally(task))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * BeginStreamingSelectTask sends the task to one of its placements and waits
+ * for the first row. Up to that point, the task is retried on the next
+ * placement on failure, once rows are returned that's not possible anymore.
+ * The connection is claimed exclusively until the scan ends, so that other
+ * commands run while the rows are being read use a different connection.
+ */
+static void
+BeginStreamingSelectTask(CitusScanState *scanState, Task *task)
+{
+	TupleDesc tupleDescriptor =
+		scanState->customScanState.ss.ps.ps_ResultTupleSlot->tts_tupleDescriptor;
+	ParamListInfo paramListInfo =
+		scanState->customScanState.ss.ps.state->es_param_list_info;
+	List *taskPlacementList = task->taskPlacementList;
+	ListCell *taskPlacementCell = NULL;
+	char *queryString = task->queryString;
+
+	foreach(taskPlacementCell, taskPlacementList)
+	{
+		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
+		int connectionFlags = SESSION_LIFESPAN;
+		MultiConnection *connection =
+			GetPlacementConnection(connectionFlags, taskPlacement, NULL);
+		bool doRaiseInterrupts = true;
+		PGresult *result = NULL;
+		ExecStatusType resultStatus = PGRES_FATAL_ERROR;
+		bool queryOK = false;
+
+		queryOK = SendQueryInSingleRowMode(connection, queryString, paramListInfo);
+		if (!queryOK)
+		{
+			continue;
+		}
+
+		result = GetRemoteCommandResult(connection, doRaiseInterrupts);
+		resultStatus = PQresultStatus(result);
+		if ((resultStatus != PGRES_SINGLE_TUPLE) && (resultStatus != PGRES_TUPLES_OK))
+		{
+			char *sqlStateString = PQresultErrorField(result, PG_DIAG_SQLSTATE);
+			int category = ERRCODE_TO_CATEGORY(ERRCODE_INTEGRITY_CONSTRAINT_VIOLATION);
+
+			MarkRemoteTransactionFailed(connection, false);
+
+			/*
+			 * Constraint violations would fail on all placements, and errors of
+			 * deferred commands sent along aren't this placement's fault.
+			 */
+			if (SqlStateMatchesCategory(sqlStateString, category) ||
+				connection->remoteTransaction.pipelinedCommandFailed)
+			{
+				ReportResultError(connection, result, ERROR);
+			}
+
+			ReportResultError(connection, result, WARNING);
+
+			PQclear(result);
+			ForgetResults(connection);
+
+			continue;
+		}
+
+		ClaimConnectionExclusively(connection);
+
+		scanState->streamingConnection = connection;
+		scanState->streamingResult = result;
+		scanState->attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
+		scanState->streamingContext = AllocSetContextCreate(CurrentMemoryContext,
+															"StreamingSelectTask",
+															ALLOCSET_DEFAULT_MINSIZE,
+															ALLOCSET_DEFAULT_INITSIZE,
+															ALLOCSET_DEFAULT_MAXSIZE);
+		return;
+	}
+
+	ereport(ERROR, (errmsg("could not receive query results")));
+}
+
+
+/*
+ * ReturnStreamedSelectTuple reads the next row of a streaming select task
+ * from its connection and returns it. When all rows have been read, the scan
+ * ends and an empty slot is returned.
+ */
+static TupleTableSlot *
+ReturnStreamedSelectTuple(CitusScanState *scanState)
+{
+	MultiConnection *connection = scanState->streamingConnection;
+	TupleTableSlot *resultSlot = scanState->customScanState.ss.ps.ps_ResultTupleSlot;
+	List *targetList = scanState->customScanState.ss.ps.plan->targetlist;
+	uint32 columnCount = ExecCleanTargetListLength(targetList);
+
+	/* the previously returned row isn't needed anymore */
+	ExecClearTuple(resultSlot);
+	MemoryContextReset(scanState->streamingContext);
+
+	for (;;)
+	{
+		PGresult *result = scanState->streamingResult;
+		ExecStatusType resultStatus = PGRES_FATAL_ERROR;
+		char **columnArray = NULL;
+		uint32 columnIndex = 0;
+		HeapTuple heapTuple = NULL;
+		MemoryContext oldContext = NULL;
+
+		if (result != NULL)
+		{
+			/* first row was already received when the scan began */
+			scanState->streamingResult = NULL;
+		}
+		else
+		{
+			bool doRaiseInterrupts = true;
+
+			result = GetRemoteCommandResult(connection, doRaiseInterrupts);
+		}
+
+		if (result == NULL)
+		{
+			/* all rows were returned */
+			scanState->finishedRemoteScan = true;
+			EndStreamingSelectTask(scanState);
+
+			return resultSlot;
+		}
+
+		resultStatus = PQresultStatus(result);
+		if ((resultStatus != PGRES_SINGLE_TUPLE) && (resultStatus != PGRES_TUPLES_OK))
+		{
+			/* rows were already returned, so we can't fail over */
+			MarkRemoteTransactionFailed(connection, false);
+			ReportResultError(connection, result, ERROR);
+		}
+
+		/* the last result of single-row mode doesn't contain any rows */
+		if (PQntuples(result) == 0)
+		{
+			PQclear(result);
+			continue;
+		}
+
+		Assert(PQntuples(result) == 1);
+		Assert(PQnfields(result) == columnCount);
+
+		/* the row lives in the streaming context until the next call */
+		oldContext = MemoryContextSwitchTo(scanState->streamingContext);
+
+		columnArray = (char **) palloc0(columnCount * sizeof(char *));
+		for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			if (!PQgetisnull(result, 0, columnIndex))
+			{
+				columnArray[columnIndex] = PQgetvalue(result, 0, columnIndex);
+			}
+		}
+
+		heapTuple = BuildTupleFromCStrings(scanState->attributeInputMetadata,
+										   columnArray);
+
+		MemoryContextSwitchTo(oldContext);
+
+		PQclear(result);
+
+		return ExecStoreTuple(heapTuple, resultSlot, InvalidBuffer, false);
+	}
+}
+
+
+/*
+ * EndStreamingSelectTask ends a streaming select task. If the scan ends before
+ * all rows were read, for example because of a LIMIT in the master query, the
+ * remote command is cancelled. The connection is then usable by others again.
+ */
+void
+EndStreamingSelectTask(CitusScanState *scanState)
+{
+	MultiConnection *connection = scanState->streamingConnection;
+
+	/* make sure we don't end the scan twice if we error out below */
+	scanState->streamingConnection = NULL;
+
+	if (scanState->streamingResult != NULL)
+	{
+		PQclear(scanState->streamingResult);
+		scanState->streamingResult = NULL;
+	}
+
+	if (!scanState->finishedRemoteScan)
+	{
+		SendCancelationRequest(connection);
+		scanState->finishedRemoteScan = true;
+	}
+
+	ForgetResults(connection);
+	UnclaimConnection(connection);
+
+	MemoryContextDelete(scanState->streamingContext);
+	scanState->streamingContext = NULL;
+}
+
+
+/*
+ * CanExecuteTaskLocally returns whether the given select task can be run in
+ * this backend instead of over a connection to the local node. This is the
+ * case when one of the task's placements is in the local group, as is common
+ * for queries on MX workers.
+ *
+ * Local execution is restricted to statements outside of transaction blocks
+ * which have not modified any data. Writes made over a remote connection in
+ * the same transaction would not be visible locally, and the locks taken by
+ * local execution could block later commands which go through a connection.
+ */
+static bool
+CanExecuteTaskLocally(Task *task)
+{
+	ListCell *taskPlacementCell = NULL;
+	int localGroupId = -1;
+
+	if (!EnableLocalExecution || IsTransactionBlock() ||
+		XactModificationLevel != XACT_MODIFICATION_NONE)
+	{
+		return false;
+	}
+
+	localGroupId = GetLocalGroupId();
+
+	foreach(taskPlacementCell, task->taskPlacementList)
+	{
+		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
+		WorkerNode *workerNode = FindWorkerNode(taskPlacement->nodeName,
+												taskPlacement->nodePort);
+
+		if (workerNode != NULL && workerNode->groupId == localGroupId)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ExecuteLocalSelectTask plans and runs the task's query string through the
+ * local executor and stores the resulting tuples in the scan's tuple store.
+ * The query string references the shard, which exists on this node.
+ */
+static void
+ExecuteLocalSelectTask(CitusScanState *scanState, Task *task,
+					   ParamListInfo paramListInfo)
+{
+	char *queryString = task->queryString;
+	List *parseTreeList = NIL;
+	Node *parseTree = NULL;
+	List *queryTreeList = NIL;
+	Query *query = NULL;
+	PlannedStmt *localPlan = NULL;
+	QueryDesc *queryDesc = NULL;
+	DestReceiver *tupleStoreDestination = NULL;
+	Oid *parameterTypes = NULL;
+	int parameterCount = 0;
+	int parameterIndex = 0;
+	bool randomAccess = true;
+	bool interTransactions = false;
+	bool detoast = false;
+	int instrumentOptions = 0;
+	int cursorOptions = 0;
+
+	ereport(DEBUG4, (errmsg("executing task %u on shard " UINT64_FORMAT " locally",
+							task->taskId, task->anchorShardId)));
+
+	if (paramListInfo != NULL)
+	{
+		parameterCount = paramListInfo->numParams;
+		parameterTypes = (Oid *) palloc0(parameterCount * sizeof(Oid));
+
+		for (parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
+		{
+			ParamExternData *parameterData = &paramListInfo->params[parameterIndex];
+
+			/* unreferenced parameters are sent as text to remote nodes as well */
+			if (parameterData->ptype == InvalidOid)
+			{
+				parameterTypes[parameterIndex] = TEXTOID;
+			}
+			else
+			{
+				parameterTypes[parameterIndex] = parameterData->ptype;
+			}
+		}
+	}
+
+	parseTreeList = pg_parse_query(queryString);
+	if (list_length(parseTreeList) != 1)
+	{
+		ereport(ERROR, (errmsg("cannot execute multiple statements locally")));
+	}
+
+	parseTree = (Node *) linitial(parseTreeList);
+	queryTreeList = pg_analyze_and_rewrite(parseTree, queryString, parameterTypes,
+										   parameterCount);
+	if (list_length(queryTreeList) != 1)
+	{
+		ereport(ERROR, (errmsg("cannot execute rewritten query locally")));
+	}
+
+	query = (Query *) linitial(queryTreeList);
+	localPlan = pg_plan_query(query, cursorOptions, paramListInfo);
+
+	if (scanState->tuplestorestate == NULL)
+	{
+		scanState->tuplestorestate =
+			tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+	}
+
+	tupleStoreDestination = CreateDestReceiver(DestTuplestore);
+	SetTuplestoreDestReceiverParams(tupleStoreDestination, scanState->tuplestorestate,
+									CurrentMemoryContext, detoast);
+
+	queryDesc = CreateQueryDesc(localPlan, queryString, GetActiveSnapshot(),
+								InvalidSnapshot, tupleStoreDestination, paramListInfo,
+								instrumentOptions);
+
+	ExecutorStart(queryDesc, 0);
+	ExecutorRun(queryDesc, ForwardScanDirection, 0L);
+	ExecutorFinish(queryDesc);
+	ExecutorEnd(queryDesc);
+
+	FreeQueryDesc(queryDesc);
+	(*tupleStoreDestination->rDestroy)(tupleStoreDestination);
+}
+
+
 /*
  * ExecuteSingleModifyTask executes the task on the remote node, retrieves the
- * results and stores them, if RETURNING is used, in a tuple store.
+ * results and stores them, if RETURNING is used, in a tuple store. Inside a
+ * coordinated transaction, the task is sent to all placements before any
+ * results are read, so that the placements execute the modification
+ * concurrently. Otherwise, the placements are modified one after another.
  *
  * If the task fails on one of the placements, the function reraises the
  * remote error (constraint violation in DML), marks the affected placement as
@@ -620,6 +1033,7 @@ ExecuteSingleModifyTask(CitusScanState *scanState, Task *task, bool expectResult
 	int64 affectedTupleCount = -1;
 	bool resultsOK = false;
 	bool gotResults = false;
+	bool sendInParallel = false;
 
 	char *queryString = task->queryString;
 	bool taskRequiresTwoPhaseCommit = (task->replicationModel == REPLICATION_MODEL_2PC);
@@ -669,7 +1083,70 @@ ExecuteSingleModifyTask(CitusScanState *scanState, Task *task, bool expectResult
 	/* prevent replicas of the same shard from diverging */
 	AcquireExecutorShardLock(task, operation);
 
-	/* try to execute modification on all placements */
+	/*
+	 * When deferring, only queue the modification on all placements. It's
+	 * sent together with later commands, and its results are checked then.
+	 */
+	if (CanDeferModifyTask(task, expectResults, paramListInfo))
+	{
+		foreach(connectionCell, connectionList)
+		{
+			MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+			if (connection->remoteTransaction.transactionFailed)
+			{
+				continue;
+			}
+
+			DeferRemoteTransactionCommand(connection, queryString);
+			resultsOK = true;
+		}
+
+		if (!resultsOK)
+		{
+			ereport(ERROR, (errmsg("could not modify any active placements")));
+		}
+
+		MarkFailedShardPlacements();
+
+		XactModificationLevel = XACT_MODIFICATION_DATA;
+
+		return;
+	}
+
+	/*
+	 * An error raised for one placement aborts a coordinated transaction on all
+	 * placements, so there we send the modification to all placements before
+	 * reading any results. Otherwise, each placement commits on its own, and a
+	 * placement that raises an error (e.g. a constraint violation) has to stop
+	 * us before we modify the next one, or the replicas would diverge.
+	 */
+	sendInParallel = InCoordinatedTransaction();
+
+	if (sendInParallel)
+	{
+		foreach(connectionCell, connectionList)
+		{
+			MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+			if (connection->remoteTransaction.transactionFailed)
+			{
+				/*
+				 * If GetModifyConnections failed to send BEGIN this connection will
+				 * have been marked as failed, and should not have any more commands
+				 * sent to it! Skip it for now, at the bottom of this method we call
+				 * MarkFailedShardPlacements() to ensure future statements will not
+				 * use this placement.
+				 */
+				continue;
+			}
+
+			/* on failure, this marks the connection's transaction as failed */
+			SendQueryInSingleRowMode(connection, queryString, paramListInfo);
+		}
+	}
+
+	/* then collect the results from all placements the modification was sent to */
 	forboth(taskPlacementCell, taskPlacementList, connectionCell, connectionList)
 	{
 		ShardPlacement *taskPlacement = (ShardPlacement *) lfirst(taskPlacementCell);
@@ -680,22 +1157,22 @@ ExecuteSingleModifyTask(CitusScanState *scanState, Task *task, bool expectResult
 
 		if (connection->remoteTransaction.transactionFailed)
 		{
-			/*
-			 * If GetModifyConnections failed to send BEGIN this connection will have
-			 * been marked as failed, and should not have any more commands sent to
-			 * it! Skip it for now, at the bottom of this method we call
-			 * MarkFailedShardPlacements() to ensure future statements will not use this
-			 * placement.
-			 */
+			/* the modification could not be sent to this placement */
 			continue;
 		}
 
-		queryOK = SendQueryInSingleRowMode(connection, queryString, paramListInfo);
-		if (!queryOK)
+		if (!sendInParallel)
 		{
-			continue;
+			queryOK = SendQueryInSingleRowMode(connection, queryString, paramListInfo);
+			if (!queryOK)
+			{
+				continue;
+			}
 		}
 
+		/* abort in case of cancellation */
+		CHECK_FOR_INTERRUPTS();
+
 		/* if we're running a 2PC, the query should fail on error */
 		failOnError = taskRequiresTwoPhaseCommit;
 
@@ -761,6 +1238,45 @@ ExecuteSingleModifyTask(CitusScanState *scanState, Task *task, bool expectResult
 }
 
 
+/*
+ * CanDeferModifyTask returns whether a single-shard modification can be
+ * deferred until the next command sent to its placements, or until commit.
+ * That's only the case for modifications in transaction blocks which don't
+ * return any rows and don't have parameters that would need to be sent
+ * separately.
+ *
+ * A deferred modification that fails aborts the transaction, as it was
+ * already reported to have succeeded. Modifications of shards with multiple
+ * placements are therefore never deferred: if they fail on some placements,
+ * those placements are marked invalid instead.
+ */
+static bool
+CanDeferModifyTask(Task *task, bool expectResults, ParamListInfo paramListInfo)
+{
+	if (!DeferRouterModifications || !IsTransactionBlock())
+	{
+		return false;
+	}
+
+	if (list_length(task->taskPlacementList) > 1)
+	{
+		return false;
+	}
+
+	if (expectResults)
+	{
+		return false;
+	}
+
+	if (paramListInfo != NULL && paramListInfo->numParams > 0)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
 /*
  * GetModifyConnections returns the list of connections required to execute
  * modify commands on the placements in tasPlacementList.  If necessary remote
@@ -932,6 +1448,15 @@ ExecuteModifyTasks(List *taskList, bool expectResults, ParamListInfo paramListIn
 	shardConnectionHash = OpenTransactionsToAllShardPlacements(shardIntervalList,
 															   connectionFlags);
 
+	/*
+	 * The deferred BEGINs can only be sent along with commands that have no
+	 * parameters. Otherwise, begin all remote transactions at once here.
+	 */
+	if (paramListInfo != NULL && paramListInfo->numParams > 0)
+	{
+		CoordinatedRemoteTransactionsFlush();
+	}
+
 	XactModificationLevel = XACT_MODIFICATION_MULTI_SHARD;
 
 	/* iterate over placements in rounds, to ensure in-order execution */
@@ -1112,8 +1637,17 @@ SendQueryInSingleRowMode(MultiConnection *connection, char *query,
 		ExtractParametersFromParamListInfo(paramListInfo, &parameterTypes,
 										   &parameterValues);
 
-		querySent = SendRemoteCommandParams(connection, query, parameterCount,
-											parameterTypes, parameterValues);
+		if (EnableRemotePreparedStatements && parameterCount > 0)
+		{
+			/* parameterized queries are worth preparing on the worker */
+			querySent = SendRemoteCommandPrepared(connection, query, parameterCount,
+												  parameterTypes, parameterValues);
+		}
+		else
+		{
+			querySent = SendRemoteCommandParams(connection, query, parameterCount,
+												parameterTypes, parameterValues);
+		}
 	}
 	else
 	{
@@ -1276,12 +1810,14 @@ StoreQueryResult(CitusScanState *scanState, MultiConnection *connection,
 			/*
 			 * If the error code is in constraint violation class, we want to
 			 * fail fast because we must get the same error from all shard
-			 * placements.
+			 * placements. The same goes for errors of earlier deferred
+			 * commands, which were sent along with this one.
 			 */
 			category = ERRCODE_TO_CATEGORY(ERRCODE_INTEGRITY_CONSTRAINT_VIOLATION);
 			isConstraintViolation = SqlStateMatchesCategory(sqlStateString, category);
 
-			if (isConstraintViolation || failOnError)
+			if (isConstraintViolation || failOnError ||
+				connection->remoteTransaction.pipelinedCommandFailed)
 			{
 				ReportResultError(connection, result, ERROR);
 			}
@@ -1390,12 +1926,14 @@ ConsumeQueryResult(MultiConnection *connection, bool failOnError, int64 *rows)
 			/*
 			 * If the error code is in constraint violation class, we want to
 			 * fail fast because we must get the same error from all shard
-			 * placements.
+			 * placements. The same goes for errors of earlier deferred
+			 * commands, which were sent along with this one.
 			 */
 			category = ERRCODE_TO_CATEGORY(ERRCODE_INTEGRITY_CONSTRAINT_VIOLATION);
 			isConstraintViolation = SqlStateMatchesCategory(sqlStateString, category);
 
-			if (isConstraintViolation || failOnError)
+			if (isConstraintViolation || failOnError ||
+				connection->remoteTransaction.pipelinedCommandFailed)
 			{
 				ReportResultError(connection, result, ERROR);
 			}
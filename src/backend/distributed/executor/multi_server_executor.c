@@ -29,6 +29,11 @@
 int RemoteTaskCheckInterval = 100; /* per cycle sleep interval in millisecs */
 int TaskExecutorType = MULTI_EXECUTOR_REAL_TIME; /* distributed executor type */
 bool BinaryMasterCopyFormat = false; /* copy data from workers in binary format */
+bool RealTimeResultsInMemory = false; /* store real-time results without files */
+bool StreamRealTimeResults = false; /* return real-time results as they arrive */
+int MaxRealTimeConnectionsPerWorker = REAL_TIME_CONNECTION_POOL_DISABLED; /* real-time connections per worker */
+bool CombineRealTimeTasks = false; /* run one real-time task per worker node */
+int TaskHedgingCompletedPercentage = 0; /* completed tasks before hedging stragglers */
 
 
 /*
@@ -155,14 +160,20 @@ InitTaskExecution(Task *task, TaskExecStatus initialTaskExecStatus)
 	taskExecution->taskId = task->taskId;
 	taskExecution->nodeCount = nodeCount;
 	taskExecution->connectStartTime = 0;
+	taskExecution->retryTime = 0;
 	taskExecution->currentNodeIndex = 0;
 	taskExecution->dataFetchTaskIndex = -1;
 	taskExecution->failureCount = 0;
+	taskExecution->storedTupleCount = 0;
+	taskExecution->hedgeExecution = NULL;
+	taskExecution->hedgeAttempt = false;
+	taskExecution->hedged = false;
 
 	taskExecution->taskStatusArray = palloc0(nodeCount * sizeof(TaskExecStatus));
 	taskExecution->transmitStatusArray = palloc0(nodeCount * sizeof(TransmitExecStatus));
 	taskExecution->connectionIdArray = palloc0(nodeCount * sizeof(int32));
 	taskExecution->fileDescriptorArray = palloc0(nodeCount * sizeof(int32));
+	taskExecution->failedNodeArray = palloc0(nodeCount * sizeof(bool));
 
 	for (nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
 	{
@@ -170,6 +181,7 @@ InitTaskExecution(Task *task, TaskExecStatus initialTaskExecStatus)
 		taskExecution->transmitStatusArray[nodeIndex] = EXEC_TRANSMIT_UNASSIGNED;
 		taskExecution->connectionIdArray[nodeIndex] = INVALID_CONNECTION_ID;
 		taskExecution->fileDescriptorArray[nodeIndex] = -1;
+		taskExecution->failedNodeArray[nodeIndex] = false;
 	}
 
 	return taskExecution;
@@ -215,6 +227,7 @@ CleanupTaskExecution(TaskExecution *taskExecution)
 	pfree(taskExecution->taskStatusArray);
 	pfree(taskExecution->connectionIdArray);
 	pfree(taskExecution->fileDescriptorArray);
+	pfree(taskExecution->failedNodeArray);
 	memset(taskExecution, 0, sizeof(TaskExecution));
 }
 
@@ -116,9 +116,14 @@ static List * ShardFetchTaskList(List *taskList);
 static void ManageTaskTracker(TaskTracker *taskTracker);
 static bool TrackerConnectionUp(TaskTracker *taskTracker);
 static void TrackerReconnectPoll(TaskTracker *taskTracker);
+static void TrackerRegisterWait(WaitInfo *waitInfo, TaskTracker *taskTracker,
+								int32 previousConnectionId);
 static List * AssignQueuedTasks(TaskTracker *taskTracker);
-static int32 NextRunningTaskIndex(List *assignedTaskList, int32 currentTaskIndex);
-static TaskStatus TaskStatusQueryResponse(int32 connectionId);
+static bool TrackerTaskRunning(TrackerTaskState *taskState);
+static StringInfo TaskStatusChangesQuery(TaskTracker *taskTracker);
+static void TaskStatusChangesQueryResponse(TaskTracker *taskTracker);
+static TaskStatus ParseTaskStatus(char *valueString);
+static void RecordTaskStatusQueryFailure(TaskTracker *taskTracker);
 static void ManageTransmitTracker(TaskTracker *transmitTracker);
 static TrackerTaskState * NextQueuedFileTransmit(HTAB *taskStateHash);
 
@@ -160,6 +165,8 @@ MultiTaskTrackerExecute(Job *job)
 	const char *taskTrackerHashName = "Task Tracker Hash";
 	const char *transmitTrackerHashName = "Transmit Tracker Hash";
 	List *jobIdList = NIL;
+	WaitInfo *waitInfo = NULL;
+	TimestampTz lastTrackerCheckTime = 0;
 
 	/*
 	 * We walk over the task tree, and create a task execution struct for each
@@ -197,6 +204,9 @@ MultiTaskTrackerExecute(Job *job)
 	TrackerHashConnect(taskTrackerHash);
 	TrackerHashConnect(transmitTrackerHash);
 
+	/* we wait on transmit connections, so that results stream in without delay */
+	waitInfo = MultiClientCreateWaitInfo(taskTrackerCount);
+
 	/* loop around until all tasks complete, one task fails, or user cancels */
 	while (!(allTasksCompleted || taskFailed || taskTransmitFailed ||
 			 clusterFailed || QueryCancelPending))
@@ -209,6 +219,8 @@ MultiTaskTrackerExecute(Job *job)
 		uint32 completedTransmitCount = 0;
 		uint32 healthyTrackerCount = 0;
 		double acceptableHealthyTrackerCount = 0.0;
+		TimestampTz currentTime = 0;
+		bool checkTaskTrackers = false;
 
 		/* first, loop around all tasks and manage them */
 		ListCell *taskAndExecutionCell = NULL;
@@ -345,7 +357,20 @@ MultiTaskTrackerExecute(Job *job)
 			}
 		}
 
-		/* third, loop around task trackers and manage them */
+		/*
+		 * Third, loop around task trackers and manage them. We may wake up
+		 * early for transmitted data; task trackers are still only polled
+		 * once per check interval, to not flood them with status queries.
+		 */
+		currentTime = GetCurrentTimestamp();
+		checkTaskTrackers = TimestampDifferenceExceeds(lastTrackerCheckTime,
+													   currentTime,
+													   RemoteTaskCheckInterval);
+		if (checkTaskTrackers)
+		{
+			lastTrackerCheckTime = currentTime;
+		}
+
 		hash_seq_init(&taskStatus, taskTrackerHash);
 		hash_seq_init(&transmitStatus, transmitTrackerHash);
 
@@ -358,15 +383,23 @@ MultiTaskTrackerExecute(Job *job)
 				healthyTrackerCount++;
 			}
 
-			ManageTaskTracker(taskTracker);
+			if (checkTaskTrackers)
+			{
+				ManageTaskTracker(taskTracker);
+			}
 
 			taskTracker = (TaskTracker *) hash_seq_search(&taskStatus);
 		}
 
+		MultiClientResetWaitInfo(waitInfo);
+
 		transmitTracker = (TaskTracker *) hash_seq_search(&transmitStatus);
 		while (transmitTracker != NULL)
 		{
+			int32 previousConnectionId = transmitTracker->connectionId;
+
 			ManageTransmitTracker(transmitTracker);
+			TrackerRegisterWait(waitInfo, transmitTracker, previousConnectionId);
 
 			transmitTracker = (TaskTracker *) hash_seq_search(&transmitStatus);
 		}
@@ -385,11 +418,12 @@ MultiTaskTrackerExecute(Job *job)
 		}
 		else
 		{
-			long sleepIntervalPerCycle = RemoteTaskCheckInterval * 1000L;
-			pg_usleep(sleepIntervalPerCycle);
+			MultiClientWaitWithTimeout(waitInfo, RemoteTaskCheckInterval);
 		}
 	}
 
+	MultiClientFreeWaitInfo(waitInfo);
+
 	/*
 	 * We prevent cancel/die interrupts until we issue cleanup requests to task
 	 * trackers and close open connections. Note that for the above while loop,
@@ -773,7 +807,7 @@ TrackerHashEnter(HTAB *taskTrackerHash, char *nodeName, uint32 nodePort)
 	memcpy(taskTracker, &taskTrackerKey, sizeof(TaskTracker));
 	taskTracker->trackerStatus = TRACKER_CONNECT_START;
 	taskTracker->connectionId = INVALID_CONNECTION_ID;
-	taskTracker->currentTaskIndex = -1;
+	taskTracker->statusVersion = 0;
 
 	return taskTracker;
 }
@@ -862,6 +896,9 @@ TrackerConnectPoll(TaskTracker *taskTracker)
 			if (pollStatus == CLIENT_CONNECTION_READY)
 			{
 				taskTracker->trackerStatus = TRACKER_CONNECTED;
+
+				/* the task tracker may have restarted, so ask for all statuses */
+				taskTracker->statusVersion = 0;
 			}
 			else if (pollStatus == CLIENT_CONNECTION_BUSY ||
 					 pollStatus == CLIENT_CONNECTION_BUSY_READ ||
@@ -2144,8 +2181,9 @@ ShardFetchTaskList(List *taskList)
  * ManageTaskTracker manages tasks assigned to the given task tracker. For this,
  * the function coordinates access to the underlying connection. The function
  * also: (1) synchronously assigns locally queued tasks to the task tracker, (2)
- * issues an asynchronous task status query for one assigned task at a time, and
- * (3) retrieves status query results for the previously issued status query.
+ * issues an asynchronous query for the statuses of all assigned tasks that
+ * changed since the last such query, and (3) retrieves the results of the
+ * previously issued status query.
  */
 static void
 ManageTaskTracker(TaskTracker *taskTracker)
@@ -2179,45 +2217,25 @@ ManageTaskTracker(TaskTracker *taskTracker)
 	}
 
 	/*
-	 * (2) We find an assigned task. We then send an asynchronous query to check
-	 * task's status.
+	 * (2) If we have running tasks, we send an asynchronous query to check the
+	 * statuses of all of them at once.
 	 */
 	if (!taskTracker->connectionBusy)
 	{
-		List *assignedTaskList = taskTracker->assignedTaskList;
-		int32 currentTaskIndex = taskTracker->currentTaskIndex;
-		int32 nextTaskIndex = -1;
-
-		nextTaskIndex = NextRunningTaskIndex(assignedTaskList, currentTaskIndex);
-		taskTracker->currentTaskIndex = nextTaskIndex;
-
-		/* if we have a running task's index, check task's status */
-		if (nextTaskIndex != -1)
+		StringInfo taskStatusQuery = TaskStatusChangesQuery(taskTracker);
+		if (taskStatusQuery != NULL)
 		{
 			int32 connectionId = taskTracker->connectionId;
-			TrackerTaskState *taskState = NULL;
-			StringInfo taskStatusQuery = NULL;
-			bool querySent = false;
-
-			taskState = (TrackerTaskState *) list_nth(assignedTaskList, nextTaskIndex);
-			Assert(taskState != NULL);
 
-			taskStatusQuery = makeStringInfo();
-			appendStringInfo(taskStatusQuery, TASK_STATUS_QUERY,
-							 taskState->jobId, taskState->taskId);
-
-			querySent = MultiClientSendQuery(connectionId, taskStatusQuery->data);
+			bool querySent = MultiClientSendQuery(connectionId, taskStatusQuery->data);
 			if (querySent)
 			{
 				taskTracker->connectionBusy = true;
-				taskTracker->connectionBusyOnTask = taskState;
+				taskTracker->connectionBusyOnTask = NULL;
 			}
 			else
 			{
-				taskState->status = TASK_CLIENT_SIDE_STATUS_FAILED;
-
-				taskTracker->connectionBusy = false;
-				taskTracker->connectionBusyOnTask = NULL;
+				RecordTaskStatusQueryFailure(taskTracker);
 			}
 		}
 	}
@@ -2229,18 +2247,16 @@ ManageTaskTracker(TaskTracker *taskTracker)
 	{
 		int32 connectionId = taskTracker->connectionId;
 		ResultStatus resultStatus = CLIENT_INVALID_RESULT_STATUS;
-		TrackerTaskState *taskState = taskTracker->connectionBusyOnTask;
-		Assert(taskState != NULL);
 
-		/* if connection is available, update task status accordingly */
+		/* if connection is available, update task statuses accordingly */
 		resultStatus = MultiClientResultStatus(connectionId);
 		if (resultStatus == CLIENT_RESULT_READY)
 		{
-			taskState->status = TaskStatusQueryResponse(connectionId);
+			TaskStatusChangesQueryResponse(taskTracker);
 		}
 		else if (resultStatus == CLIENT_RESULT_UNAVAILABLE)
 		{
-			taskState->status = TASK_CLIENT_SIDE_STATUS_FAILED;
+			RecordTaskStatusQueryFailure(taskTracker);
 		}
 
 		/* if connection is available, give it back to the task tracker */
@@ -2313,6 +2329,38 @@ TrackerReconnectPoll(TaskTracker *taskTracker)
 }
 
 
+/*
+ * TrackerRegisterWait updates the wait registered for the given tracker's
+ * connection after the tracker has been managed. We only wait on connections
+ * with an ongoing request, and forget about connections the tracker closed.
+ */
+static void
+TrackerRegisterWait(WaitInfo *waitInfo, TaskTracker *taskTracker,
+					int32 previousConnectionId)
+{
+	int32 connectionId = taskTracker->connectionId;
+
+	if (previousConnectionId != connectionId)
+	{
+		MultiClientUnregisterWait(waitInfo, previousConnectionId);
+	}
+
+	if (connectionId == INVALID_CONNECTION_ID)
+	{
+		return;
+	}
+
+	if (taskTracker->trackerStatus == TRACKER_CONNECTED && taskTracker->connectionBusy)
+	{
+		MultiClientRegisterWait(waitInfo, TASK_STATUS_SOCKET_READ, connectionId);
+	}
+	else
+	{
+		MultiClientUnregisterWait(waitInfo, connectionId);
+	}
+}
+
+
 /*
  * AssignQueuedTasks walks over the given task tracker's task state hash, finds
  * queued tasks in this hash, and synchronously assigns them to the given task
@@ -2406,112 +2454,234 @@ AssignQueuedTasks(TaskTracker *taskTracker)
 
 
 /*
- * NextRunningTaskIndex walks over the tasks in the given list, and looks for a
- * task that was still running as of the last time we checked. If such a task
- * exists (before wrapping around the assigned task list), the function returns
- * that task's index in the list. Else, the function returns -1 to signal either
- * no such task exists or that the function may be called again to search from
- * the beginning of the task list.
+ * TrackerTaskRunning checks if the given task was still running on the task
+ * tracker as of the last time we checked. Note that the task tracker retries
+ * tasks that only failed once (task_failed).
  */
-static int32
-NextRunningTaskIndex(List *assignedTaskList, int32 currentTaskIndex)
+static bool
+TrackerTaskRunning(TrackerTaskState *taskState)
 {
-	int32 nextTaskIndex = -1;
-	int32 lastTaskIndex = -1;
-	int32 assignedTaskIndex = 0;
-	ListCell *assignedTaskCell = NULL;
+	TaskStatus taskStatus = taskState->status;
 
-	int32 assignedTaskCount = list_length(assignedTaskList);
-	if (assignedTaskCount == 0)
+	bool taskRunning = false;
+	if (taskStatus == TASK_ASSIGNED || taskStatus == TASK_SCHEDULED ||
+		taskStatus == TASK_RUNNING || taskStatus == TASK_FAILED)
 	{
-		return -1;
+		taskRunning = true;
 	}
 
-	lastTaskIndex = (assignedTaskCount - 1);
-	if (currentTaskIndex >= lastTaskIndex)
-	{
-		currentTaskIndex = -1;
-	}
+	return taskRunning;
+}
+
 
-	assignedTaskCell = NULL;
-	foreach(assignedTaskCell, assignedTaskList)
+/*
+ * TaskStatusChangesQuery builds the query that asks the given task tracker for
+ * the statuses of its tasks that changed since the last time we asked. The
+ * query covers all jobs that have running tasks on the task tracker. If there
+ * are no running tasks, the function returns NULL.
+ */
+static StringInfo
+TaskStatusChangesQuery(TaskTracker *taskTracker)
+{
+	StringInfo taskStatusQuery = NULL;
+	StringInfo jobIdArrayString = makeStringInfo();
+	List *jobTaskList = NIL;
+	ListCell *assignedTaskCell = NULL;
+
+	foreach(assignedTaskCell, taskTracker->assignedTaskList)
 	{
 		TrackerTaskState *assignedTask = (TrackerTaskState *) lfirst(assignedTaskCell);
-		TaskStatus taskStatus = assignedTask->status;
+		bool jobIncluded = false;
+		ListCell *jobTaskCell = NULL;
 
-		/* task tracker retries tasks that only failed once (task_failed) */
-		bool taskRunning = false;
-		if (taskStatus == TASK_ASSIGNED || taskStatus == TASK_SCHEDULED ||
-			taskStatus == TASK_RUNNING || taskStatus == TASK_FAILED)
+		if (!TrackerTaskRunning(assignedTask))
 		{
-			taskRunning = true;
+			continue;
 		}
 
-		if (taskRunning && (assignedTaskIndex > currentTaskIndex))
+		/* we only need to include each job once */
+		foreach(jobTaskCell, jobTaskList)
 		{
-			nextTaskIndex = assignedTaskIndex;
-			break;
+			TrackerTaskState *jobTask = (TrackerTaskState *) lfirst(jobTaskCell);
+			if (jobTask->jobId == assignedTask->jobId)
+			{
+				jobIncluded = true;
+				break;
+			}
+		}
+
+		if (jobIncluded)
+		{
+			continue;
 		}
 
-		assignedTaskIndex++;
+		if (jobTaskList != NIL)
+		{
+			appendStringInfoChar(jobIdArrayString, ',');
+		}
+
+		appendStringInfo(jobIdArrayString, UINT64_FORMAT, assignedTask->jobId);
+		jobTaskList = lappend(jobTaskList, assignedTask);
 	}
 
-	/*
-	 * We might have wrapped around the assigned task list and found nothing. If
-	 * that's the case, we'll start looking from the beginning next time.
-	 */
-	return nextTaskIndex;
+	if (jobTaskList == NIL)
+	{
+		return NULL;
+	}
+
+	taskStatusQuery = makeStringInfo();
+	appendStringInfo(taskStatusQuery, TASK_STATUS_CHANGES_QUERY,
+					 jobIdArrayString->data, taskTracker->statusVersion);
+
+	list_free(jobTaskList);
+
+	return taskStatusQuery;
 }
 
 
 /*
- * TaskStatusQueryResponse assumes that a task status query has been previously
- * sent on the given connection, and reads the response for this status query.
+ * TaskStatusChangesQueryResponse assumes that a task status changes query has
+ * been previously sent on the given task tracker's connection, and reads the
+ * response for this query. The function then updates the statuses of the
+ * running tasks that changed, and remembers the highest status version seen.
  */
-static TaskStatus
-TaskStatusQueryResponse(int32 connectionId)
+static void
+TaskStatusChangesQueryResponse(TaskTracker *taskTracker)
 {
-	TaskStatus taskStatus = TASK_STATUS_INVALID_FIRST;
+	int32 connectionId = taskTracker->connectionId;
 	void *queryResult = NULL;
 	int rowCount = 0;
 	int columnCount = 0;
+	int rowIndex = 0;
+	bool allStatusesQueried = (taskTracker->statusVersion == 0);
+	int32 runningTaskCount = 0;
+	List *updatedTaskList = NIL;
+	ListCell *assignedTaskCell = NULL;
 
 	bool resultReceived = MultiClientQueryResult(connectionId, &queryResult,
 												 &rowCount, &columnCount);
-	if (resultReceived)
+	if (!resultReceived)
 	{
-		char *valueString = MultiClientGetValue(queryResult, 0, 0);
-		if (valueString == NULL || (*valueString) == '\0')
+		RecordTaskStatusQueryFailure(taskTracker);
+		MultiClientClearResult(queryResult);
+		return;
+	}
+
+	if (allStatusesQueried)
+	{
+		foreach(assignedTaskCell, taskTracker->assignedTaskList)
 		{
-			taskStatus = TASK_PERMANENTLY_FAILED;
+			TrackerTaskState *assignedTask = (TrackerTaskState *) lfirst(assignedTaskCell);
+			if (TrackerTaskRunning(assignedTask))
+			{
+				runningTaskCount++;
+			}
 		}
-		else
+	}
+
+	for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		char *jobIdString = MultiClientGetValue(queryResult, rowIndex, 0);
+		char *taskIdString = MultiClientGetValue(queryResult, rowIndex, 1);
+		char *taskStatusString = MultiClientGetValue(queryResult, rowIndex, 2);
+		char *statusVersionString = MultiClientGetValue(queryResult, rowIndex, 3);
+		uint64 statusVersion = strtoull(statusVersionString, NULL, 10);
+		TrackerTaskState *taskState = NULL;
+		TrackerTaskState taskStateKey;
+
+		taskStateKey.jobId = strtoull(jobIdString, NULL, 10);
+		taskStateKey.taskId = strtoul(taskIdString, NULL, 10);
+
+		taskState = (TrackerTaskState *) hash_search(taskTracker->taskStateHash,
+													 (void *) &taskStateKey,
+													 HASH_FIND, NULL);
+
+		/* we only care about tasks we still consider running */
+		if (taskState != NULL && TrackerTaskRunning(taskState))
+		{
+			taskState->status = ParseTaskStatus(taskStatusString);
+			updatedTaskList = lappend(updatedTaskList, taskState);
+		}
+
+		if (statusVersion > taskTracker->statusVersion)
 		{
-			char *valueStringEnd = NULL;
-			errno = 0;
+			taskTracker->statusVersion = statusVersion;
+		}
+	}
 
-			taskStatus = strtoul(valueString, &valueStringEnd, 0);
-			if (errno != 0 || (*valueStringEnd) != '\0')
+	MultiClientClearResult(queryResult);
+
+	/*
+	 * When we asked for all statuses, the task tracker reported every task it
+	 * knows about. If a task we assigned is missing, the task tracker lost it,
+	 * and we handle this like a failed status query for that task.
+	 */
+	if (allStatusesQueried && list_length(updatedTaskList) < runningTaskCount)
+	{
+		foreach(assignedTaskCell, taskTracker->assignedTaskList)
+		{
+			TrackerTaskState *assignedTask = (TrackerTaskState *) lfirst(assignedTaskCell);
+			if (TrackerTaskRunning(assignedTask) &&
+				!list_member_ptr(updatedTaskList, assignedTask))
 			{
-				/* we couldn't parse received integer */
-				taskStatus = TASK_PERMANENTLY_FAILED;
+				assignedTask->status = TASK_CLIENT_SIDE_STATUS_FAILED;
 			}
-
-			Assert(taskStatus > TASK_STATUS_INVALID_FIRST);
-			Assert(taskStatus < TASK_STATUS_LAST);
 		}
 	}
-	else
+
+	list_free(updatedTaskList);
+}
+
+
+/*
+ * ParseTaskStatus parses a task status received from the task tracker. If the
+ * status cannot be parsed, the function considers the task permanently failed.
+ */
+static TaskStatus
+ParseTaskStatus(char *valueString)
+{
+	TaskStatus taskStatus = TASK_STATUS_INVALID_FIRST;
+	char *valueStringEnd = NULL;
+
+	if (valueString == NULL || (*valueString) == '\0')
 	{
-		taskStatus = TASK_CLIENT_SIDE_STATUS_FAILED;
+		return TASK_PERMANENTLY_FAILED;
 	}
 
-	MultiClientClearResult(queryResult);
+	errno = 0;
+
+	taskStatus = strtoul(valueString, &valueStringEnd, 0);
+	if (errno != 0 || (*valueStringEnd) != '\0')
+	{
+		/* we couldn't parse received integer */
+		taskStatus = TASK_PERMANENTLY_FAILED;
+	}
+
+	Assert(taskStatus > TASK_STATUS_INVALID_FIRST);
+	Assert(taskStatus < TASK_STATUS_LAST);
 
 	return taskStatus;
 }
 
 
+/*
+ * RecordTaskStatusQueryFailure counts a failed task status query as a single
+ * failure of the given task tracker, however many running tasks the query
+ * covered. The tasks keep their statuses, and since the status version didn't
+ * advance, the next query asks for the same changes again. If the connection
+ * was lost, reconnecting counts the failure instead.
+ */
+static void
+RecordTaskStatusQueryFailure(TaskTracker *taskTracker)
+{
+	bool trackerConnectionUp = TrackerConnectionUp(taskTracker);
+	if (trackerConnectionUp)
+	{
+		taskTracker->trackerFailureCount++;
+	}
+}
+
+
 /*
  * ManageTransmitTracker manages access to the connection we opened to the worker
  * node. If the connection is idle, and we have file transmit requests pending,
@@ -27,11 +27,13 @@
 #include "catalog/namespace.h"
 #include "catalog/pg_attribute.h"
 #include "catalog/pg_class.h"
+#include "commands/dbcommands.h"
 #include "commands/defrem.h"
 #include "commands/tablecmds.h"
 #include "commands/prepare.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/colocation_utils.h"
+#include "distributed/maintenanced.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
@@ -188,6 +190,25 @@ multi_ProcessUtility(Node *parsetree,
 		return;
 	}
 
+	/*
+	 * A database cannot be dropped while the maintenance daemon is connected
+	 * to it, so stop the daemon first. This is done regardless of whether the
+	 * current database uses Citus, but only if the user may drop the database,
+	 * so that failed attempts don't interrupt the daemon's work.
+	 */
+	if (IsA(parsetree, DropdbStmt))
+	{
+		DropdbStmt *dropDbStatement = (DropdbStmt *) parsetree;
+		bool missingOK = true;
+		Oid databaseOid = get_database_oid(dropDbStatement->dbname, missingOK);
+
+		if (OidIsValid(databaseOid) && databaseOid != MyDatabaseId &&
+			pg_database_ownercheck(databaseOid, GetUserId()))
+		{
+			StopMaintenanceDaemon(databaseOid);
+		}
+	}
+
 	if (!CitusHasBeenLoaded())
 	{
 		/*
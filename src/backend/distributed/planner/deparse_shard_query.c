@@ -26,11 +26,43 @@
 #include "nodes/parsenodes.h"
 #include "nodes/pg_list.h"
 #include "storage/lock.h"
+#include "utils/hsearch.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 
 
+/*
+ * DeparsedQueryCacheEntry keeps the task query strings that were rebuilt for
+ * a plan, along with the master evaluated query they were deparsed from. A
+ * later execution of the plan whose query evaluates to the same query tree
+ * reuses these strings instead of deparsing the query again.
+ */
+typedef struct DeparsedQueryCacheEntry
+{
+	uint64 planId; /* hash key, must be first */
+	MemoryContext entryContext;
+	Query *evaluatedQuery;
+	int taskCount;
+	uint64 *anchorShardIdArray;
+	char **queryStringArray;
+	int missCount;
+	int uncachedCount;
+} DeparsedQueryCacheEntry;
+
+
+/* cache of rebuilt query strings, keyed by the plan they belong to */
+static HTAB *DeparsedQueryCache = NULL;
+static MemoryContext DeparsedQueryCacheContext = NULL;
+static bool DeparsedQueryCacheValid = false;
+
+
 static void ConvertRteToSubqueryWithEmptyResult(RangeTblEntry *rte);
+static void InitializeDeparsedQueryCache(void);
+static bool DeparsedQueryCacheEntryMatches(DeparsedQueryCacheEntry *cacheEntry,
+										   Query *evaluatedQuery, List *taskList);
+static void StoreDeparsedQueryCacheEntry(DeparsedQueryCacheEntry *cacheEntry,
+										 Query *evaluatedQuery, List *taskList);
 
 
 /*
@@ -76,6 +108,11 @@ RebuildQueryStrings(Query *originalQuery, List *taskList)
 
 			UpdateRelationToShardNames((Node *) copiedSubquery, relationShardList);
 		}
+		else if (task->valuesRowIndexList != NIL)
+		{
+			/* for multi-row INSERTs, only keep the rows going to this shard */
+			query = InsertValuesSubsetQuery(originalQuery, task->valuesRowIndexList);
+		}
 
 		deparse_shard_query(query, relationId, task->anchorShardId,
 							newQueryString);
@@ -90,6 +127,197 @@ RebuildQueryStrings(Query *originalQuery, List *taskList)
 }
 
 
+/*
+ * RebuildQueryStringsCached rebuilds the query strings of the given tasks like
+ * RebuildQueryStrings, but reuses the query strings of a previous execution of
+ * the same plan if the master evaluated query didn't change since. Functions
+ * such as current_date evaluate to the same value for many executions, which
+ * then only pay for comparing query trees instead of deparsing them. Plans
+ * whose query changes on every execution are no longer cached after a few
+ * executions, until caching them is tried again after a while.
+ */
+void
+RebuildQueryStringsCached(uint64 planId, Query *originalQuery, List *taskList)
+{
+	DeparsedQueryCacheEntry *cacheEntry = NULL;
+	ListCell *taskCell = NULL;
+	int taskIndex = 0;
+	bool found = false;
+
+	InitializeDeparsedQueryCache();
+
+	cacheEntry = hash_search(DeparsedQueryCache, &planId, HASH_ENTER, &found);
+	if (!found)
+	{
+		cacheEntry->entryContext = AllocSetContextCreate(DeparsedQueryCacheContext,
+														 "Deparsed Query Cache Entry",
+														 ALLOCSET_SMALL_MINSIZE,
+														 ALLOCSET_SMALL_INITSIZE,
+														 ALLOCSET_SMALL_MAXSIZE);
+		cacheEntry->evaluatedQuery = NULL;
+		cacheEntry->missCount = 0;
+		cacheEntry->uncachedCount = 0;
+	}
+
+	if (cacheEntry->missCount >= MAX_DEPARSED_QUERY_CACHE_MISSES)
+	{
+		RebuildQueryStrings(originalQuery, taskList);
+
+		/* the query may have stopped changing, e.g. once a parameter settled */
+		cacheEntry->uncachedCount++;
+		if (cacheEntry->uncachedCount >= DEPARSED_QUERY_CACHE_RETRY_INTERVAL)
+		{
+			cacheEntry->missCount = 0;
+			cacheEntry->uncachedCount = 0;
+		}
+
+		return;
+	}
+
+	if (DeparsedQueryCacheEntryMatches(cacheEntry, originalQuery, taskList))
+	{
+		foreach(taskCell, taskList)
+		{
+			Task *task = (Task *) lfirst(taskCell);
+
+			task->queryString = pstrdup(cacheEntry->queryStringArray[taskIndex]);
+			taskIndex++;
+		}
+
+		cacheEntry->missCount = 0;
+		return;
+	}
+
+	RebuildQueryStrings(originalQuery, taskList);
+	StoreDeparsedQueryCacheEntry(cacheEntry, originalQuery, taskList);
+}
+
+
+/*
+ * InvalidateDeparsedQueryCache makes sure that no cached query strings are
+ * used anymore. This is called whenever the metadata of a distributed table
+ * changes, as the query strings contain shard and relation names.
+ */
+void
+InvalidateDeparsedQueryCache(void)
+{
+	DeparsedQueryCacheValid = false;
+}
+
+
+/*
+ * InitializeDeparsedQueryCache creates the deparsed query cache, or recreates
+ * it if it was invalidated or grew too large.
+ */
+static void
+InitializeDeparsedQueryCache(void)
+{
+	HASHCTL info;
+	int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	if (DeparsedQueryCache != NULL && DeparsedQueryCacheValid &&
+		hash_get_num_entries(DeparsedQueryCache) < MAX_DEPARSED_QUERY_CACHE_ENTRIES)
+	{
+		return;
+	}
+
+	if (DeparsedQueryCacheContext != NULL)
+	{
+		MemoryContextDelete(DeparsedQueryCacheContext);
+	}
+
+	DeparsedQueryCacheContext = AllocSetContextCreate(CacheMemoryContext,
+													  "Deparsed Query Cache",
+													  ALLOCSET_DEFAULT_MINSIZE,
+													  ALLOCSET_DEFAULT_INITSIZE,
+													  ALLOCSET_DEFAULT_MAXSIZE);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(uint64);
+	info.entrysize = sizeof(DeparsedQueryCacheEntry);
+	info.hcxt = DeparsedQueryCacheContext;
+
+	DeparsedQueryCache = hash_create("Deparsed Query Cache", 64, &info, hashFlags);
+	DeparsedQueryCacheValid = true;
+}
+
+
+/*
+ * DeparsedQueryCacheEntryMatches returns whether the query strings stored in
+ * the given cache entry were deparsed from the given query for tasks on the
+ * same shards as the given tasks. Otherwise, the function counts a miss.
+ */
+static bool
+DeparsedQueryCacheEntryMatches(DeparsedQueryCacheEntry *cacheEntry,
+							   Query *evaluatedQuery, List *taskList)
+{
+	ListCell *taskCell = NULL;
+	int taskIndex = 0;
+
+	if (cacheEntry->evaluatedQuery == NULL ||
+		cacheEntry->taskCount != list_length(taskList))
+	{
+		cacheEntry->missCount++;
+		return false;
+	}
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		if (cacheEntry->anchorShardIdArray[taskIndex] != task->anchorShardId)
+		{
+			cacheEntry->missCount++;
+			return false;
+		}
+
+		taskIndex++;
+	}
+
+	if (!equal(cacheEntry->evaluatedQuery, evaluatedQuery))
+	{
+		cacheEntry->missCount++;
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * StoreDeparsedQueryCacheEntry replaces the contents of the given cache entry
+ * with a copy of the given query and of the query strings of the given tasks.
+ */
+static void
+StoreDeparsedQueryCacheEntry(DeparsedQueryCacheEntry *cacheEntry,
+							 Query *evaluatedQuery, List *taskList)
+{
+	MemoryContext oldContext = NULL;
+	ListCell *taskCell = NULL;
+	int taskCount = list_length(taskList);
+	int taskIndex = 0;
+
+	MemoryContextReset(cacheEntry->entryContext);
+	oldContext = MemoryContextSwitchTo(cacheEntry->entryContext);
+
+	cacheEntry->evaluatedQuery = copyObject(evaluatedQuery);
+	cacheEntry->taskCount = taskCount;
+	cacheEntry->anchorShardIdArray = palloc0(taskCount * sizeof(uint64));
+	cacheEntry->queryStringArray = palloc0(taskCount * sizeof(char *));
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		cacheEntry->anchorShardIdArray[taskIndex] = task->anchorShardId;
+		cacheEntry->queryStringArray[taskIndex] = pstrdup(task->queryString);
+		taskIndex++;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
 /*
  * UpdateRelationToShardNames walks over the query tree and appends shard ids to
  * relations. It uses unique identity value to establish connection between a
@@ -27,11 +27,39 @@
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/planner.h"
+#include "utils/catcache.h"
+#include "utils/hsearch.h"
 #include "utils/memutils.h"
 
 
+/*
+ * MultiPlanCacheEntry keeps the deserialized form of a distributed plan that
+ * this backend has executed more than once. Plans are identified by the plan
+ * id which FinalizePlan stores next to the serialized plan. Each entry owns a
+ * memory context, so that it can be evicted on its own once one of the
+ * relations it reads from is invalidated.
+ */
+typedef struct MultiPlanCacheEntry
+{
+	uint64 planId; /* hash key, must be first */
+	MultiPlan *multiPlan;
+	bool shareable;
+	bool isValid;
+	List *relationIdList;
+	MemoryContext planContext;
+} MultiPlanCacheEntry;
+
+
 static List *relationRestrictionContextList = NIL;
 
+/* identifier assigned to the next distributed plan built by this backend */
+static uint64 NextMultiPlanId = 1;
+
+/* deserialized distributed plans, kept until their relations are invalidated */
+static HTAB *MultiPlanCache = NULL;
+static MemoryContext MultiPlanCacheContext = NULL;
+static bool MultiPlanCacheHasInvalidEntries = false;
+
 /* create custom scan methods for separate executors */
 static CustomScanMethods RealTimeCustomScanMethods = {
 	"Citus Real-Time",
@@ -60,6 +88,13 @@ static PlannedStmt * CreateDistributedPlan(PlannedStmt *localPlan, Query *origin
 										   RelationRestrictionContext *restrictionContext);
 static Node * SerializeMultiPlan(struct MultiPlan *multiPlan);
 static MultiPlan * DeserializeMultiPlan(Node *node);
+static MultiPlan * GetCachedMultiPlan(Node *multiPlanData,
+									  MultiPlanCacheEntry *cacheEntry);
+static List * MultiPlanRelationIdList(MultiPlan *multiPlan);
+static void InitializeMultiPlanCache(void);
+static void RemoveMultiPlanCacheEntry(MultiPlanCacheEntry *cacheEntry);
+static bool MultiPlanShareable(CustomScan *customScan, MultiPlan *multiPlan);
+static PlannedStmt * FastPathRouterPlan(Query *parse, ParamListInfo boundParams);
 static PlannedStmt * FinalizePlan(PlannedStmt *localPlan, MultiPlan *multiPlan);
 static PlannedStmt * FinalizeNonRouterPlan(PlannedStmt *localPlan, MultiPlan *multiPlan,
 										   CustomScan *customScan);
@@ -84,6 +119,15 @@ multi_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	 * standard_planner scribbles on it's input, but for deparsing we need the
 	 * unmodified form. So copy once we're sure it's a distributed query.
 	 */
+	if (needsDistributedPlanning && EnableFastPathRouterPlanner)
+	{
+		result = FastPathRouterPlan(parse, boundParams);
+		if (result != NULL)
+		{
+			return result;
+		}
+	}
+
 	if (needsDistributedPlanning)
 	{
 		originalQuery = copyObject(parse);
@@ -311,22 +355,345 @@ CreateDistributedPlan(PlannedStmt *localPlan, Query *originalQuery, Query *query
 }
 
 
+/*
+ * FastPathRouterPlan plans simple single-shard statements without going
+ * through standard_planner() and the relation restriction hooks. It returns
+ * NULL if the query is not eligible, leaving the query untouched.
+ *
+ * Router plans only use the target list and the statement level fields of the
+ * local plan, so a minimal local plan is built from the query here.
+ */
+static PlannedStmt *
+FastPathRouterPlan(Query *parse, ParamListInfo boundParams)
+{
+	Query *originalQuery = copyObject(parse);
+	MultiPlan *distributedPlan = NULL;
+	PlannedStmt *localPlan = NULL;
+	Plan *localPlanTree = NULL;
+
+	distributedPlan = CreateFastPathRouterPlan(originalQuery, boundParams);
+	if (distributedPlan == NULL)
+	{
+		return NULL;
+	}
+
+	localPlanTree = (Plan *) makeNode(Result);
+	if (parse->commandType == CMD_SELECT)
+	{
+		localPlanTree->targetlist = parse->targetList;
+	}
+	else
+	{
+		localPlanTree->targetlist = parse->returningList;
+	}
+
+	localPlan = makeNode(PlannedStmt);
+	localPlan->commandType = parse->commandType;
+	localPlan->queryId = parse->queryId;
+	localPlan->hasReturning = (parse->returningList != NIL);
+	localPlan->canSetTag = parse->canSetTag;
+	localPlan->planTree = localPlanTree;
+
+	return FinalizePlan(localPlan, distributedPlan);
+}
+
+
 /*
  * GetMultiPlan returns the associated MultiPlan for a CustomScan.
+ *
+ * Deserializing the plan string is expensive for plans with many tasks, so
+ * plans which the executors do not modify in place are deserialized once into
+ * a backend-local cache the second time they are executed. Every other plan is
+ * deserialized on each call, which hands the executor a private copy.
  */
 MultiPlan *
 GetMultiPlan(CustomScan *customScan)
 {
 	MultiPlan *multiPlan = NULL;
+	Node *multiPlanData = NULL;
+	Const *planIdConst = NULL;
+	uint64 planId = 0;
+	MultiPlanCacheEntry *cacheEntry = NULL;
+	bool found = false;
+
+	Assert(list_length(customScan->custom_private) == 2);
+
+	multiPlanData = (Node *) linitial(customScan->custom_private);
+	planIdConst = (Const *) lsecond(customScan->custom_private);
+	Assert(IsA(planIdConst, Const));
 
-	Assert(list_length(customScan->custom_private) == 1);
+	planId = (uint64) DatumGetInt64(planIdConst->constvalue);
+
+	/* task-tracker and delayed error plans are always deserialized */
+	if (customScan->methods != &RealTimeCustomScanMethods &&
+		customScan->methods != &RouterCustomScanMethods)
+	{
+		return DeserializeMultiPlan(multiPlanData);
+	}
 
-	multiPlan = DeserializeMultiPlan(linitial(customScan->custom_private));
+	InitializeMultiPlanCache();
+
+	cacheEntry = hash_search(MultiPlanCache, &planId, HASH_FIND, NULL);
+	if (cacheEntry != NULL)
+	{
+		/* plans of invalidated relations are not reused until they are evicted */
+		if (!cacheEntry->isValid)
+		{
+			return DeserializeMultiPlan(multiPlanData);
+		}
+
+		if (cacheEntry->multiPlan != NULL)
+		{
+			return cacheEntry->multiPlan;
+		}
+
+		if (cacheEntry->shareable)
+		{
+			multiPlan = GetCachedMultiPlan(multiPlanData, cacheEntry);
+			cacheEntry->multiPlan = multiPlan;
+
+			return multiPlan;
+		}
+
+		return DeserializeMultiPlan(multiPlanData);
+	}
+
+	multiPlan = DeserializeMultiPlan(multiPlanData);
+
+	/*
+	 * Only remember the plan on its first execution; one-off queries then cost
+	 * a hash entry rather than a second copy of the plan. Once the cache is
+	 * full we stop adding entries until it is cleaned up at transaction end.
+	 */
+	if (hash_get_num_entries(MultiPlanCache) < MAX_CACHED_MULTI_PLANS)
+	{
+		MemoryContext planContext = NULL;
+		MemoryContext oldContext = NULL;
+
+		planContext = AllocSetContextCreate(MultiPlanCacheContext,
+											"Citus Cached Multi Plan",
+											ALLOCSET_SMALL_MINSIZE,
+											ALLOCSET_SMALL_INITSIZE,
+											ALLOCSET_DEFAULT_MAXSIZE);
+
+		cacheEntry = hash_search(MultiPlanCache, &planId, HASH_ENTER, &found);
+		cacheEntry->multiPlan = NULL;
+		cacheEntry->shareable = MultiPlanShareable(customScan, multiPlan);
+		cacheEntry->isValid = true;
+		cacheEntry->planContext = planContext;
+
+		oldContext = MemoryContextSwitchTo(planContext);
+		cacheEntry->relationIdList = MultiPlanRelationIdList(multiPlan);
+		MemoryContextSwitchTo(oldContext);
+	}
 
 	return multiPlan;
 }
 
 
+/*
+ * GetCachedMultiPlan deserializes the given plan into the memory context of
+ * its cache entry, so that it survives the end of the current execution.
+ */
+static MultiPlan *
+GetCachedMultiPlan(Node *multiPlanData, MultiPlanCacheEntry *cacheEntry)
+{
+	MultiPlan *multiPlan = NULL;
+	MemoryContext oldContext = MemoryContextSwitchTo(cacheEntry->planContext);
+
+	multiPlan = DeserializeMultiPlan(multiPlanData);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return multiPlan;
+}
+
+
+/*
+ * MultiPlanRelationIdList returns the ids of the relations the given plan reads
+ * from or writes to, which are the relations whose invalidation evicts the
+ * plan from the cache.
+ */
+static List *
+MultiPlanRelationIdList(MultiPlan *multiPlan)
+{
+	List *rangeTableList = NIL;
+	List *relationIdList = NIL;
+	ListCell *rangeTableCell = NULL;
+	Job *workerJob = multiPlan->workerJob;
+
+	if (workerJob == NULL || workerJob->jobQuery == NULL)
+	{
+		return NIL;
+	}
+
+	ExtractRangeTableRelationWalker((Node *) workerJob->jobQuery, &rangeTableList);
+
+	foreach(rangeTableCell, rangeTableList)
+	{
+		RangeTblEntry *rangeTableEntry = (RangeTblEntry *) lfirst(rangeTableCell);
+
+		relationIdList = list_append_unique_oid(relationIdList,
+												rangeTableEntry->relid);
+	}
+
+	return relationIdList;
+}
+
+
+/*
+ * MultiPlanShareable returns whether a deserialized plan may be handed to
+ * several executions. The router executor rewrites the job query and the task
+ * query strings of plans requiring master evaluation, so those need a fresh
+ * copy on every execution.
+ */
+static bool
+MultiPlanShareable(CustomScan *customScan, MultiPlan *multiPlan)
+{
+	if (customScan->methods == &RealTimeCustomScanMethods)
+	{
+		return true;
+	}
+
+	if (customScan->methods == &RouterCustomScanMethods)
+	{
+		Job *workerJob = multiPlan->workerJob;
+
+		return workerJob != NULL && !workerJob->requiresMasterEvaluation;
+	}
+
+	return false;
+}
+
+
+/*
+ * InitializeMultiPlanCache creates the backend-local plan cache and its memory
+ * context if they do not exist yet.
+ */
+static void
+InitializeMultiPlanCache(void)
+{
+	HASHCTL info;
+	int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	if (MultiPlanCache != NULL)
+	{
+		return;
+	}
+
+	if (CacheMemoryContext == NULL)
+	{
+		CreateCacheMemoryContext();
+	}
+
+	MultiPlanCacheContext = AllocSetContextCreate(CacheMemoryContext,
+												  "Citus Multi Plan Cache",
+												  ALLOCSET_DEFAULT_MINSIZE,
+												  ALLOCSET_DEFAULT_INITSIZE,
+												  ALLOCSET_DEFAULT_MAXSIZE);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(uint64);
+	info.entrysize = sizeof(MultiPlanCacheEntry);
+	info.hcxt = MultiPlanCacheContext;
+
+	MultiPlanCache = hash_create("Citus Multi Plan Cache", 32, &info, hashFlags);
+}
+
+
+/*
+ * InvalidateMultiPlanCache marks the cached plans which refer to the given
+ * relation, or all cached plans if relationId is InvalidOid, as invalid. This
+ * is called from a relcache invalidation callback while executions may still
+ * point into the cached plans, so the entries are only removed once the
+ * transaction ends.
+ */
+void
+InvalidateMultiPlanCache(Oid relationId)
+{
+	MultiPlanCacheEntry *cacheEntry = NULL;
+	HASH_SEQ_STATUS status;
+
+	if (MultiPlanCache == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, MultiPlanCache);
+
+	while ((cacheEntry = (MultiPlanCacheEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (relationId == InvalidOid ||
+			list_member_oid(cacheEntry->relationIdList, relationId))
+		{
+			cacheEntry->isValid = false;
+			MultiPlanCacheHasInvalidEntries = true;
+		}
+	}
+}
+
+
+/*
+ * CleanUpMultiPlanCache evicts the cached plans which were invalidated during
+ * the transaction, and drops all cached plans once the cache has reached its
+ * size limit. Executions may still point into cached plans while a
+ * transaction is running, which is why this is only called at transaction end.
+ */
+void
+CleanUpMultiPlanCache(void)
+{
+	MultiPlanCacheEntry *cacheEntry = NULL;
+	HASH_SEQ_STATUS status;
+
+	if (MultiPlanCache == NULL)
+	{
+		return;
+	}
+
+	if (hash_get_num_entries(MultiPlanCache) >= MAX_CACHED_MULTI_PLANS)
+	{
+		MemoryContextDelete(MultiPlanCacheContext);
+		MultiPlanCacheContext = NULL;
+		MultiPlanCache = NULL;
+		MultiPlanCacheHasInvalidEntries = false;
+
+		return;
+	}
+
+	if (!MultiPlanCacheHasInvalidEntries)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, MultiPlanCache);
+
+	while ((cacheEntry = (MultiPlanCacheEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (!cacheEntry->isValid)
+		{
+			RemoveMultiPlanCacheEntry(cacheEntry);
+		}
+	}
+
+	MultiPlanCacheHasInvalidEntries = false;
+}
+
+
+/*
+ * RemoveMultiPlanCacheEntry frees the plan kept in the given cache entry and
+ * removes the entry from the cache.
+ */
+static void
+RemoveMultiPlanCacheEntry(MultiPlanCacheEntry *cacheEntry)
+{
+	uint64 planId = cacheEntry->planId;
+
+	MemoryContextDelete(cacheEntry->planContext);
+
+	hash_search(MultiPlanCache, &planId, HASH_REMOVE, NULL);
+}
+
+
 /*
  * SerializeMultiPlan returns the string representing the distributed plan in a
  * Const node.
@@ -386,6 +753,7 @@ FinalizePlan(PlannedStmt *localPlan, MultiPlan *multiPlan)
 	PlannedStmt *finalPlan = NULL;
 	CustomScan *customScan = makeNode(CustomScan);
 	Node *multiPlanData = NULL;
+	Const *planIdConst = NULL;
 	MultiExecutorType executorType = MULTI_EXECUTOR_INVALID_FIRST;
 
 	if (!multiPlan->planningError)
@@ -422,7 +790,15 @@ FinalizePlan(PlannedStmt *localPlan, MultiPlan *multiPlan)
 
 	multiPlanData = SerializeMultiPlan(multiPlan);
 
-	customScan->custom_private = list_make1(multiPlanData);
+	/*
+	 * The plan id lets GetMultiPlan find the deserialized plan in its cache. It
+	 * is copied along with the plan, and copies share the same serialized plan.
+	 */
+	planIdConst = makeConst(INT8OID, -1, InvalidOid, sizeof(int64),
+							Int64GetDatum((int64) NextMultiPlanId++), false,
+							FLOAT8PASSBYVAL);
+
+	customScan->custom_private = list_make2(multiPlanData, planIdConst);
 	customScan->flags = CUSTOMPATH_SUPPORT_BACKWARD_SCAN;
 
 	/* check if we have a master query */
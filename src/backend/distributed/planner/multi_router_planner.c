@@ -55,6 +55,7 @@
 #include "parser/parse_oper.h"
 #include "storage/lock.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
 #include "utils/lsyscache.h"
@@ -73,12 +74,15 @@ typedef struct WalkerState
 } WalkerState;
 
 bool EnableRouterExecution = true;
+bool EnableFastPathRouterPlanner = false;
 
 /* planner functions forward declarations */
 static MultiPlan * CreateSingleTaskRouterPlan(Query *originalQuery,
 											  Query *query,
 											  RelationRestrictionContext *
 											  restrictionContext);
+static MultiPlan * CreateMultiRowInsertPlan(Query *originalQuery, Query *query);
+static void NormalizeMultiRowInsertTargetList(Query *query);
 static MultiPlan * CreateInsertSelectRouterPlan(Query *originalQuery,
 												RelationRestrictionContext *
 												restrictionContext);
@@ -94,6 +98,14 @@ static char MostPermissiveVolatileFlag(char left, char right);
 static bool TargetEntryChangesValue(TargetEntry *targetEntry, Var *column,
 									FromExpr *joinTree);
 static Task * RouterModifyTask(Query *originalQuery, Query *query);
+static Task * RouterModifyTaskForShard(Query *originalQuery,
+									   ShardInterval *shardInterval);
+static bool FastPathRouterQuery(Query *query);
+static Const * FastPathPartitionValue(Query *query, Var *partitionColumn,
+									  ParamListInfo boundParams);
+static Const * PartitionValueFromClause(Node *clause, Var *partitionColumn,
+										ParamListInfo boundParams);
+static Const * ResolveExternParam(Param *param, ParamListInfo boundParams);
 static ShardInterval * TargetShardIntervalForModify(Query *query);
 static List * QueryRestrictList(Query *query);
 static bool FastShardPruningPossible(CmdType commandType, char partitionMethod);
@@ -156,6 +168,336 @@ CreateRouterPlan(Query *originalQuery, Query *query,
 }
 
 
+/*
+ * CreateFastPathRouterPlan creates a router plan for simple single-table
+ * SELECT, UPDATE and DELETE statements directly from the parse tree, without
+ * calling standard_planner() and pruning shards on its restriction info. The
+ * statement must filter on equality of the distribution column with a constant
+ * or a bound parameter.
+ *
+ * The function returns NULL if the query does not qualify for the fast path,
+ * in which case the caller falls back to regular planning. The given query is
+ * only modified if a plan is returned.
+ */
+MultiPlan *
+CreateFastPathRouterPlan(Query *query, ParamListInfo boundParams)
+{
+	CmdType commandType = query->commandType;
+	RangeTblEntry *rangeTableEntry = NULL;
+	Oid distributedTableId = InvalidOid;
+	DistTableCacheEntry *cacheEntry = NULL;
+	Var *partitionColumn = NULL;
+	Const *partitionValue = NULL;
+	ShardInterval *shardInterval = NULL;
+	MultiPlan *multiPlan = NULL;
+	Task *task = NULL;
+	List *placementList = NIL;
+	uint32 rangeTableId = 1;
+
+	if (!FastPathRouterQuery(query))
+	{
+		return NULL;
+	}
+
+	rangeTableEntry = (RangeTblEntry *) linitial(query->rtable);
+	distributedTableId = rangeTableEntry->relid;
+	cacheEntry = DistributedTableCacheEntry(distributedTableId);
+
+	/*
+	 * Range and append distributed tables may have shards with uninitialized
+	 * or overlapping ranges, for which a single shard cannot be picked by a
+	 * binary search. Those are left to regular shard pruning.
+	 */
+	if (cacheEntry->partitionMethod != DISTRIBUTE_BY_HASH ||
+		cacheEntry->hasUninitializedShardInterval ||
+		cacheEntry->shardIntervalArrayLength == 0)
+	{
+		return NULL;
+	}
+
+	partitionColumn = PartitionColumn(distributedTableId, rangeTableId);
+	partitionValue = FastPathPartitionValue(query, partitionColumn, boundParams);
+	if (partitionValue == NULL)
+	{
+		return NULL;
+	}
+
+	shardInterval = FastShardPruning(distributedTableId, partitionValue->constvalue);
+	if (shardInterval == NULL)
+	{
+		return NULL;
+	}
+
+	if (commandType == CMD_SELECT)
+	{
+		RelationShard *relationShard = NULL;
+		StringInfo queryString = makeStringInfo();
+
+		placementList = FinalizedShardPlacementList(shardInterval->shardId);
+		if (placementList == NIL)
+		{
+			return NULL;
+		}
+
+		relationShard = CitusMakeNode(RelationShard);
+		relationShard->relationId = distributedTableId;
+		relationShard->shardId = shardInterval->shardId;
+
+		UpdateRelationToShardNames((Node *) query, list_make1(relationShard));
+		pg_get_query_def(query, queryString);
+
+		task = CitusMakeNode(Task);
+		task->jobId = INVALID_JOB_ID;
+		task->taskId = INVALID_TASK_ID;
+		task->taskType = ROUTER_TASK;
+		task->queryString = queryString->data;
+		task->anchorShardId = shardInterval->shardId;
+		task->replicationModel = REPLICATION_MODEL_INVALID;
+		task->dependedTaskList = NIL;
+		task->upsertQuery = false;
+		task->relationShardList = list_make1(relationShard);
+	}
+	else
+	{
+		/* leave unsupported modifications to the regular planner's errors */
+		if (ModifyQuerySupported(query) != NULL)
+		{
+			return NULL;
+		}
+
+		task = RouterModifyTaskForShard(query, shardInterval);
+	}
+
+	ereport(DEBUG2, (errmsg("Creating fast-path router plan")));
+
+	multiPlan = CitusMakeNode(MultiPlan);
+	multiPlan->operation = commandType;
+	multiPlan->workerJob = RouterQueryJob(query, task, placementList);
+	multiPlan->masterQuery = NULL;
+	multiPlan->routerExecutable = true;
+	multiPlan->hasReturning = (list_length(query->returningList) > 0);
+
+	return multiPlan;
+}
+
+
+/*
+ * FastPathRouterQuery returns whether the query has the shape handled by the
+ * fast-path router planner: a SELECT, UPDATE or DELETE on a single distributed
+ * relation, without subqueries, CTEs, set operations or row locks.
+ */
+static bool
+FastPathRouterQuery(Query *query)
+{
+	CmdType commandType = query->commandType;
+	RangeTblEntry *rangeTableEntry = NULL;
+	FromExpr *joinTree = query->jointree;
+
+	if (commandType == CMD_SELECT)
+	{
+		if (!EnableRouterExecution || query->hasForUpdate)
+		{
+			return false;
+		}
+	}
+	else if (commandType != CMD_UPDATE && commandType != CMD_DELETE)
+	{
+		return false;
+	}
+
+	if (query->hasSubLinks || query->cteList != NIL || query->setOperations != NULL ||
+		query->hasModifyingCTE || query->hasRowSecurity || query->utilityStmt != NULL)
+	{
+		return false;
+	}
+
+	if (list_length(query->rtable) != 1 || joinTree == NULL ||
+		list_length(joinTree->fromlist) != 1 || joinTree->quals == NULL)
+	{
+		return false;
+	}
+
+	if (!IsA(linitial(joinTree->fromlist), RangeTblRef))
+	{
+		return false;
+	}
+
+	rangeTableEntry = (RangeTblEntry *) linitial(query->rtable);
+	if (rangeTableEntry->rtekind != RTE_RELATION ||
+		rangeTableEntry->relkind != RELKIND_RELATION ||
+		!IsDistributedTable(rangeTableEntry->relid))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * FastPathPartitionValue returns the value the query's top-level WHERE clause
+ * requires the partition column to be equal to, or NULL if there is no such
+ * equality or its value is not known at planning time.
+ */
+static Const *
+FastPathPartitionValue(Query *query, Var *partitionColumn, ParamListInfo boundParams)
+{
+	Node *quals = query->jointree->quals;
+	ListCell *clauseCell = NULL;
+
+	if (IsA(quals, BoolExpr) && ((BoolExpr *) quals)->boolop == AND_EXPR)
+	{
+		foreach(clauseCell, ((BoolExpr *) quals)->args)
+		{
+			Node *clause = (Node *) lfirst(clauseCell);
+			Const *partitionValue = PartitionValueFromClause(clause, partitionColumn,
+															  boundParams);
+			if (partitionValue != NULL)
+			{
+				return partitionValue;
+			}
+		}
+
+		return NULL;
+	}
+
+	return PartitionValueFromClause(quals, partitionColumn, boundParams);
+}
+
+
+/*
+ * PartitionValueFromClause returns the value compared to the partition column
+ * if the clause is an equality of the form "column = value" or "value =
+ * column" using the default equality operator of the column's type. The value
+ * must be a non-null constant, an immutable expression over constants, or a
+ * bound external parameter.
+ */
+static Const *
+PartitionValueFromClause(Node *clause, Var *partitionColumn,
+						 ParamListInfo boundParams)
+{
+	OpExpr *operatorExpression = NULL;
+	Node *leftOperand = NULL;
+	Node *rightOperand = NULL;
+	Node *valueOperand = NULL;
+	Var *column = NULL;
+	Const *partitionValue = NULL;
+	TypeCacheEntry *typeEntry = NULL;
+
+	if (!IsA(clause, OpExpr) || list_length(((OpExpr *) clause)->args) != 2)
+	{
+		return NULL;
+	}
+
+	operatorExpression = (OpExpr *) clause;
+	leftOperand = (Node *) linitial(operatorExpression->args);
+	rightOperand = (Node *) lsecond(operatorExpression->args);
+
+	if (IsA(leftOperand, Var))
+	{
+		column = (Var *) leftOperand;
+		valueOperand = rightOperand;
+	}
+	else if (IsA(rightOperand, Var))
+	{
+		column = (Var *) rightOperand;
+		valueOperand = leftOperand;
+	}
+	else
+	{
+		return NULL;
+	}
+
+	if (column->varno != partitionColumn->varno ||
+		column->varattno != partitionColumn->varattno ||
+		column->varlevelsup != 0)
+	{
+		return NULL;
+	}
+
+	typeEntry = lookup_type_cache(partitionColumn->vartype, TYPECACHE_EQ_OPR);
+	if (operatorExpression->opno != typeEntry->eq_opr)
+	{
+		return NULL;
+	}
+
+	if (IsA(valueOperand, Const))
+	{
+		partitionValue = (Const *) valueOperand;
+	}
+	else if (IsA(valueOperand, Param))
+	{
+		partitionValue = ResolveExternParam((Param *) valueOperand, boundParams);
+	}
+	else
+	{
+		/* fold casts and other immutable expressions over constants */
+		Node *foldedOperand = eval_const_expressions(NULL, valueOperand);
+
+		if (IsA(foldedOperand, Const))
+		{
+			partitionValue = (Const *) foldedOperand;
+		}
+	}
+
+	if (partitionValue == NULL || partitionValue->constisnull ||
+		partitionValue->consttype != partitionColumn->vartype)
+	{
+		return NULL;
+	}
+
+	return partitionValue;
+}
+
+
+/*
+ * ResolveExternParam returns a Const holding the value bound to the given
+ * external parameter, or NULL if the value is not available. As in
+ * eval_const_expressions(), only values marked as constant are used, so that
+ * generic plans never embed a parameter value.
+ */
+static Const *
+ResolveExternParam(Param *param, ParamListInfo boundParams)
+{
+	ParamExternData *parameterData = NULL;
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	Datum parameterValue = 0;
+
+	if (param->paramkind != PARAM_EXTERN || boundParams == NULL ||
+		param->paramid <= 0 || param->paramid > boundParams->numParams)
+	{
+		return NULL;
+	}
+
+	parameterData = &boundParams->params[param->paramid - 1];
+
+	/* give hooks a chance in case parameter is dynamic */
+	if (!OidIsValid(parameterData->ptype) && boundParams->paramFetch != NULL)
+	{
+		(*boundParams->paramFetch)(boundParams, param->paramid);
+	}
+
+	if (!OidIsValid(parameterData->ptype) || parameterData->ptype != param->paramtype ||
+		!(parameterData->pflags & PARAM_FLAG_CONST))
+	{
+		return NULL;
+	}
+
+	get_typlenbyval(param->paramtype, &typeLength, &typeByValue);
+
+	parameterValue = parameterData->value;
+	if (!parameterData->isnull)
+	{
+		parameterValue = datumCopy(parameterValue, typeByValue, typeLength);
+	}
+
+	return makeConst(param->paramtype, param->paramtypmod, param->paramcollid,
+					 (int) typeLength, parameterValue, parameterData->isnull,
+					 typeByValue);
+}
+
+
 /*
  * CreateModifyPlan attempts to create a plan the given modification
  * statement.  If planning fails ->planningError is set to a description of
@@ -169,6 +511,10 @@ CreateModifyPlan(Query *originalQuery, Query *query,
 	{
 		return CreateInsertSelectRouterPlan(originalQuery, restrictionContext);
 	}
+	else if (ExtractInsertValuesRangeTableEntry(originalQuery) != NULL)
+	{
+		return CreateMultiRowInsertPlan(originalQuery, query);
+	}
 	else
 	{
 		return CreateSingleTaskRouterPlan(originalQuery, query,
@@ -248,6 +594,338 @@ CreateSingleTaskRouterPlan(Query *originalQuery, Query *query,
 }
 
 
+/*
+ * CreateMultiRowInsertPlan creates a router plan for an INSERT with a multi-row
+ * VALUES list. The rows are grouped by the shard their partition value falls
+ * into, and a modify task which inserts the rows of a group is created for
+ * each shard. The tasks remember the indexes of their rows, so that their
+ * query strings can be rebuilt after master evaluation of the VALUES list.
+ *
+ * Partition values are read from the planned query, in which constant
+ * expressions and bound parameters have already been folded into constants.
+ */
+static MultiPlan *
+CreateMultiRowInsertPlan(Query *originalQuery, Query *query)
+{
+	MultiPlan *multiPlan = CitusMakeNode(MultiPlan);
+	Oid distributedTableId = ExtractFirstDistributedTableId(originalQuery);
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(distributedTableId);
+	char partitionMethod = cacheEntry->partitionMethod;
+	uint32 rangeTableId = 1;
+	Var *partitionColumn = PartitionColumn(distributedTableId, rangeTableId);
+	RangeTblEntry *valuesRte = ExtractInsertValuesRangeTableEntry(query);
+	Index valuesRteIndex = 0;
+	Node *partitionValueExpr = NULL;
+	List *shardIntervalList = NIL;
+	List *rowIndexLists = NIL;
+	ListCell *valuesListCell = NULL;
+	ListCell *shardIntervalCell = NULL;
+	ListCell *rowIndexListCell = NULL;
+	List *taskList = NIL;
+	Job *job = NULL;
+	int rowIndex = 0;
+
+	multiPlan->operation = CMD_INSERT;
+
+	multiPlan->planningError = ModifyQuerySupported(query);
+	if (multiPlan->planningError)
+	{
+		return multiPlan;
+	}
+
+	NormalizeMultiRowInsertTargetList(originalQuery);
+
+	if (partitionMethod == DISTRIBUTE_BY_APPEND)
+	{
+		multiPlan->planningError =
+			DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
+						  "cannot perform distributed planning for the given "
+						  "modification",
+						  "Multi-row INSERTs to append-distributed tables are not "
+						  "supported.",
+						  NULL);
+		return multiPlan;
+	}
+
+	if (cacheEntry->shardIntervalArrayLength == 0)
+	{
+		char *relationName = get_rel_name(distributedTableId);
+
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("could not find any shards"),
+						errdetail("No shards exist for distributed table \"%s\".",
+								  relationName),
+						errhint("Run master_create_worker_shards to create shards "
+								"and try again.")));
+	}
+
+	/* find the expression providing the partition value of each row */
+	if (partitionColumn != NULL)
+	{
+		TargetEntry *targetEntry = get_tle_by_resno(query->targetList,
+													partitionColumn->varattno);
+		if (targetEntry != NULL)
+		{
+			partitionValueExpr = (Node *) targetEntry->expr;
+		}
+
+		valuesRteIndex = list_length(query->rtable);
+		while (valuesRteIndex > 0 && rt_fetch(valuesRteIndex, query->rtable) != valuesRte)
+		{
+			valuesRteIndex--;
+		}
+	}
+
+	foreach(valuesListCell, valuesRte->values_lists)
+	{
+		List *rowValues = (List *) lfirst(valuesListCell);
+		ShardInterval *shardInterval = NULL;
+		bool foundShard = false;
+
+		if (partitionColumn == NULL)
+		{
+			/* reference tables have a single shard */
+			shardInterval = cacheEntry->sortedShardIntervalArray[0];
+		}
+		else
+		{
+			Node *rowPartitionValue = partitionValueExpr;
+			Const *partitionValue = NULL;
+
+			if (rowPartitionValue != NULL && IsA(rowPartitionValue, Var) &&
+				((Var *) rowPartitionValue)->varno == valuesRteIndex)
+			{
+				AttrNumber valuesColumn = ((Var *) rowPartitionValue)->varattno;
+
+				rowPartitionValue = (Node *) list_nth(rowValues, valuesColumn - 1);
+			}
+
+			if (rowPartitionValue == NULL || !IsA(rowPartitionValue, Const))
+			{
+				multiPlan->planningError =
+					DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
+								  "values given for the partition column must be"
+								  " constants or constant expressions",
+								  NULL, NULL);
+				return multiPlan;
+			}
+
+			partitionValue = (Const *) rowPartitionValue;
+			if (partitionValue->constisnull)
+			{
+				ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+								errmsg("cannot plan INSERT using row with NULL value "
+									   "in partition column")));
+			}
+
+			shardInterval = FastShardPruning(distributedTableId,
+											 partitionValue->constvalue);
+			if (shardInterval == NULL)
+			{
+				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+								errmsg("cannot run INSERT command which targets no "
+									   "shards"),
+								errhint("Make sure you have created a shard which "
+										"can receive this partition column value.")));
+			}
+		}
+
+		/* add the row to the group of its shard */
+		forboth(shardIntervalCell, shardIntervalList, rowIndexListCell, rowIndexLists)
+		{
+			ShardInterval *groupShardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+
+			if (groupShardInterval->shardId == shardInterval->shardId)
+			{
+				lfirst(rowIndexListCell) = lappend_int((List *) lfirst(rowIndexListCell),
+													   rowIndex);
+				foundShard = true;
+				break;
+			}
+		}
+
+		if (!foundShard)
+		{
+			shardIntervalList = lappend(shardIntervalList, shardInterval);
+			rowIndexLists = lappend(rowIndexLists, list_make1_int(rowIndex));
+		}
+
+		rowIndex++;
+	}
+
+	/* setting an alias simplifies deparsing of UPSERTs */
+	if (originalQuery->onConflict != NULL)
+	{
+		RangeTblEntry *insertRte = (RangeTblEntry *) linitial(originalQuery->rtable);
+		if (insertRte->alias == NULL)
+		{
+			insertRte->alias = makeAlias(CITUS_TABLE_ALIAS, NIL);
+		}
+	}
+
+	forboth(shardIntervalCell, shardIntervalList, rowIndexListCell, rowIndexLists)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		List *rowIndexList = (List *) lfirst(rowIndexListCell);
+		Query *shardQuery = InsertValuesSubsetQuery(originalQuery, rowIndexList);
+		Task *modifyTask = RouterModifyTaskForShard(shardQuery, shardInterval);
+
+		modifyTask->taskId = list_length(taskList) + 1;
+		modifyTask->valuesRowIndexList = rowIndexList;
+
+		taskList = lappend(taskList, modifyTask);
+	}
+
+	ereport(DEBUG2, (errmsg("Creating router plan")));
+
+	job = CitusMakeNode(Job);
+	job->dependedJobList = NIL;
+	job->jobId = INVALID_JOB_ID;
+	job->subqueryPushdown = false;
+	job->jobQuery = originalQuery;
+	job->taskList = FirstReplicaAssignTaskList(taskList);
+	job->requiresMasterEvaluation = RequiresMasterEvaluation(originalQuery);
+
+	multiPlan->workerJob = job;
+	multiPlan->masterQuery = NULL;
+	multiPlan->routerExecutable = true;
+	multiPlan->hasReturning = (list_length(originalQuery->returningList) > 0);
+
+	return multiPlan;
+}
+
+
+/*
+ * NormalizeMultiRowInsertTargetList makes every entry in the target list of a
+ * multi-row INSERT a Var pointing into the VALUES list. The rewriter leaves
+ * defaults of columns missing from the column list in the target list, where
+ * they would be evaluated only once for all rows, and orders the target list
+ * by attribute number, which may differ from the order of the VALUES columns.
+ * The rows are rebuilt to follow the target list, with the default expression
+ * copied into each row, so that the rows can be deparsed and evaluated one by
+ * one.
+ */
+static void
+NormalizeMultiRowInsertTargetList(Query *query)
+{
+	RangeTblEntry *valuesRte = ExtractInsertValuesRangeTableEntry(query);
+	Index valuesRteIndex = 0;
+	ListCell *valuesListCell = NULL;
+	ListCell *targetEntryCell = NULL;
+	List *valuesCollations = NIL;
+	List *columnNames = NIL;
+	AttrNumber columnNumber = 0;
+
+	if (valuesRte == NULL)
+	{
+		return;
+	}
+
+	valuesRteIndex = list_length(query->rtable);
+	while (valuesRteIndex > 0 && rt_fetch(valuesRteIndex, query->rtable) != valuesRte)
+	{
+		valuesRteIndex--;
+	}
+
+	foreach(valuesListCell, valuesRte->values_lists)
+	{
+		List *rowValues = (List *) lfirst(valuesListCell);
+		List *expandedRowValues = NIL;
+
+		foreach(targetEntryCell, query->targetList)
+		{
+			TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+			Expr *targetExpr = targetEntry->expr;
+
+			if (IsA(targetExpr, Var) && ((Var *) targetExpr)->varno == valuesRteIndex)
+			{
+				AttrNumber valuesColumn = ((Var *) targetExpr)->varattno;
+
+				targetExpr = (Expr *) list_nth(rowValues, valuesColumn - 1);
+			}
+			else
+			{
+				/* rows are evaluated in place, so each needs its own copy */
+				targetExpr = (Expr *) copyObject(targetExpr);
+			}
+
+			expandedRowValues = lappend(expandedRowValues, targetExpr);
+		}
+
+		lfirst(valuesListCell) = expandedRowValues;
+	}
+
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Node *targetExpr = (Node *) targetEntry->expr;
+		Oid columnCollation = exprCollation(targetExpr);
+		StringInfo columnName = makeStringInfo();
+
+		columnNumber++;
+		appendStringInfo(columnName, "column%d", columnNumber);
+
+		targetEntry->expr = (Expr *) makeVar(valuesRteIndex, columnNumber,
+											 exprType(targetExpr),
+											 exprTypmod(targetExpr),
+											 columnCollation, 0);
+
+		valuesCollations = lappend_oid(valuesCollations, columnCollation);
+		columnNames = lappend(columnNames, makeString(columnName->data));
+	}
+
+	valuesRte->values_collations = valuesCollations;
+	valuesRte->eref->colnames = columnNames;
+}
+
+
+/*
+ * InsertValuesSubsetQuery returns a copy of the given multi-row INSERT query
+ * whose VALUES list only contains the rows at the given zero-based indexes.
+ * The rows themselves are not copied.
+ */
+Query *
+InsertValuesSubsetQuery(Query *query, List *rowIndexList)
+{
+	Query *subsetQuery = NULL;
+	RangeTblEntry *valuesRte = ExtractInsertValuesRangeTableEntry(query);
+	RangeTblEntry *subsetValuesRte = NULL;
+	List *valuesLists = valuesRte->values_lists;
+	List **rowArray = NULL;
+	List *subsetValuesLists = NIL;
+	ListCell *valuesListCell = NULL;
+	ListCell *rowIndexCell = NULL;
+	int rowCount = list_length(valuesLists);
+	int rowIndex = 0;
+
+	/* avoid copying all rows of the VALUES list */
+	valuesRte->values_lists = NIL;
+	subsetQuery = copyObject(query);
+	valuesRte->values_lists = valuesLists;
+
+	rowArray = (List **) palloc0(rowCount * sizeof(List *));
+	foreach(valuesListCell, valuesLists)
+	{
+		rowArray[rowIndex++] = (List *) lfirst(valuesListCell);
+	}
+
+	foreach(rowIndexCell, rowIndexList)
+	{
+		int subsetRowIndex = lfirst_int(rowIndexCell);
+
+		Assert(subsetRowIndex >= 0 && subsetRowIndex < rowCount);
+		subsetValuesLists = lappend(subsetValuesLists, rowArray[subsetRowIndex]);
+	}
+
+	subsetValuesRte = ExtractInsertValuesRangeTableEntry(subsetQuery);
+	subsetValuesRte->values_lists = subsetValuesLists;
+
+	pfree(rowArray);
+
+	return subsetQuery;
+}
+
+
 /*
  * Creates a router plan for INSERT ... SELECT queries which could consists of
  * multiple tasks.
@@ -665,6 +1343,34 @@ ExtractInsertRangeTableEntry(Query *query)
 }
 
 
+/*
+ * ExtractInsertValuesRangeTableEntry returns the VALUES range table entry of a
+ * multi-row INSERT, or NULL if the query is not such an INSERT.
+ */
+RangeTblEntry *
+ExtractInsertValuesRangeTableEntry(Query *query)
+{
+	ListCell *rangeTableCell = NULL;
+
+	if (query->commandType != CMD_INSERT)
+	{
+		return NULL;
+	}
+
+	foreach(rangeTableCell, query->rtable)
+	{
+		RangeTblEntry *rangeTableEntry = (RangeTblEntry *) lfirst(rangeTableCell);
+
+		if (rangeTableEntry->rtekind == RTE_VALUES)
+		{
+			return rangeTableEntry;
+		}
+	}
+
+	return NULL;
+}
+
+
 /*
  * InsertSelectQueryNotSupported returns NULL if the INSERT ... SELECT query
  * is supported, or a description why not.
@@ -1345,21 +2051,18 @@ ModifyQuerySupported(Query *queryTree)
 							 NULL);
 	}
 
-	/* reject queries which involve multi-row inserts */
-	if (hasValuesScan)
+	/*
+	 * VALUES lists are only supported as the rows of multi-row INSERTs. Function
+	 * calls in the rows are evaluated on the master separately for each row, so
+	 * VOLATILE functions still return a different value for each row.
+	 */
+	if (hasValuesScan && commandType != CMD_INSERT)
 	{
-		/*
-		 * NB: If you remove this check you must also change the checks further in this
-		 * method and ensure that VOLATILE function calls aren't allowed in INSERT
-		 * statements. Currently they're allowed but the function call is replaced
-		 * with a constant, and if you're inserting multiple rows at once the function
-		 * should return a different value for each row.
-		 */
 		return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
 							 "cannot perform distributed planning for the given"
 							 " modification",
-							 "Multi-row INSERTs to distributed tables are not "
-							 "supported.",
+							 "Joins are not supported in distributed "
+							 "modifications.",
 							 NULL);
 	}
 
@@ -1408,8 +2111,10 @@ ModifyQuerySupported(Query *queryTree)
 				specifiesPartitionValue = true;
 			}
 
+			/* partition values of multi-row INSERTs are checked for each row */
 			if (commandType == CMD_INSERT && targetEntryPartitionColumn &&
-				!IsA(targetEntry->expr, Const))
+				!IsA(targetEntry->expr, Const) &&
+				!(hasValuesScan && IsA(targetEntry->expr, Var)))
 			{
 				return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
 									 "values given for the partition column must be"
@@ -1864,6 +2569,18 @@ static Task *
 RouterModifyTask(Query *originalQuery, Query *query)
 {
 	ShardInterval *shardInterval = TargetShardIntervalForModify(query);
+
+	return RouterModifyTaskForShard(originalQuery, shardInterval);
+}
+
+
+/*
+ * RouterModifyTaskForShard builds a Task to represent a modification performed
+ * by the provided query against the given, already pruned, shard interval.
+ */
+static Task *
+RouterModifyTaskForShard(Query *originalQuery, ShardInterval *shardInterval)
+{
 	uint64 shardId = shardInterval->shardId;
 	Oid distributedTableId = shardInterval->relationId;
 	StringInfo queryString = makeStringInfo();
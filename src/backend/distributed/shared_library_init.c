@@ -21,6 +21,7 @@
 #include "distributed/citus_nodefuncs.h"
 #include "distributed/connection_management.h"
 #include "distributed/connection_management.h"
+#include "distributed/maintenanced.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
 #include "distributed/multi_copy.h"
@@ -35,6 +36,7 @@
 #include "distributed/pg_dist_partition.h"
 #include "distributed/placement_connection.h"
 #include "distributed/remote_commands.h"
+#include "distributed/shared_connection_stats.h"
 #include "distributed/task_tracker.h"
 #include "distributed/transaction_management.h"
 #include "distributed/worker_manager.h"
@@ -53,6 +55,8 @@ void _PG_init(void);
 static void CreateRequiredDirectories(void);
 static void RegisterCitusConfigVariables(void);
 static void NormalizeWorkerListPath(void);
+static bool CheckRecover2PCInterval(int *newval, void **extra, GucSource source);
+static bool CheckMaxTaskStringMemory(int *newval, void **extra, GucSource source);
 
 
 /* *INDENT-OFF* */
@@ -149,6 +153,12 @@ _PG_init(void)
 	/* organize that task tracker is started once server is up */
 	TaskTrackerRegister();
 
+	/* organize that connections to workers are tracked across backends */
+	InitializeSharedConnectionStats();
+
+	/* organize that maintenance daemons can coordinate with backends */
+	InitializeMaintenanceDaemon();
+
 	/* initialize coordinated transaction management */
 	InitializeTransactionManagement();
 	InitializeConnectionManagement();
@@ -207,6 +217,45 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_idle_connections_per_node",
+		gettext_noop("Sets the maximum number of idle connections kept to each node."),
+		gettext_noop("Connections to worker nodes are kept open after a "
+					 "transaction ends, so later transactions of the same "
+					 "session don't have to connect again. This setting limits "
+					 "how many such idle connections all sessions on this node "
+					 "together keep to each worker node, for any user and "
+					 "database; sessions close their connections at "
+					 "transaction end once the limit is reached. -1 means no "
+					 "limit."),
+		&MaxIdleConnectionsPerNode,
+		-1, -1, INT_MAX,
+		PGC_SUSET,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_shared_connections_per_node",
+		gettext_noop("Sets the maximum number of connections to each node."),
+		gettext_noop("All sessions on this node together use at most this "
+					 "many connections to each worker node at a time. Idle "
+					 "connections, bounded by "
+					 "citus.max_idle_connections_per_node, don't count "
+					 "towards the limit, and max_connections on the workers "
+					 "should leave room for them. Real-time queries use "
+					 "fewer connections once the limit is reached, and "
+					 "sessions that need another connection to a node wait "
+					 "for another session to release one, for up to "
+					 "citus.node_connection_timeout. Sessions that already "
+					 "use all of them themselves don't wait, and open the "
+					 "connections they need at the same time beyond the "
+					 "limit. -1 means no limit."),
+		&MaxSharedConnectionsPerNode,
+		-1, -1, INT_MAX,
+		PGC_SUSET,
+		0,
+		NULL, NULL, NULL);
+
 	/* keeping temporarily for updates from pre-6.0 versions */
 	DefineCustomStringVariable(
 		"citus.worker_list_file",
@@ -230,6 +279,66 @@ RegisterCitusConfigVariables(void)
 		0,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.real_time_results_in_memory",
+		gettext_noop("Stores real-time executor results in memory."),
+		gettext_noop("When enabled, the real-time executor reads task results "
+					 "directly into the tuple store of the distributed scan, "
+					 "instead of copying them into files on the master node "
+					 "first. Results are always transferred in text format, "
+					 "and a task that fails after returning some of its rows "
+					 "is not retried on another placement."),
+		&RealTimeResultsInMemory,
+		false,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.stream_real_time_results",
+		gettext_noop("Returns real-time executor results as they arrive."),
+		gettext_noop("When enabled, the real-time executor returns rows to the "
+					 "master query as soon as any task delivers them, instead "
+					 "of waiting for all tasks to complete. Once the master "
+					 "query needs no more rows, for example because of a LIMIT, "
+					 "the remaining tasks are cancelled. Results are stored in "
+					 "memory as with citus.real_time_results_in_memory."),
+		&StreamRealTimeResults,
+		false,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.stream_router_results",
+		gettext_noop("Returns router select results as they arrive."),
+		gettext_noop("When enabled, single-shard select queries outside of "
+					 "transaction blocks return rows to the client as they are "
+					 "received from the worker, instead of first storing all of "
+					 "them on the coordinator. Scans that may need to move "
+					 "backwards, such as scrollable cursors, still store their "
+					 "results. A placement that fails after returning some "
+					 "rows is not retried on another placement."),
+		&StreamRouterResults,
+		false,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.combine_real_time_tasks",
+		gettext_noop("Combines real-time tasks that run on the same workers."),
+		gettext_noop("When enabled, the real-time executor combines the queries "
+					 "of all tasks whose shard placements are on the same worker "
+					 "nodes into a single UNION ALL query. This saves the per "
+					 "task round trip and planning overhead on workers that "
+					 "hold many shards."),
+		&CombineRealTimeTasks,
+		false,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.binary_worker_copy_format",
 		gettext_noop("Use the binary worker copy format."),
@@ -286,6 +395,52 @@ RegisterCitusConfigVariables(void)
 		0,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_remote_prepared_statements",
+		gettext_noop("Prepares parameterized router queries on worker nodes."),
+		gettext_noop("When enabled, router queries that have parameters are sent "
+					 "to workers as named prepared statements, which are reused "
+					 "by later executions over the same connection. This saves "
+					 "workers from parsing and planning the same query over "
+					 "and over again. Statements are deallocated once the "
+					 "metadata of a distributed table changes."),
+		&EnableRemotePreparedStatements,
+		false,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.async_commit_prepared",
+		gettext_noop("Commits prepared transactions in the background."),
+		gettext_noop("When enabled, transactions using two-phase commit return "
+					 "once their transaction record is committed, and the "
+					 "maintenance daemon commits the prepared transactions on "
+					 "the workers. Changes then become visible on the workers, "
+					 "and their locks are released, shortly after the commit "
+					 "returns. Prepared transactions the daemon cannot commit "
+					 "are left to recover_prepared_transactions()."),
+		&AsyncCommitPrepared,
+		false,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.recover_2pc_interval",
+		gettext_noop("Sets the time to wait between recovering 2PCs."),
+		gettext_noop("The maintenance daemon of each database on the "
+					 "coordinator commits or aborts the prepared transactions "
+					 "that failures left behind on the workers, as "
+					 "recover_prepared_transactions() does, at this interval. "
+					 "Until then, such transactions hold on to their locks. "
+					 "-1 disables automatic recovery, 0 is not allowed."),
+		&Recover2PCInterval,
+		60000, -1, INT_MAX,
+		PGC_SIGHUP,
+		GUC_UNIT_MS,
+		CheckRecover2PCInterval, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.explain_distributed_queries",
 		gettext_noop("Enables Explain for distributed queries."),
@@ -334,6 +489,38 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_local_execution",
+		gettext_noop("Executes router select queries on local shard placements "
+					 "without connecting to the local node"),
+		gettext_noop("When enabled, a single-shard select query whose shard has "
+					 "a placement on the node running the query, such as an MX "
+					 "worker, is executed within the same backend. This only "
+					 "applies outside of transaction blocks."),
+		&EnableLocalExecution,
+		false,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.defer_router_modifications",
+		gettext_noop("Batches single-shard modifications in transaction blocks."),
+		gettext_noop("When enabled, single-shard modifications without a "
+					 "RETURNING clause that run in a transaction block are not "
+					 "sent right away. Instead, they are sent as a single batch "
+					 "right before the next command on the same connection, or "
+					 "when the transaction commits. Errors in these "
+					 "modifications are reported at that point and abort the "
+					 "transaction, and the number of modified rows is not "
+					 "reported. Only applies to shards with a single "
+					 "placement."),
+		&DeferRouterModifications,
+		false,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_ddl_propagation",
 		gettext_noop("Enables propagating DDL statements to worker shards"),
@@ -354,6 +541,20 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_fast_path_router_planner",
+		gettext_noop("Enables planning simple single-shard queries without "
+					 "the PostgreSQL planner"),
+		gettext_noop("When enabled, SELECT, UPDATE and DELETE statements on a "
+					 "single distributed table which filter on equality of the "
+					 "distribution column with a constant or a parameter are "
+					 "planned directly from the parse tree."),
+		&EnableFastPathRouterPlanner,
+		false,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.shard_count",
 		gettext_noop("Sets the number of shards for a new hash-partitioned table"
@@ -426,14 +627,51 @@ RegisterCitusConfigVariables(void)
 		gettext_noop("The task tracker process wakes up regularly, walks over "
 					 "all tasks assigned to it, and schedules and executes these "
 					 "tasks. Then, the task tracker sleeps for a time period "
-					 "before walking over these tasks again. This configuration "
-					 "value determines the length of that sleeping period."),
+					 "before walking over these tasks again. Task assignments "
+					 "and results of running tasks end the sleep early. This "
+					 "configuration value determines the maximum length of "
+					 "that sleeping period."),
 		&TaskTrackerDelay,
 		200, 1, 100000,
 		PGC_SIGHUP,
 		GUC_UNIT_MS,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.task_hedging_completed_percentage",
+		gettext_noop("Sets the percentage of a query's real-time tasks that "
+					 "need to complete before lagging tasks are hedged."),
+		gettext_noop("This is a plain share of the query's tasks, not a "
+					 "latency percentile. Once this percentage of a query's "
+					 "tasks completed, the real-time executor starts a "
+					 "second attempt of each remaining task on another shard "
+					 "placement, and uses the result of whichever attempt "
+					 "finishes first. Only applies to results copied into "
+					 "files, and to tasks with a placement on which they "
+					 "haven't failed yet. 0 disables hedging."),
+		&TaskHedgingCompletedPercentage,
+		0, 0, 100,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_real_time_connections_per_worker",
+		gettext_noop("Sets the maximum number of connections the real-time "
+					 "executor opens to a worker node."),
+		gettext_noop("The real-time executor runs a query's tasks on a pool "
+					 "of connections per worker node, and reuses a connection "
+					 "for the next task once a task completes. The pool starts "
+					 "small, and grows while tasks wait for a connection. This "
+					 "configuration value caps the size of each pool. -1 "
+					 "disables pooling, so that each task opens its own "
+					 "connection."),
+		&MaxRealTimeConnectionsPerWorker,
+		-1, -1, INT_MAX,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_assign_task_batch_size",
 		gettext_noop("Sets the maximum number of tasks to assign per round."),
@@ -462,6 +700,22 @@ RegisterCitusConfigVariables(void)
 		0,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_task_string_memory",
+		gettext_noop("Sets the shared memory used for the tracked tasks' queries."),
+		gettext_noop("The task tracker keeps the query or function call "
+					 "string of each tracked task in shared memory, using as "
+					 "much of it as the string needs. This configuration value "
+					 "sets the size of that memory, and therefore limits the "
+					 "total length of the strings of all tasks tracked at any "
+					 "given time. -1 leaves room for the longest string for "
+					 "each of citus.max_tracked_tasks_per_node tasks."),
+		&MaxTaskStringMemory,
+		-1, -1, INT_MAX / 1024,
+		PGC_POSTMASTER,
+		GUC_UNIT_KB,
+		CheckMaxTaskStringMemory, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_running_tasks_per_node",
 		gettext_noop("Sets the maximum number of tasks to run concurrently per node."),
@@ -658,3 +912,40 @@ NormalizeWorkerListPath(void)
 					PGC_S_OVERRIDE);
 	free(absoluteFileName);
 }
+
+
+/*
+ * CheckRecover2PCInterval is the check hook of citus.recover_2pc_interval. It
+ * rejects 0, which could either be taken to mean recovering continuously or
+ * never, so that only -1 disables recovery.
+ */
+static bool
+CheckRecover2PCInterval(int *newval, void **extra, GucSource source)
+{
+	if (*newval == 0)
+	{
+		GUC_check_errdetail("citus.recover_2pc_interval must be positive, or -1 "
+							"to disable automatic recovery.");
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * CheckMaxTaskStringMemory is the check hook of citus.max_task_string_memory.
+ * It rejects sizes too small to hold even short call strings of a few tasks.
+ */
+static bool
+CheckMaxTaskStringMemory(int *newval, void **extra, GucSource source)
+{
+	if (*newval != -1 && *newval < 64)
+	{
+		GUC_check_errdetail("citus.max_task_string_memory must be at least 64kB, "
+							"or -1 to size it by citus.max_tracked_tasks_per_node.");
+		return false;
+	}
+
+	return true;
+}
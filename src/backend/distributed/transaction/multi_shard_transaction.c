@@ -34,6 +34,9 @@
  * using the provided shard identifier list and returns it as a shard ID ->
  * ShardConnections hash. connectionFlags can be used to specify whether
  * the command is FOR_DML or FOR_DDL.
+ *
+ * The connections are established concurrently, and BEGIN is deferred so it
+ * is sent together with the first command over each connection.
  */
 HTAB *
 OpenTransactionsToAllShardPlacements(List *shardIntervalList, int connectionFlags)
@@ -108,7 +111,7 @@ OpenTransactionsToAllShardPlacements(List *shardIntervalList, int connectionFlag
 	/* the special BARE mode (for e.g. VACUUM/ANALYZE) skips BEGIN */
 	if (MultiShardCommitProtocol > COMMIT_PROTOCOL_BARE)
 	{
-		RemoteTransactionsBeginIfNecessary(newConnectionList);
+		RemoteTransactionsDeferBeginIfNecessary(newConnectionList);
 	}
 
 	return shardConnectionHash;
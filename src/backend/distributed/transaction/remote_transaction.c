@@ -16,16 +16,26 @@
 
 #include "access/xact.h"
 #include "distributed/connection_management.h"
+#include "distributed/maintenanced.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/remote_commands.h"
 #include "distributed/remote_transaction.h"
 #include "distributed/transaction_management.h"
 #include "distributed/transaction_recovery.h"
 #include "distributed/worker_manager.h"
+#include "lib/stringinfo.h"
+#include "storage/lmgr.h"
 #include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+
+/* command beginning a remote transaction, see StartRemoteTransactionBegin */
+#define BEGIN_TRANSACTION_COMMAND "BEGIN TRANSACTION ISOLATION LEVEL READ COMMITTED"
 
 
 static void CheckTransactionHealth(void);
+static bool CanCommitRemoteTransactionsInOnePhase(void);
+static void SendRemoteTransactionPrepare(MultiConnection *connection);
 static void Assign2PCIdentifier(MultiConnection *connection);
 static void WarnAboutLeakedPreparedTransaction(MultiConnection *connection, bool commit);
 
@@ -51,8 +61,7 @@ StartRemoteTransactionBegin(struct MultiConnection *connection)
 	 * side might have been changed, and that would cause problematic
 	 * behaviour.
 	 */
-	if (!SendRemoteCommand(connection,
-						   "BEGIN TRANSACTION ISOLATION LEVEL READ COMMITTED"))
+	if (!SendRemoteCommand(connection, BEGIN_TRANSACTION_COMMAND))
 	{
 		ReportConnectionError(connection, WARNING);
 		MarkRemoteTransactionFailed(connection, true);
@@ -275,6 +284,13 @@ StartRemoteTransactionAbort(MultiConnection *connection)
 
 	Assert(transaction->transactionState != REMOTE_TRANS_INVALID);
 
+	/* deferred commands would be rolled back anyway, so don't send them */
+	transaction->deferredCommands = NULL;
+	transaction->deferredCommandCount = 0;
+	transaction->deferredCommandsSent = false;
+	transaction->pipelinedResultCount = 0;
+	ForgetPendingPreparedStatement(connection);
+
 	/*
 	 * Clear previous results, so we have a better chance to send
 	 * ROLLBACK [PREPARED];
@@ -375,11 +391,32 @@ RemoteTransactionAbort(MultiConnection *connection)
  */
 void
 StartRemoteTransactionPrepare(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	WorkerNode *workerNode = NULL;
+
+	SendRemoteTransactionPrepare(connection);
+
+	/* log transactions to workers in pg_dist_transaction */
+	workerNode = FindWorkerNode(connection->hostname, connection->port);
+	if (workerNode != NULL)
+	{
+		LogTransactionRecord(workerNode->groupId, transaction->preparedName);
+	}
+}
+
+
+/*
+ * SendRemoteTransactionPrepare assigns the remote transaction a 2PC
+ * identifier and sends PREPARE TRANSACTION, without logging the transaction
+ * in pg_dist_transaction.
+ */
+static void
+SendRemoteTransactionPrepare(MultiConnection *connection)
 {
 	RemoteTransaction *transaction = &connection->remoteTransaction;
 	StringInfoData command;
 	const bool raiseErrors = true;
-	WorkerNode *workerNode = NULL;
 
 	/* can't prepare a nonexistant transaction */
 	Assert(transaction->transactionState != REMOTE_TRANS_INVALID);
@@ -392,13 +429,6 @@ StartRemoteTransactionPrepare(struct MultiConnection *connection)
 
 	Assign2PCIdentifier(connection);
 
-	/* log transactions to workers in pg_dist_transaction */
-	workerNode = FindWorkerNode(connection->hostname, connection->port);
-	if (workerNode != NULL)
-	{
-		LogTransactionRecord(workerNode->groupId, transaction->preparedName);
-	}
-
 	initStringInfo(&command);
 	appendStringInfo(&command, "PREPARE TRANSACTION '%s'",
 					 transaction->preparedName);
@@ -544,6 +574,172 @@ RemoteTransactionsBeginIfNecessary(List *connectionList)
 }
 
 
+/*
+ * RemoteTransactionsDeferBeginIfNecessary is a variant of
+ * RemoteTransactionsBeginIfNecessary that doesn't wait for the remote
+ * transactions to begin. BEGIN is deferred instead, so that it is sent in the
+ * same round-trip as the first command over each connection.
+ */
+void
+RemoteTransactionsDeferBeginIfNecessary(List *connectionList)
+{
+	ListCell *connectionCell = NULL;
+
+	if (!InCoordinatedTransaction())
+	{
+		return;
+	}
+
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+
+		if (transaction->transactionState != REMOTE_TRANS_INVALID)
+		{
+			continue;
+		}
+
+		/* remember transaction as being in-progress */
+		dlist_push_tail(&InProgressTransactions, &connection->transactionNode);
+
+		/* any later command over the connection runs after the BEGIN */
+		transaction->transactionState = REMOTE_TRANS_STARTED;
+
+		DeferRemoteTransactionCommand(connection, BEGIN_TRANSACTION_COMMAND);
+	}
+}
+
+
+/*
+ * DeferRemoteTransactionCommand queues a command to be executed in the
+ * remote transaction, without sending it yet. Queued commands are sent as a
+ * single multi-statement batch, either right before the next command is sent
+ * over the connection, or when the coordinated transaction commits. That way
+ * consecutive modifications only cost a single round-trip.
+ */
+void
+DeferRemoteTransactionCommand(struct MultiConnection *connection, const char *command)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
+	Assert(transaction->transactionState == REMOTE_TRANS_STARTED);
+
+	if (transaction->deferredCommands == NULL)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+		transaction->deferredCommands = makeStringInfo();
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	appendStringInfoString(transaction->deferredCommands, command);
+	appendStringInfoChar(transaction->deferredCommands, ';');
+	transaction->deferredCommandCount++;
+}
+
+
+/*
+ * StartRemoteTransactionFlush sends the commands deferred on the connection
+ * in a non-blocking manner. As the commands were already accepted by the
+ * executor, failing to send them errors out.
+ */
+void
+StartRemoteTransactionFlush(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	StringInfo deferredCommands = transaction->deferredCommands;
+
+	if (deferredCommands == NULL)
+	{
+		return;
+	}
+
+	transaction->deferredCommands = NULL;
+	transaction->deferredCommandCount = 0;
+
+	if (!SendRemoteCommandBatch(connection, deferredCommands->data))
+	{
+		MarkRemoteTransactionFailed(connection, false);
+		ReportConnectionError(connection, ERROR);
+	}
+
+	transaction->deferredCommandsSent = true;
+}
+
+
+/*
+ * FinishRemoteTransactionFlush finishes the work StartRemoteTransactionFlush
+ * initiated. It blocks if necessary (i.e. if PQisBusy() would return true).
+ * If any of the deferred commands failed, the error is rethrown.
+ */
+void
+FinishRemoteTransactionFlush(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	PGresult *result = NULL;
+	const bool raiseInterrupts = true;
+
+	if (!transaction->deferredCommandsSent)
+	{
+		return;
+	}
+
+	transaction->deferredCommandsSent = false;
+
+	while ((result = GetRemoteCommandResult(connection, raiseInterrupts)) != NULL)
+	{
+		if (!IsResponseOK(result))
+		{
+			MarkRemoteTransactionFailed(connection, false);
+			ReportResultError(connection, result, ERROR);
+		}
+
+		PQclear(result);
+	}
+}
+
+
+/*
+ * RemoteTransactionFlush executes the commands deferred on the connection in
+ * a blocking manner.
+ */
+void
+RemoteTransactionFlush(struct MultiConnection *connection)
+{
+	StartRemoteTransactionFlush(connection);
+	FinishRemoteTransactionFlush(connection);
+}
+
+
+/*
+ * RemoteTransactionPipelineCommand returns the given command, preceded by the
+ * commands deferred on the connection, so that both can be sent as a single
+ * multi-statement query. GetRemoteCommandResult consumes the results of the
+ * deferred commands before returning those of the command itself.
+ */
+const char *
+RemoteTransactionPipelineCommand(struct MultiConnection *connection, const char *command)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	StringInfo deferredCommands = transaction->deferredCommands;
+
+	if (deferredCommands == NULL)
+	{
+		return command;
+	}
+
+	appendStringInfoString(deferredCommands, command);
+
+	transaction->pipelinedResultCount = transaction->deferredCommandCount;
+	transaction->deferredCommands = NULL;
+	transaction->deferredCommandCount = 0;
+
+	return deferredCommands->data;
+}
+
+
 /*
  * MarkRemoteTransactionFailed records a transaction as having failed.
  *
@@ -619,14 +815,73 @@ ResetRemoteTransaction(struct MultiConnection *connection)
 }
 
 
+/*
+ * CoordinatedRemoteTransactionsFlush executes the commands deferred on any of
+ * the connections participating in the coordinated transaction, before the
+ * transaction is prepared or committed.
+ */
+void
+CoordinatedRemoteTransactionsFlush(void)
+{
+	dlist_iter iter;
+
+	/* asynchronously send the deferred commands */
+	dlist_foreach(iter, &InProgressTransactions)
+	{
+		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
+													  iter.cur);
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+
+		if (transaction->transactionFailed)
+		{
+			continue;
+		}
+
+		StartRemoteTransactionFlush(connection);
+	}
+
+	/* then wait for their results */
+	dlist_foreach(iter, &InProgressTransactions)
+	{
+		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
+													  iter.cur);
+
+		FinishRemoteTransactionFlush(connection);
+	}
+}
+
+
 /*
  * CoordinatedRemoteTransactionsPrepare PREPAREs a 2PC transaction on all
  * non-failed transactions participating in the coordinated transaction.
+ * The transactions are logged in pg_dist_transaction as one batch, while the
+ * PREPAREs are in flight.
+ *
+ * If a single remote transaction is all there is to commit, it is committed
+ * right away instead, as the outcome of the coordinated transaction then
+ * only depends on it.
  */
 void
 CoordinatedRemoteTransactionsPrepare(void)
 {
 	dlist_iter iter;
+	List *groupIdList = NIL;
+	List *transactionNameList = NIL;
+
+	if (CanCommitRemoteTransactionsInOnePhase())
+	{
+		CoordinatedRemoteTransactionsCommit();
+		CurrentCoordinatedTransactionState = COORD_TRANS_COMMITTED;
+
+		return;
+	}
+
+	/*
+	 * Recovery aborts prepared transactions it finds no record for, and it
+	 * waits for transactions holding this lock. Take it before anything is
+	 * prepared, so recovery can't interfere before the records are written.
+	 */
+	LockRelationOid(DistTransactionRelationId(), RowExclusiveLock);
 
 	/* issue PREPARE TRANSACTION; to all relevant remote nodes */
 
@@ -636,6 +891,7 @@ CoordinatedRemoteTransactionsPrepare(void)
 		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
 													  iter.cur);
 		RemoteTransaction *transaction = &connection->remoteTransaction;
+		WorkerNode *workerNode = NULL;
 
 		Assert(transaction->transactionState != REMOTE_TRANS_INVALID);
 
@@ -645,9 +901,20 @@ CoordinatedRemoteTransactionsPrepare(void)
 			continue;
 		}
 
-		StartRemoteTransactionPrepare(connection);
+		SendRemoteTransactionPrepare(connection);
+
+		workerNode = FindWorkerNode(connection->hostname, connection->port);
+		if (workerNode != NULL)
+		{
+			groupIdList = lappend_int(groupIdList, workerNode->groupId);
+			transactionNameList = lappend(transactionNameList,
+										  transaction->preparedName);
+		}
 	}
 
+	/* log transactions to workers in pg_dist_transaction */
+	LogTransactionRecords(groupIdList, transactionNameList);
+
 	/* XXX: Should perform network IO for all connections in a non-blocking manner */
 
 	/* Wait for result */
@@ -669,6 +936,41 @@ CoordinatedRemoteTransactionsPrepare(void)
 }
 
 
+/*
+ * CanCommitRemoteTransactionsInOnePhase returns whether the coordinated
+ * transaction can skip 2PC: there is exactly one remote transaction, it
+ * didn't fail, and the local transaction didn't write anything, so there
+ * is nothing that could commit while the remote transaction doesn't.
+ */
+static bool
+CanCommitRemoteTransactionsInOnePhase(void)
+{
+	dlist_iter iter;
+	int remoteTransactionCount = 0;
+
+	if (GetTopTransactionIdIfAny() != InvalidTransactionId)
+	{
+		return false;
+	}
+
+	dlist_foreach(iter, &InProgressTransactions)
+	{
+		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
+													  iter.cur);
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+
+		if (transaction->transactionFailed)
+		{
+			return false;
+		}
+
+		remoteTransactionCount++;
+	}
+
+	return remoteTransactionCount == 1;
+}
+
+
 /*
  * CoordinatedRemoteTransactionsCommit performs distributed transactions
  * handling at commit time. This will be called at XACT_EVENT_PRE_COMMIT if
@@ -709,6 +1011,19 @@ CoordinatedRemoteTransactionsCommit(void)
 			continue;
 		}
 
+		/*
+		 * With citus.async_commit_prepared, committing the prepared
+		 * transaction is left to the maintenance daemon if it can take it.
+		 */
+		if (AsyncCommitPrepared &&
+			transaction->transactionState == REMOTE_TRANS_PREPARED &&
+			!transaction->transactionFailed &&
+			EnqueueCommitPrepared(connection))
+		{
+			transaction->transactionState = REMOTE_TRANS_COMMITTED;
+			continue;
+		}
+
 		StartRemoteTransactionCommit(connection);
 	}
 
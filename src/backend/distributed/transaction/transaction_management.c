@@ -21,6 +21,8 @@
 #include "access/xact.h"
 #include "distributed/connection_management.h"
 #include "distributed/hash_helpers.h"
+#include "distributed/maintenanced.h"
+#include "distributed/multi_planner.h"
 #include "distributed/multi_shard_transaction.h"
 #include "distributed/transaction_management.h"
 #include "distributed/placement_connection.h"
@@ -149,6 +151,7 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			 * callbacks still can perform work if needed.
 			 */
 			ResetShardPlacementTransactionState();
+			CleanUpMultiPlanCache();
 
 			if (CurrentCoordinatedTransactionState == COORD_TRANS_PREPARED)
 			{
@@ -185,6 +188,7 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			 * callbacks still can perform work if needed.
 			 */
 			ResetShardPlacementTransactionState();
+			CleanUpMultiPlanCache();
 
 			/* handles both already prepared and open transactions */
 			if (CurrentCoordinatedTransactionState > COORD_TRANS_IDLE)
@@ -241,6 +245,12 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			 * fails, which can lead to divergence when not using 2PC.
 			 */
 
+			/*
+			 * Execute modifications that were deferred until commit, their
+			 * failures have to be noticed before preparing or committing.
+			 */
+			CoordinatedRemoteTransactionsFlush();
+
 			/*
 			 * Check whether the coordinated transaction is in a state we want
 			 * to persist, or whether we want to error out.  This handles the
@@ -251,8 +261,14 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 
 			if (CoordinatedTransactionUses2PC)
 			{
+				/* the maintenance daemon commits the prepared transactions */
+				if (AsyncCommitPrepared)
+				{
+					InitializeMaintenanceDaemonBackend();
+				}
+
+				/* commits right away if only one remote transaction takes part */
 				CoordinatedRemoteTransactionsPrepare();
-				CurrentCoordinatedTransactionState = COORD_TRANS_PREPARED;
 			}
 			else
 			{
@@ -26,6 +26,7 @@
 #include "catalog/indexing.h"
 #include "distributed/connection_management.h"
 #include "distributed/listutils.h"
+#include "distributed/maintenanced.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/pg_dist_transaction.h"
 #include "distributed/remote_commands.h"
@@ -45,15 +46,22 @@ PG_FUNCTION_INFO_V1(recover_prepared_transactions);
 
 
 /* Local functions forward declarations */
-static int RecoverPreparedTransactions(void);
-static int RecoverWorkerTransactions(WorkerNode *workerNode);
+static int RecoverWorkerTransactions(WorkerNode *workerNode,
+									 MultiConnection *connection,
+									 List *pendingTransactionList,
+									 List *unconfirmedTransactionList,
+									 int *committedTransactionCount,
+									 int *abortedTransactionCount);
 static List * NameListDifference(List *nameList, List *subtractList);
 static int CompareNames(const void *leftPointer, const void *rightPointer);
 static bool FindMatchingName(char **nameArray, int nameCount, char *needle,
 							 int *matchIndex);
-static List * PendingWorkerTransactionList(MultiConnection *connection);
+static bool SendPendingWorkerTransactionsQuery(MultiConnection *connection);
+static bool ReceivePendingWorkerTransactionList(MultiConnection *connection,
+												List **pendingTransactionList);
 static List * UnconfirmedWorkerTransactionsList(int groupId);
-static void DeleteTransactionRecord(int32 groupId, char *transactionName);
+static void DeleteTransactionRecord(int32 groupId, char *transactionName,
+									bool missingOk);
 
 
 /*
@@ -78,28 +86,67 @@ recover_prepared_transactions(PG_FUNCTION_ARGS)
  */
 void
 LogTransactionRecord(int groupId, char *transactionName)
+{
+	List *groupIdList = list_make1_int(groupId);
+	List *transactionNameList = list_make1(transactionName);
+
+	LogTransactionRecords(groupIdList, transactionNameList);
+}
+
+
+/*
+ * LogTransactionRecords registers a batch of prepared transactions at once,
+ * as LogTransactionRecord does for a single one. groupIdList and
+ * transactionNameList hold the group and name of each transaction at the
+ * same positions. pg_dist_transaction and its indexes are opened only once
+ * for the whole batch.
+ */
+void
+LogTransactionRecords(List *groupIdList, List *transactionNameList)
 {
 	Relation pgDistTransaction = NULL;
 	TupleDesc tupleDescriptor = NULL;
-	HeapTuple heapTuple = NULL;
-	Datum values[Natts_pg_dist_transaction];
-	bool isNulls[Natts_pg_dist_transaction];
+	CatalogIndexState indexState = NULL;
+	ListCell *groupIdCell = NULL;
+	ListCell *transactionNameCell = NULL;
 
-	/* form new transaction tuple */
-	memset(values, 0, sizeof(values));
-	memset(isNulls, false, sizeof(isNulls));
+	Assert(list_length(groupIdList) == list_length(transactionNameList));
 
-	values[Anum_pg_dist_transaction_groupid - 1] = Int32GetDatum(groupId);
-	values[Anum_pg_dist_transaction_gid - 1] = CStringGetTextDatum(transactionName);
+	if (groupIdList == NIL)
+	{
+		return;
+	}
 
-	/* open transaction relation and insert new tuple */
+	/* open transaction relation and insert new tuples */
 	pgDistTransaction = heap_open(DistTransactionRelationId(), RowExclusiveLock);
 
 	tupleDescriptor = RelationGetDescr(pgDistTransaction);
-	heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+	indexState = CatalogOpenIndexes(pgDistTransaction);
+
+	forboth(groupIdCell, groupIdList, transactionNameCell, transactionNameList)
+	{
+		int groupId = lfirst_int(groupIdCell);
+		char *transactionName = (char *) lfirst(transactionNameCell);
+		HeapTuple heapTuple = NULL;
+		Datum values[Natts_pg_dist_transaction];
+		bool isNulls[Natts_pg_dist_transaction];
+
+		/* form new transaction tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[Anum_pg_dist_transaction_groupid - 1] = Int32GetDatum(groupId);
+		values[Anum_pg_dist_transaction_gid - 1] = CStringGetTextDatum(transactionName);
 
-	simple_heap_insert(pgDistTransaction, heapTuple);
-	CatalogUpdateIndexes(pgDistTransaction, heapTuple);
+		heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+
+		simple_heap_insert(pgDistTransaction, heapTuple);
+		CatalogIndexInsert(indexState, heapTuple);
+
+		heap_freetuple(heapTuple);
+	}
+
+	CatalogCloseIndexes(indexState);
 	CommandCounterIncrement();
 
 	/* close relation and invalidate previous cache entry */
@@ -107,31 +154,273 @@ LogTransactionRecord(int groupId, char *transactionName)
 }
 
 
+/*
+ * CommitPreparedTransactionList commits the prepared transactions of committed
+ * distributed transactions, as handed over to the maintenance daemon, and
+ * removes their transaction records. The commands are sent to all nodes
+ * concurrently, one at a time per connection. Prepared transactions that
+ * cannot be committed right now are left for recovery. Returns the number
+ * of prepared transactions that were committed.
+ */
+int
+CommitPreparedTransactionList(List *pendingCommitList)
+{
+	int pendingCommitCount = list_length(pendingCommitList);
+	PendingCommitPrepared **pendingCommitArray =
+		(PendingCommitPrepared **) PointerArrayFromList(pendingCommitList);
+	MultiConnection **connectionArray =
+		(MultiConnection **) palloc0(pendingCommitCount * sizeof(MultiConnection *));
+	bool *sentArray = (bool *) palloc0(pendingCommitCount * sizeof(bool));
+	bool *doneArray = (bool *) palloc0(pendingCommitCount * sizeof(bool));
+	List *connectionList = NIL;
+	int remainingCount = pendingCommitCount;
+	int committedCount = 0;
+	int pendingIndex = 0;
+
+	for (pendingIndex = 0; pendingIndex < pendingCommitCount; pendingIndex++)
+	{
+		PendingCommitPrepared *pendingCommit = pendingCommitArray[pendingIndex];
+		int connectionFlags = SESSION_LIFESPAN;
+		MultiConnection *connection =
+			StartNodeUserDatabaseConnection(connectionFlags, pendingCommit->nodeName,
+											pendingCommit->nodePort,
+											pendingCommit->userName, NULL);
+
+		connectionArray[pendingIndex] = connection;
+		connectionList = list_append_unique_ptr(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	while (remainingCount > 0)
+	{
+		List *busyConnectionList = NIL;
+
+		/* send at most one command over each connection */
+		for (pendingIndex = 0; pendingIndex < pendingCommitCount; pendingIndex++)
+		{
+			PendingCommitPrepared *pendingCommit = pendingCommitArray[pendingIndex];
+			MultiConnection *connection = connectionArray[pendingIndex];
+			StringInfo command = NULL;
+
+			sentArray[pendingIndex] = false;
+
+			if (doneArray[pendingIndex] || list_member_ptr(busyConnectionList, connection))
+			{
+				continue;
+			}
+
+			if (PQstatus(connection->pgConn) != CONNECTION_OK)
+			{
+				/* cannot commit this transaction right now, leave it to recovery */
+				doneArray[pendingIndex] = true;
+				remainingCount--;
+				continue;
+			}
+
+			command = makeStringInfo();
+			appendStringInfo(command, "COMMIT PREPARED '%s'",
+							 pendingCommit->preparedName);
+
+			if (!SendRemoteCommand(connection, command->data))
+			{
+				ReportConnectionError(connection, WARNING);
+				doneArray[pendingIndex] = true;
+				remainingCount--;
+				continue;
+			}
+
+			sentArray[pendingIndex] = true;
+			busyConnectionList = lappend(busyConnectionList, connection);
+		}
+
+		/* and wait for the results */
+		for (pendingIndex = 0; pendingIndex < pendingCommitCount; pendingIndex++)
+		{
+			PendingCommitPrepared *pendingCommit = pendingCommitArray[pendingIndex];
+			MultiConnection *connection = connectionArray[pendingIndex];
+			PGresult *result = NULL;
+			bool committed = false;
+
+			if (!sentArray[pendingIndex])
+			{
+				continue;
+			}
+
+			result = GetRemoteCommandResult(connection, true);
+			if (IsResponseOK(result))
+			{
+				committed = true;
+			}
+			else
+			{
+				char *sqlStateString = PQresultErrorField(result, PG_DIAG_SQLSTATE);
+
+				/* recovery already committed the prepared transaction */
+				if (sqlStateString != NULL && strcmp(sqlStateString, "42704") == 0)
+				{
+					committed = true;
+				}
+				else
+				{
+					ReportResultError(connection, result, WARNING);
+				}
+			}
+
+			PQclear(result);
+			ForgetResults(connection);
+
+			if (committed)
+			{
+				WorkerNode *workerNode = FindWorkerNode(pendingCommit->nodeName,
+														pendingCommit->nodePort);
+
+				if (workerNode != NULL)
+				{
+					DeleteTransactionRecord(workerNode->groupId,
+											pendingCommit->preparedName, true);
+				}
+
+				committedCount++;
+			}
+
+			doneArray[pendingIndex] = true;
+			remainingCount--;
+		}
+	}
+
+	return committedCount;
+}
+
+
 /*
  * RecoverPreparedTransactions recovers any pending prepared
- * transactions started by this node on other nodes.
+ * transactions started by this node on other nodes. The prepared
+ * transactions of all workers are requested at once, so that the
+ * round-trips to the workers overlap. Workers that cannot be reached or
+ * queried are skipped with a warning, and recovered in a later round.
+ * Returns the number of prepared transactions that were committed or
+ * aborted, and logs both counts.
  */
-static int
+int
 RecoverPreparedTransactions(void)
 {
 	List *workerList = NIL;
+	List *connectionList = NIL;
+	List *queriedConnectionList = NIL;
 	ListCell *workerNodeCell = NULL;
+	ListCell *connectionCell = NULL;
+	List **pendingTransactionLists = NULL;
+	List **unconfirmedTransactionLists = NULL;
+	bool *workerQueried = NULL;
+	int workerCount = 0;
+	int workerIndex = 0;
 	int recoveredTransactionCount = 0;
+	int committedTransactionCount = 0;
+	int abortedTransactionCount = 0;
+
+	/* prevent concurrent recovery for the whole round */
+	LockRelationOid(DistTransactionRelationId(), ShareUpdateExclusiveLock);
 
 	/*
 	 * We block here if metadata transactions are ongoing, since we
 	 * mustn't commit/abort their prepared transactions under their
-	 * feet. We also prevent concurrent recovery.
+	 * feet. Transactions take this lock before preparing, so once we
+	 * hold it, the prepared transactions we find and their records
+	 * don't change until we have read both.
 	 */
 	LockRelationOid(DistTransactionRelationId(), ExclusiveLock);
 
 	workerList = WorkerNodeList();
+	workerCount = list_length(workerList);
+
+	pendingTransactionLists = (List **) palloc0(workerCount * sizeof(List *));
+	unconfirmedTransactionLists = (List **) palloc0(workerCount * sizeof(List *));
+	workerQueried = (bool *) palloc0(workerCount * sizeof(bool));
 
+	/* connect to all workers concurrently */
 	foreach(workerNodeCell, workerList)
 	{
 		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
+		int connectionFlags = SESSION_LIFESPAN;
+		MultiConnection *connection = StartNodeConnection(connectionFlags,
+														  workerNode->workerName,
+														  workerNode->workerPort);
 
-		recoveredTransactionCount += RecoverWorkerTransactions(workerNode);
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	/* ask all workers for their prepared transactions before waiting for any */
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		if (connection->pgConn == NULL ||
+			PQstatus(connection->pgConn) != CONNECTION_OK)
+		{
+			/* cannot recover transactions on this worker right now */
+			continue;
+		}
+
+		if (!SendPendingWorkerTransactionsQuery(connection))
+		{
+			continue;
+		}
+
+		queriedConnectionList = lappend(queriedConnectionList, connection);
+	}
+
+	workerIndex = 0;
+	forboth(workerNodeCell, workerList, connectionCell, connectionList)
+	{
+		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		if (list_member_ptr(queriedConnectionList, connection) &&
+			ReceivePendingWorkerTransactionList(connection,
+												&pendingTransactionLists[workerIndex]))
+		{
+			/* find transactions that were committed, but not yet confirmed */
+			unconfirmedTransactionLists[workerIndex] =
+				UnconfirmedWorkerTransactionsList(workerNode->groupId);
+			workerQueried[workerIndex] = true;
+		}
+
+		workerIndex++;
+	}
+
+	/*
+	 * Transactions that prepare from now on are not among the ones we found,
+	 * so they can go ahead while we commit and abort on the workers.
+	 */
+	UnlockRelationOid(DistTransactionRelationId(), ExclusiveLock);
+
+	workerIndex = 0;
+	forboth(workerNodeCell, workerList, connectionCell, connectionList)
+	{
+		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		if (workerQueried[workerIndex])
+		{
+			recoveredTransactionCount +=
+				RecoverWorkerTransactions(workerNode, connection,
+										  pendingTransactionLists[workerIndex],
+										  unconfirmedTransactionLists[workerIndex],
+										  &committedTransactionCount,
+										  &abortedTransactionCount);
+		}
+
+		workerIndex++;
+	}
+
+	if (recoveredTransactionCount > 0)
+	{
+		ereport(LOG, (errmsg("recovered %d prepared transactions: committed %d, "
+							 "aborted %d", recoveredTransactionCount,
+							 committedTransactionCount, abortedTransactionCount)));
 	}
 
 	return recoveredTransactionCount;
@@ -139,11 +428,17 @@ RecoverPreparedTransactions(void)
 
 
 /*
- * RecoverWorkerTransactions recovers any pending prepared transactions
- * started by this node on the specified worker.
+ * RecoverWorkerTransactions recovers the given pending prepared transactions
+ * started by this node on the specified worker, over the given connection,
+ * using the transaction records that were unconfirmed when they were read.
+ * The number of committed and aborted transactions is added to the counts.
  */
 static int
-RecoverWorkerTransactions(WorkerNode *workerNode)
+RecoverWorkerTransactions(WorkerNode *workerNode, MultiConnection *connection,
+						  List *pendingTransactionList,
+						  List *unconfirmedTransactionList,
+						  int *committedTransactionCount,
+						  int *abortedTransactionCount)
 {
 	int recoveredTransactionCount = 0;
 
@@ -151,10 +446,8 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 	char *nodeName = workerNode->workerName;
 	int nodePort = workerNode->workerPort;
 
-	List *pendingTransactionList = NIL;
 	ListCell *pendingTransactionCell = NULL;
 
-	List *unconfirmedTransactionList = NIL;
 	char **unconfirmedTransactionArray = NULL;
 	int unconfirmedTransactionCount = 0;
 	int unconfirmedTransactionIndex = 0;
@@ -165,14 +458,6 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 	MemoryContext localContext = NULL;
 	MemoryContext oldContext = NULL;
 
-	int connectionFlags = SESSION_LIFESPAN;
-	MultiConnection *connection = GetNodeConnection(connectionFlags, nodeName, nodePort);
-	if (connection->pgConn == NULL)
-	{
-		/* cannot recover transactions on this worker right now */
-		return 0;
-	}
-
 	localContext = AllocSetContextCreate(CurrentMemoryContext,
 										 "RecoverWorkerTransactions",
 										 ALLOCSET_DEFAULT_MINSIZE,
@@ -180,8 +465,6 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 										 ALLOCSET_DEFAULT_MAXSIZE);
 	oldContext = MemoryContextSwitchTo(localContext);
 
-	/* find transactions that were committed, but not yet confirmed */
-	unconfirmedTransactionList = UnconfirmedWorkerTransactionsList(groupId);
 	unconfirmedTransactionList = SortList(unconfirmedTransactionList, CompareNames);
 
 	/* convert list to an array to use with FindMatchingNames */
@@ -189,8 +472,7 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 	unconfirmedTransactionArray =
 		(char **) PointerArrayFromList(unconfirmedTransactionList);
 
-	/* find stale prepared transactions on the remote node */
-	pendingTransactionList = PendingWorkerTransactionList(connection);
+	/* sort the stale prepared transactions on the remote node */
 	pendingTransactionList = SortList(pendingTransactionList, CompareNames);
 
 	/*
@@ -251,17 +533,25 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 		{
 			committedTransactionList = lappend(committedTransactionList,
 											   transactionName);
+			*committedTransactionCount += 1;
+		}
+		else
+		{
+			*abortedTransactionCount += 1;
 		}
 
 		recoveredTransactionCount += 1;
 	}
 
-	/* we can remove the transaction records of confirmed transactions */
+	/*
+	 * We can remove the transaction records of confirmed transactions. The
+	 * maintenance daemon may have removed some of them already.
+	 */
 	foreach(committedTransactionCell, committedTransactionList)
 	{
 		char *transactionName = (char *) lfirst(committedTransactionCell);
 
-		DeleteTransactionRecord(groupId, transactionName);
+		DeleteTransactionRecord(groupId, transactionName, true);
 	}
 
 	MemoryContextReset(localContext);
@@ -369,19 +659,16 @@ FindMatchingName(char **nameArray, int nameCount, char *needle,
 
 
 /*
- * PendingWorkerTransactionList returns a list of pending prepared
- * transactions on a remote node that were started by this node.
+ * SendPendingWorkerTransactionsQuery sends the query for the pending prepared
+ * transactions on a remote node that were started by this node. The result
+ * is read by ReceivePendingWorkerTransactionList. Returns false, after a
+ * warning, if the query could not be sent.
  */
-static List *
-PendingWorkerTransactionList(MultiConnection *connection)
+static bool
+SendPendingWorkerTransactionsQuery(MultiConnection *connection)
 {
 	StringInfo command = makeStringInfo();
-	bool raiseInterrupts = true;
 	int querySent = 0;
-	PGresult *result = NULL;
-	int rowCount = 0;
-	int rowIndex = 0;
-	List *transactionNames = NIL;
 	int coordinatorId = 0;
 
 	appendStringInfo(command, "SELECT gid FROM pg_prepared_xacts "
@@ -391,13 +678,38 @@ PendingWorkerTransactionList(MultiConnection *connection)
 	querySent = SendRemoteCommand(connection, command->data);
 	if (querySent == 0)
 	{
-		ReportConnectionError(connection, ERROR);
+		ReportConnectionError(connection, WARNING);
+		return false;
 	}
 
+	return true;
+}
+
+
+/*
+ * ReceivePendingWorkerTransactionList sets pendingTransactionList to the
+ * pending prepared transactions on a remote node that were started by this
+ * node, as queried by SendPendingWorkerTransactionsQuery. Returns false,
+ * after a warning, if the query failed.
+ */
+static bool
+ReceivePendingWorkerTransactionList(MultiConnection *connection,
+									List **pendingTransactionList)
+{
+	bool raiseInterrupts = true;
+	PGresult *result = NULL;
+	int rowCount = 0;
+	int rowIndex = 0;
+	List *transactionNames = NIL;
+
 	result = GetRemoteCommandResult(connection, raiseInterrupts);
 	if (!IsResponseOK(result))
 	{
-		ReportResultError(connection, result, ERROR);
+		ReportResultError(connection, result, WARNING);
+		PQclear(result);
+		ForgetResults(connection);
+
+		return false;
 	}
 
 	rowCount = PQntuples(result);
@@ -413,7 +725,9 @@ PendingWorkerTransactionList(MultiConnection *connection)
 	PQclear(result);
 	ForgetResults(connection);
 
-	return transactionNames;
+	*pendingTransactionList = transactionNames;
+
+	return true;
 }
 
 
@@ -469,10 +783,12 @@ UnconfirmedWorkerTransactionsList(int groupId)
 /*
  * DeleteTransactionRecord opens the pg_dist_transaction system catalog, finds the
  * first (unique) row that corresponds to the given transactionName and worker node,
- * and deletes this row.
+ * and deletes this row. If missingOk is true, a missing row is not an error,
+ * since recovery or the maintenance daemon may have deleted it concurrently,
+ * even after this transaction's snapshot was taken.
  */
 static void
-DeleteTransactionRecord(int32 groupId, char *transactionName)
+DeleteTransactionRecord(int32 groupId, char *transactionName, bool missingOk)
 {
 	Relation pgDistTransaction = NULL;
 	SysScanDesc scanDescriptor = NULL;
@@ -481,6 +797,8 @@ DeleteTransactionRecord(int32 groupId, char *transactionName)
 	bool indexOK = true;
 	HeapTuple heapTuple = NULL;
 	bool heapTupleFound = false;
+	HTSU_Result deleteResult = HeapTupleMayBeUpdated;
+	HeapUpdateFailureData failureData;
 
 	pgDistTransaction = heap_open(DistTransactionRelationId(), RowExclusiveLock);
 
@@ -512,6 +830,14 @@ DeleteTransactionRecord(int32 groupId, char *transactionName)
 		heapTuple = systable_getnext(scanDescriptor);
 	}
 
+	if (!heapTupleFound && missingOk)
+	{
+		systable_endscan(scanDescriptor);
+		heap_close(pgDistTransaction, RowExclusiveLock);
+
+		return;
+	}
+
 	/* if we couldn't find the transaction record to delete, error out */
 	if (!heapTupleFound)
 	{
@@ -520,7 +846,18 @@ DeleteTransactionRecord(int32 groupId, char *transactionName)
 							   transactionName, groupId)));
 	}
 
-	simple_heap_delete(pgDistTransaction, &heapTuple->t_self);
+	deleteResult = heap_delete(pgDistTransaction, &heapTuple->t_self,
+							   GetCurrentCommandId(true), InvalidSnapshot, true,
+							   &failureData);
+
+	/* transaction records are never updated, only deleted */
+	if (deleteResult != HeapTupleMayBeUpdated &&
+		!(deleteResult == HeapTupleUpdated && missingOk))
+	{
+		ereport(ERROR, (errmsg("could not delete transaction record '%s' in "
+							   "group %d", transactionName, groupId)));
+	}
+
 	CommandCounterIncrement();
 
 	systable_endscan(scanDescriptor);
@@ -22,6 +22,7 @@
 #include "utils/datum.h"
 #include "utils/lsyscache.h"
 
+static void EvaluateValuesLists(List *valuesLists);
 static Node * PartiallyEvaluateExpression(Node *expression);
 static Node * EvaluateNodeIfReferencesFunction(Node *expression);
 static Node * PartiallyEvaluateExpressionMutator(Node *expression, bool *containsVar);
@@ -53,6 +54,16 @@ RequiresMasterEvaluation(Query *query)
 	{
 		RangeTblEntry *rte = (RangeTblEntry *) lfirst(rteCell);
 
+		if (rte->rtekind == RTE_VALUES)
+		{
+			if (contain_mutable_functions((Node *) rte->values_lists))
+			{
+				return true;
+			}
+
+			continue;
+		}
+
 		if (rte->rtekind != RTE_SUBQUERY)
 		{
 			continue;
@@ -128,6 +139,13 @@ ExecuteMasterEvaluableFunctions(Query *query)
 	{
 		RangeTblEntry *rte = (RangeTblEntry *) lfirst(rteCell);
 
+		if (rte->rtekind == RTE_VALUES)
+		{
+			/* the rows of multi-row INSERTs are evaluated like single-row values */
+			EvaluateValuesLists(rte->values_lists);
+			continue;
+		}
+
 		if (rte->rtekind != RTE_SUBQUERY)
 		{
 			continue;
@@ -145,6 +163,36 @@ ExecuteMasterEvaluableFunctions(Query *query)
 }
 
 
+/*
+ * EvaluateValuesLists evaluates the function calls in each row of a VALUES
+ * list in place. Every row is evaluated separately, so volatile functions
+ * produce a value per row.
+ */
+static void
+EvaluateValuesLists(List *valuesLists)
+{
+	ListCell *valuesListCell = NULL;
+
+	foreach(valuesListCell, valuesLists)
+	{
+		List *rowValues = (List *) lfirst(valuesListCell);
+		ListCell *valueCell = NULL;
+
+		foreach(valueCell, rowValues)
+		{
+			Node *value = (Node *) lfirst(valueCell);
+
+			if (IsA(value, Const) || IsA(value, Var))
+			{
+				continue;
+			}
+
+			lfirst(valueCell) = EvaluateNodeIfReferencesFunction(value);
+		}
+	}
+}
+
+
 /*
  * Walks the expression evaluating any node which invokes a function as long as a Var
  * doesn't show up in the parameter list.
@@ -0,0 +1,628 @@
+/*-------------------------------------------------------------------------
+ *
+ * maintenanced.c
+ *	  Background worker run for each database that uses Citus.
+ *
+ * The first backend that notices Citus is loaded in a database registers a
+ * dynamic background worker, the maintenance daemon, for that database, on
+ * the coordinator and wherever sessions use citus.async_commit_prepared. The
+ * daemon sleeps on its latch, and performs work that doesn't need to delay
+ * the sessions that cause it:
+ *
+ * - Committing the prepared transactions of distributed transactions that
+ *   committed with citus.async_commit_prepared enabled. The sessions queue
+ *   these in shared memory and wake the daemon up.
+ * - Recovering prepared transactions left behind by failures, every
+ *   citus.recover_2pc_interval, on the coordinator.
+ *
+ * Copyright (c) 2017, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "access/xact.h"
+#include "commands/dbcommands.h"
+#include "distributed/maintenanced.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/transaction_recovery.h"
+#include "libpq/pqsignal.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lmgr.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+
+
+/* number of prepared transactions that can be queued for the daemons */
+#define MAX_PENDING_COMMIT_PREPARED 1024
+
+/* time the maintenance daemon sleeps if there's nothing to do */
+#define MAINTENANCE_DAEMON_NAPTIME_MS 5000
+
+
+/*
+ * MaintenanceDaemonControlData contains the state shared between all
+ * maintenance daemons and the backends that start and notify them.
+ */
+typedef struct MaintenanceDaemonControlData
+{
+	/* lock protecting this struct and the database hash */
+	int trancheId;
+	LWLockTranche lockTranche;
+	LWLock lock;
+
+	/* prepared transactions waiting to be committed, of all databases */
+	int pendingCommitCount;
+	PendingCommitPrepared pendingCommits[MAX_PENDING_COMMIT_PREPARED];
+} MaintenanceDaemonControlData;
+
+
+/*
+ * MaintenanceDaemonDBData keeps track of the maintenance daemon of a single
+ * database.
+ */
+typedef struct MaintenanceDaemonDBData
+{
+	/* hash key: database to run on */
+	Oid databaseOid;
+
+	/* information on the worker process, set once it's running */
+	bool daemonStarted;
+	pid_t workerPid;
+	Latch *latch;
+} MaintenanceDaemonDBData;
+
+
+/* config variables managed via guc.c */
+bool AsyncCommitPrepared = false;
+int Recover2PCInterval = 60000;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static MaintenanceDaemonControlData *MaintenanceDaemonControl = NULL;
+static HTAB *MaintenanceDaemonDBHash = NULL;
+
+/* whether this process is a maintenance daemon */
+static bool IsMaintenanceDaemon = false;
+
+/* flags set by interrupt handlers for later service in the main loop */
+static volatile sig_atomic_t got_SIGHUP = false;
+static volatile sig_atomic_t got_SIGTERM = false;
+
+static Size MaintenanceDaemonShmemSize(void);
+static void MaintenanceDaemonShmemInit(void);
+static void MaintenanceDaemonShmemExit(int code, Datum arg);
+static void MaintenanceDaemonSigHupHandler(SIGNAL_ARGS);
+static void MaintenanceDaemonSigTermHandler(SIGNAL_ARGS);
+static List * DequeueCommitPrepared(Oid databaseOid);
+static void RecoverTwoPhaseCommits(void);
+
+
+/*
+ * InitializeMaintenanceDaemon organizes, at startup, that the shared memory
+ * used to coordinate the maintenance daemons is allocated.
+ */
+void
+InitializeMaintenanceDaemon(void)
+{
+	RequestAddinShmemSpace(MaintenanceDaemonShmemSize());
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = MaintenanceDaemonShmemInit;
+}
+
+
+/*
+ * InitializeMaintenanceDaemonBackend, called at backend start once Citus is
+ * known to be loaded, and before committing prepared transactions with
+ * citus.async_commit_prepared, registers the maintenance daemon of the
+ * current database if it isn't running yet. Errors out if there is no
+ * background worker slot left for it.
+ */
+void
+InitializeMaintenanceDaemonBackend(void)
+{
+	MaintenanceDaemonDBData *myDbData = NULL;
+	bool found = false;
+	bool registrationFailed = false;
+
+	if (IsMaintenanceDaemon)
+	{
+		return;
+	}
+
+	/*
+	 * Only the coordinator recovers prepared transactions. Other nodes only
+	 * need the daemon once their sessions commit prepared transactions
+	 * asynchronously, so don't take up a worker slot on them before that.
+	 */
+	if (!AsyncCommitPrepared && GetLocalGroupId() != 0)
+	{
+		return;
+	}
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	myDbData = (MaintenanceDaemonDBData *) hash_search(MaintenanceDaemonDBHash,
+													   &MyDatabaseId,
+													   HASH_ENTER_NULL, &found);
+	if (myDbData == NULL)
+	{
+		LWLockRelease(&MaintenanceDaemonControl->lock);
+
+		ereport(ERROR, (errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+						errmsg("could not start the maintenance daemon of "
+							   "database \"%s\"", get_database_name(MyDatabaseId)),
+						errdetail("Maintenance daemons already run for as many "
+								  "databases as max_worker_processes allows."),
+						errhint("Increase max_worker_processes to leave room for "
+								"one maintenance daemon per database that uses "
+								"Citus.")));
+	}
+
+	if (!found)
+	{
+		myDbData->daemonStarted = false;
+		myDbData->workerPid = 0;
+		myDbData->latch = NULL;
+	}
+
+	if (!myDbData->daemonStarted)
+	{
+		BackgroundWorker worker;
+		BackgroundWorkerHandle *handle = NULL;
+
+		memset(&worker, 0, sizeof(worker));
+		snprintf(worker.bgw_name, BGW_MAXLEN, "Citus Maintenance Daemon: %u",
+				 MyDatabaseId);
+		worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+		worker.bgw_start_time = BgWorkerStart_ConsistentState;
+		worker.bgw_restart_time = 5;
+		snprintf(worker.bgw_library_name, BGW_MAXLEN, "citus");
+		snprintf(worker.bgw_function_name, BGW_MAXLEN, "CitusMaintenanceDaemonMain");
+		worker.bgw_main_arg = ObjectIdGetDatum(MyDatabaseId);
+		worker.bgw_notify_pid = 0;
+
+		if (RegisterDynamicBackgroundWorker(&worker, &handle))
+		{
+			myDbData->daemonStarted = true;
+		}
+		else
+		{
+			registrationFailed = true;
+		}
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	/* the next backend tries again, once a worker slot may be free */
+	if (registrationFailed)
+	{
+		ereport(ERROR, (errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+						errmsg("could not start the maintenance daemon of "
+							   "database \"%s\"", get_database_name(MyDatabaseId)),
+						errdetail("All %d background worker slots allowed by "
+								  "max_worker_processes are in use.",
+								  max_worker_processes),
+						errhint("Increase max_worker_processes to leave room for "
+								"one maintenance daemon per database that uses "
+								"Citus.")));
+	}
+}
+
+
+/*
+ * StopMaintenanceDaemon stops the maintenance daemon of the given database,
+ * which would otherwise prevent dropping the database. The daemon commits
+ * the prepared transactions still queued for it before exiting. If the
+ * database is not dropped after all, the next backend starts a new daemon.
+ */
+void
+StopMaintenanceDaemon(Oid databaseId)
+{
+	MaintenanceDaemonDBData *dbData = NULL;
+	pid_t workerPid = 0;
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	dbData = (MaintenanceDaemonDBData *) hash_search(MaintenanceDaemonDBHash,
+													 &databaseId, HASH_FIND, NULL);
+	if (dbData != NULL)
+	{
+		workerPid = dbData->workerPid;
+
+		hash_search(MaintenanceDaemonDBHash, &databaseId, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	if (workerPid > 0)
+	{
+		kill(workerPid, SIGTERM);
+	}
+}
+
+
+/*
+ * EnqueueCommitPrepared hands committing the prepared transaction on the
+ * given connection over to the maintenance daemon of the current database,
+ * and wakes the daemon up. It is called after the local transaction
+ * committed, so it must not error out. Returns false if the daemon isn't
+ * running or its queue is full, in which case the caller has to commit the
+ * prepared transaction itself.
+ */
+bool
+EnqueueCommitPrepared(MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	MaintenanceDaemonDBData *myDbData = NULL;
+	PendingCommitPrepared *pendingCommit = NULL;
+	bool enqueued = false;
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	myDbData = (MaintenanceDaemonDBData *) hash_search(MaintenanceDaemonDBHash,
+													   &MyDatabaseId, HASH_FIND, NULL);
+	if (myDbData != NULL && myDbData->latch != NULL &&
+		MaintenanceDaemonControl->pendingCommitCount < MAX_PENDING_COMMIT_PREPARED)
+	{
+		pendingCommit = &MaintenanceDaemonControl->pendingCommits[
+			MaintenanceDaemonControl->pendingCommitCount++];
+
+		pendingCommit->databaseOid = MyDatabaseId;
+		strlcpy(pendingCommit->nodeName, connection->hostname, MAX_NODE_LENGTH);
+		pendingCommit->nodePort = connection->port;
+		strlcpy(pendingCommit->userName, connection->user, NAMEDATALEN);
+		strlcpy(pendingCommit->preparedName, transaction->preparedName, NAMEDATALEN);
+
+		SetLatch(myDbData->latch);
+
+		enqueued = true;
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	return enqueued;
+}
+
+
+/*
+ * DequeueCommitPrepared removes the prepared transactions queued for the
+ * given database from shared memory, and returns them as a list.
+ */
+static List *
+DequeueCommitPrepared(Oid databaseOid)
+{
+	List *pendingCommitList = NIL;
+	int pendingIndex = 0;
+	int remainingCount = 0;
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	for (pendingIndex = 0; pendingIndex < MaintenanceDaemonControl->pendingCommitCount;
+		 pendingIndex++)
+	{
+		PendingCommitPrepared *pendingCommit =
+			&MaintenanceDaemonControl->pendingCommits[pendingIndex];
+
+		if (pendingCommit->databaseOid == databaseOid)
+		{
+			PendingCommitPrepared *pendingCommitCopy =
+				(PendingCommitPrepared *) palloc(sizeof(PendingCommitPrepared));
+
+			*pendingCommitCopy = *pendingCommit;
+			pendingCommitList = lappend(pendingCommitList, pendingCommitCopy);
+		}
+		else
+		{
+			MaintenanceDaemonControl->pendingCommits[remainingCount++] = *pendingCommit;
+		}
+	}
+
+	MaintenanceDaemonControl->pendingCommitCount = remainingCount;
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	return pendingCommitList;
+}
+
+
+/*
+ * CitusMaintenanceDaemonMain is the maintenance daemon's main routine, it'll
+ * be started by the background worker infrastructure. If it errors out,
+ * it'll be restarted after a few seconds.
+ */
+void
+CitusMaintenanceDaemonMain(Datum main_arg)
+{
+	Oid databaseOid = DatumGetObjectId(main_arg);
+	MaintenanceDaemonDBData *myDbData = NULL;
+	TimestampTz lastRecoveryTime = 0;
+
+	IsMaintenanceDaemon = true;
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	myDbData = (MaintenanceDaemonDBData *) hash_search(MaintenanceDaemonDBHash,
+													   &databaseOid, HASH_FIND, NULL);
+	if (myDbData == NULL || myDbData->workerPid != 0)
+	{
+		/* the database was dropped, or another daemon is already running */
+		LWLockRelease(&MaintenanceDaemonControl->lock);
+
+		proc_exit(0);
+	}
+
+	myDbData->workerPid = MyProcPid;
+	myDbData->latch = MyLatch;
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	before_shmem_exit(MaintenanceDaemonShmemExit, main_arg);
+
+	/* properly accept or ignore signals the postmaster might send us */
+	pqsignal(SIGHUP, MaintenanceDaemonSigHupHandler);
+	pqsignal(SIGTERM, MaintenanceDaemonSigTermHandler);
+
+	/* we're now ready to receive signals */
+	BackgroundWorkerUnblockSignals();
+
+	/* connect to the database as the bootstrap superuser */
+	BackgroundWorkerInitializeConnectionByOid(databaseOid, InvalidOid);
+
+	/* make the daemon recognizable in pg_stat_activity */
+	pgstat_report_appname("Citus Maintenance Daemon");
+
+	for (;;)
+	{
+		int latchFlags = WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH;
+		long timeout = MAINTENANCE_DAEMON_NAPTIME_MS;
+		bool recoveryDue = false;
+		bool exitRequested = false;
+		int rc = 0;
+
+		CHECK_FOR_INTERRUPTS();
+
+		/* commit the prepared transactions still queued before exiting */
+		exitRequested = got_SIGTERM;
+
+		if (got_SIGHUP)
+		{
+			got_SIGHUP = false;
+
+			/* reload postgres configuration files */
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		if (Recover2PCInterval > 0)
+		{
+			TimestampTz currentTime = GetCurrentTimestamp();
+			TimestampTz nextRecoveryTime = 0;
+			long secondsToRecovery = 0;
+			int microsecondsToRecovery = 0;
+			long millisecondsToRecovery = 0;
+
+			if (TimestampDifferenceExceeds(lastRecoveryTime, currentTime,
+										   Recover2PCInterval))
+			{
+				recoveryDue = true;
+				lastRecoveryTime = currentTime;
+			}
+
+			/* wake up in time for the next recovery */
+			nextRecoveryTime = TimestampTzPlusMilliseconds(lastRecoveryTime,
+														   Recover2PCInterval);
+			TimestampDifference(currentTime, nextRecoveryTime, &secondsToRecovery,
+								&microsecondsToRecovery);
+			millisecondsToRecovery = secondsToRecovery * 1000L +
+									 microsecondsToRecovery / 1000L;
+
+			timeout = Min(timeout, Max(1, millisecondsToRecovery));
+		}
+
+		StartTransactionCommand();
+		PushActiveSnapshot(GetTransactionSnapshot());
+
+		/* the extension may have been dropped since the daemon started */
+		if (CitusHasBeenLoaded())
+		{
+			List *pendingCommitList = DequeueCommitPrepared(databaseOid);
+
+			if (pendingCommitList != NIL)
+			{
+				CommitPreparedTransactionList(pendingCommitList);
+			}
+
+			if (recoveryDue && !exitRequested)
+			{
+				RecoverTwoPhaseCommits();
+			}
+		}
+
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+
+		if (exitRequested)
+		{
+			proc_exit(0);
+		}
+
+		rc = WaitLatch(MyLatch, latchFlags, timeout);
+		ResetLatch(MyLatch);
+
+		/* emergency bailout if postmaster has died */
+		if (rc & WL_POSTMASTER_DEATH)
+		{
+			proc_exit(1);
+		}
+	}
+}
+
+
+/*
+ * RecoverTwoPhaseCommits recovers the prepared transactions this node left
+ * behind on the workers. Only the coordinator starts distributed
+ * transactions whose prepared transactions recovery knows to find. If
+ * recovery is already running in another session, this round is skipped
+ * rather than waited for.
+ */
+static void
+RecoverTwoPhaseCommits(void)
+{
+	if (GetLocalGroupId() != 0)
+	{
+		return;
+	}
+
+	if (!ConditionalLockRelationOid(DistTransactionRelationId(),
+									ShareUpdateExclusiveLock))
+	{
+		return;
+	}
+
+	RecoverPreparedTransactions();
+}
+
+
+/* Estimates the shared memory size used for the maintenance daemons. */
+static Size
+MaintenanceDaemonShmemSize(void)
+{
+	Size size = 0;
+	Size hashSize = 0;
+
+	size = add_size(size, sizeof(MaintenanceDaemonControlData));
+
+	hashSize = hash_estimate_size(max_worker_processes, sizeof(MaintenanceDaemonDBData));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/* Initializes the shared memory used for the maintenance daemons. */
+static void
+MaintenanceDaemonShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL hashInfo;
+	int hashFlags = 0;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	MaintenanceDaemonControl =
+		(MaintenanceDaemonControlData *) ShmemInitStruct("Citus Maintenance Daemon",
+														 sizeof(MaintenanceDaemonControlData),
+														 &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		/* initialize lwlock protecting the daemon state */
+		LWLockTranche *tranche = &MaintenanceDaemonControl->lockTranche;
+
+		MaintenanceDaemonControl->trancheId = LWLockNewTrancheId();
+		tranche->array_base = &MaintenanceDaemonControl->lock;
+		tranche->array_stride = sizeof(LWLock);
+		tranche->name = "Citus Maintenance Daemon Tranche";
+		LWLockRegisterTranche(MaintenanceDaemonControl->trancheId, tranche);
+		LWLockInitialize(&MaintenanceDaemonControl->lock,
+						 MaintenanceDaemonControl->trancheId);
+
+		MaintenanceDaemonControl->pendingCommitCount = 0;
+	}
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(Oid);
+	hashInfo.entrysize = sizeof(MaintenanceDaemonDBData);
+	hashInfo.hash = tag_hash;
+	hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	MaintenanceDaemonDBHash = ShmemInitHash("Citus Maintenance Daemon Hash",
+											max_worker_processes, max_worker_processes,
+											&hashInfo, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * MaintenanceDaemonShmemExit is the before_shmem_exit handler of the
+ * maintenance daemon. After a regular exit the daemon is not restarted, so
+ * the next backend has to register it again. After an error the postmaster
+ * restarts it.
+ */
+static void
+MaintenanceDaemonShmemExit(int code, Datum arg)
+{
+	Oid databaseOid = DatumGetObjectId(arg);
+	MaintenanceDaemonDBData *myDbData = NULL;
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	myDbData = (MaintenanceDaemonDBData *) hash_search(MaintenanceDaemonDBHash,
+													   &databaseOid, HASH_FIND, NULL);
+
+	/* the entry may have been removed, or taken over by a new daemon */
+	if (myDbData != NULL && myDbData->workerPid == MyProcPid)
+	{
+		myDbData->workerPid = 0;
+		myDbData->latch = NULL;
+
+		if (code == 0)
+		{
+			myDbData->daemonStarted = false;
+		}
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+}
+
+
+/* MaintenanceDaemonSigHupHandler sets a flag to re-read config file. */
+static void
+MaintenanceDaemonSigHupHandler(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	got_SIGHUP = true;
+	if (MyProc != NULL)
+	{
+		SetLatch(&MyProc->procLatch);
+	}
+
+	errno = save_errno;
+}
+
+
+/* MaintenanceDaemonSigTermHandler sets a flag to request termination. */
+static void
+MaintenanceDaemonSigTermHandler(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	got_SIGTERM = true;
+	if (MyProc != NULL)
+	{
+		SetLatch(&MyProc->procLatch);
+	}
+
+	errno = save_errno;
+}
@@ -25,13 +25,17 @@
 #include "commands/extension.h"
 #include "commands/trigger.h"
 #include "distributed/colocation_utils.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/maintenanced.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_planner.h"
 #include "distributed/pg_dist_local_group.h"
 #include "distributed/pg_dist_node.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/pg_dist_shard.h"
 #include "distributed/pg_dist_shard_placement.h"
+#include "distributed/remote_commands.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
@@ -964,6 +968,9 @@ CitusHasBeenLoaded(void)
 			 * present during early stages of upgrade operation.
 			 */
 			DistPartitionRelationId();
+
+			/* start the maintenance daemon of this database, if not running yet */
+			InitializeMaintenanceDaemonBackend();
 		}
 	}
 
@@ -1869,6 +1876,10 @@ InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 		{
 			cacheEntry->isValid = false;
 		}
+
+		InvalidateRemotePreparedStatements();
+		InvalidateDeparsedQueryCache();
+		InvalidateMultiPlanCache(InvalidOid);
 	}
 	else
 	{
@@ -1880,6 +1891,11 @@ InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 		if (foundInCache)
 		{
 			cacheEntry->isValid = false;
+
+			/* statements, query strings and plans may refer to the old shards */
+			InvalidateRemotePreparedStatements();
+			InvalidateDeparsedQueryCache();
+			InvalidateMultiPlanCache(relationId);
 		}
 	}
 
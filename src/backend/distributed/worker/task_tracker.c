@@ -3,11 +3,13 @@
  * task_tracker.c
  *
  * The task tracker background process runs on every worker node. The process
- * wakes up at regular intervals, reads information from a shared hash, and
- * checks if any new tasks are assigned to this node. If they are, the process
- * runs task-specific logic, and sends queries to the postmaster for execution.
- * The task tracker then tracks the execution of these queries, and updates the
- * shared hash with task progress information.
+ * wakes up when tasks are assigned to this node, when the local backends
+ * running its tasks send results, or otherwise at regular intervals. It then
+ * reads information from a shared hash, and checks if any new tasks are
+ * assigned to this node. If they are, the process runs task-specific logic,
+ * and sends queries to the postmaster for execution. The task tracker then
+ * tracks the execution of these queries, and updates the shared hash with
+ * task progress information.
  *
  * The task tracker is started by the postmaster when the startup process
  * finishes. The process remains alive until the postmaster commands it to
@@ -50,13 +52,17 @@
 #include "utils/memutils.h"
 
 
-int TaskTrackerDelay = 200;       /* process sleep interval in millisecs */
+int TaskTrackerDelay = 200;       /* max process sleep interval in millisecs */
 int MaxRunningTasksPerNode = 16;  /* max number of running tasks */
 int MaxTrackedTasksPerNode = 1024; /* max number of tracked tasks */
+int MaxTaskStringMemory = -1;     /* task call string memory in kilobytes */
 WorkerTasksSharedStateData *WorkerTasksSharedState; /* shared memory state */
 
 static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 
+/* sockets of the local backends running tasks, to wait for their results */
+static WaitInfo *TrackerWaitInfo = NULL;
+
 /* Flags set by interrupt handlers for later service in the main loop */
 static volatile sig_atomic_t got_SIGHUP = false;
 static volatile sig_atomic_t got_SIGTERM = false;
@@ -64,6 +70,8 @@ static volatile sig_atomic_t got_SIGTERM = false;
 /* initialization forward declarations */
 static void TaskTrackerMain(Datum main_arg);
 static Size TaskTrackerShmemSize(void);
+static int32 TaskCallStringBlockCount(void);
+static Size TaskCallStringArenaSize(void);
 static void TaskTrackerShmemInit(void);
 
 /* Signal handler forward declarations */
@@ -75,7 +83,7 @@ static void TrackerCleanupJobDirectories(void);
 static void TrackerCleanupJobSchemas(void);
 static void TrackerCleanupConnections(HTAB *WorkerTasksHash);
 static void TrackerRegisterShutDown(HTAB *WorkerTasksHash);
-static void TrackerDelayLoop(void);
+static void TrackerWait(WaitInfo *waitInfo, bool tasksNeedAttention);
 static List * SchedulableTaskList(HTAB *WorkerTasksHash);
 static WorkerTask * SchedulableTaskPriorityQueue(HTAB *WorkerTasksHash);
 static uint32 CountTasksMatchingCriteria(HTAB *WorkerTasksHash,
@@ -84,11 +92,12 @@ static bool RunningTask(WorkerTask *workerTask);
 static bool SchedulableTask(WorkerTask *workerTask);
 static int CompareTasksByTime(const void *first, const void *second);
 static void ScheduleWorkerTasks(HTAB *WorkerTasksHash, List *schedulableTaskList);
-static void ManageWorkerTasksHash(HTAB *WorkerTasksHash);
+static bool ManageWorkerTasksHash(HTAB *WorkerTasksHash, WaitInfo *waitInfo);
 static void ManageWorkerTask(WorkerTask *workerTask, HTAB *WorkerTasksHash);
 static void RemoveWorkerTask(WorkerTask *workerTask, HTAB *WorkerTasksHash);
 static void CreateJobDirectoryIfNotExists(uint64 jobId);
 static int32 ConnectToLocalBackend(const char *databaseName, const char *userName);
+static int32 AllocateTaskCallStringBlocks(int32 blockCount);
 
 
 /* Organize, at startup, that the task tracker is started */
@@ -131,6 +140,9 @@ TaskTrackerMain(Datum main_arg)
 	/* We're now ready to receive signals */
 	BackgroundWorkerUnblockSignals();
 
+	/* let task assignments wake us up */
+	WorkerTasksSharedState->taskTrackerLatch = MyLatch;
+
 	/*
 	 * Create a memory context that we will do all our work in.  We do this so
 	 * that we can reset the context during error recovery and thereby avoid
@@ -182,6 +194,9 @@ TaskTrackerMain(Datum main_arg)
 		/* Flush any leaked data in the top-level context */
 		MemoryContextResetAndDeleteChildren(TaskTrackerContext);
 
+		/* the wait info was released with the context; connections are kept */
+		TrackerWaitInfo = NULL;
+
 		/* Now we can allow interrupts again */
 		RESUME_INTERRUPTS();
 
@@ -211,17 +226,19 @@ TaskTrackerMain(Datum main_arg)
 		TrackerCleanupJobSchemas();
 	}
 
+	if (TrackerWaitInfo == NULL)
+	{
+		TrackerWaitInfo = MultiClientCreateWaitInfo(MAX_CONNECTION_COUNT);
+	}
+
 	/* Loop forever */
 	for (;;)
 	{
+		bool tasksNeedAttention = false;
+
 		/*
 		 * Emergency bailout if postmaster has died. This is to avoid the
 		 * necessity for manual cleanup of all postmaster children.
-		 *
-		 * XXX: Note that PostgreSQL background processes no longer nap between
-		 * their loops, but instead uses latches to wake up when necessary. We
-		 * should switch to using latches in here too, and have the task tracker
-		 * assign function notify us when there is a new task.
 		 */
 		if (!PostmasterIsAlive())
 		{
@@ -255,10 +272,11 @@ TaskTrackerMain(Datum main_arg)
 		}
 
 		/* Call the function that does the actual work */
-		ManageWorkerTasksHash(WorkerTasksSharedState->taskHash);
+		tasksNeedAttention = ManageWorkerTasksHash(WorkerTasksSharedState->taskHash,
+												   TrackerWaitInfo);
 
-		/* Sleep for the configured time */
-		TrackerDelayLoop();
+		/* Sleep until there is something to do */
+		TrackerWait(TrackerWaitInfo, tasksNeedAttention);
 	}
 }
 
@@ -297,6 +315,10 @@ WorkerTasksHashEnter(uint64 jobId, uint32 taskId)
 								  jobId, taskId)));
 	}
 
+	workerTask->taskCallStringBlock = INVALID_TASK_CALL_STRING_BLOCK;
+	workerTask->taskCallStringLength = 0;
+	MarkTaskStatusChanged(workerTask);
+
 	return workerTask;
 }
 
@@ -324,6 +346,166 @@ WorkerTasksHashFind(uint64 jobId, uint32 taskId)
 }
 
 
+/*
+ * SetTaskCallString copies the given query or function call string into the
+ * string arena, and makes it the worker task's call string, releasing its
+ * previous one. If the arena doesn't have enough room left, the function
+ * leaves the task unchanged and returns false. Note that the caller needs to
+ * hold an exclusive lock over the shared hash.
+ */
+bool
+SetTaskCallString(WorkerTask *workerTask, const char *taskCallString)
+{
+	uint32 taskCallStringLength = strlen(taskCallString);
+	int32 blockCount = (taskCallStringLength + TASK_CALL_STRING_BLOCK_SIZE) /
+					   TASK_CALL_STRING_BLOCK_SIZE;
+	int32 firstBlock = INVALID_TASK_CALL_STRING_BLOCK;
+	char *arenaString = NULL;
+
+	Assert(taskCallStringLength < TASK_CALL_STRING_SIZE);
+
+	firstBlock = AllocateTaskCallStringBlocks(blockCount);
+	if (firstBlock == INVALID_TASK_CALL_STRING_BLOCK)
+	{
+		return false;
+	}
+
+	FreeTaskCallString(workerTask);
+
+	arenaString = WorkerTasksSharedState->taskCallStringArena +
+				  ((Size) firstBlock * TASK_CALL_STRING_BLOCK_SIZE);
+	memcpy(arenaString, taskCallString, taskCallStringLength + 1);
+
+	workerTask->taskCallStringBlock = firstBlock;
+	workerTask->taskCallStringLength = taskCallStringLength;
+
+	return true;
+}
+
+
+/*
+ * TaskCallString returns the worker task's query or function call string. The
+ * string lives in shared memory, and stays valid only as long as the caller
+ * holds a lock over the shared hash.
+ */
+char *
+TaskCallString(WorkerTask *workerTask)
+{
+	Assert(workerTask->taskCallStringBlock != INVALID_TASK_CALL_STRING_BLOCK);
+
+	return WorkerTasksSharedState->taskCallStringArena +
+		   ((Size) workerTask->taskCallStringBlock * TASK_CALL_STRING_BLOCK_SIZE);
+}
+
+
+/*
+ * FreeTaskCallString returns the blocks of the worker task's call string to
+ * the string arena. Tasks need to release their call string this way before
+ * they are removed from the shared hash. Note that the caller needs to hold an
+ * exclusive lock over the shared hash.
+ */
+void
+FreeTaskCallString(WorkerTask *workerTask)
+{
+	int32 firstBlock = workerTask->taskCallStringBlock;
+	int32 blockCount = 0;
+	int32 blockIndex = 0;
+
+	if (firstBlock == INVALID_TASK_CALL_STRING_BLOCK)
+	{
+		return;
+	}
+
+	blockCount = (workerTask->taskCallStringLength + TASK_CALL_STRING_BLOCK_SIZE) /
+				 TASK_CALL_STRING_BLOCK_SIZE;
+
+	for (blockIndex = firstBlock; blockIndex < firstBlock + blockCount; blockIndex++)
+	{
+		WorkerTasksSharedState->taskCallStringBlockUsed[blockIndex] = false;
+	}
+
+	workerTask->taskCallStringBlock = INVALID_TASK_CALL_STRING_BLOCK;
+	workerTask->taskCallStringLength = 0;
+}
+
+
+/*
+ * MarkTaskStatusChanged gives the worker task's current status a new version,
+ * so that the master node picks it up the next time it asks for the statuses
+ * that changed. Callers need to call this function whenever they change a
+ * task's status, while they hold an exclusive lock over the shared hash.
+ */
+void
+MarkTaskStatusChanged(WorkerTask *workerTask)
+{
+	WorkerTasksSharedState->taskStatusVersion++;
+	workerTask->statusVersion = WorkerTasksSharedState->taskStatusVersion;
+}
+
+
+/*
+ * AllocateTaskCallStringBlocks finds blockCount consecutive free blocks in the
+ * string arena, marks them as used, and returns the first one's index. The
+ * search starts where the previous one left off, and wraps around to the
+ * start of the arena once. If no such blocks are free, the function returns
+ * INVALID_TASK_CALL_STRING_BLOCK.
+ */
+static int32
+AllocateTaskCallStringBlocks(int32 blockCount)
+{
+	bool *blockUsed = WorkerTasksSharedState->taskCallStringBlockUsed;
+	int32 totalBlockCount = WorkerTasksSharedState->taskCallStringBlockCount;
+	int32 searchStart = WorkerTasksSharedState->taskCallStringNextBlock;
+	int32 firstBlock = INVALID_TASK_CALL_STRING_BLOCK;
+	int32 passIndex = 0;
+
+	for (passIndex = 0; passIndex < 2 && firstBlock < 0; passIndex++)
+	{
+		int32 blockIndex = (passIndex == 0) ? searchStart : 0;
+		int32 searchEnd = (passIndex == 0) ? totalBlockCount :
+						  Min(searchStart + blockCount - 1, totalBlockCount);
+		int32 runStart = blockIndex;
+		int32 runLength = 0;
+
+		for (; blockIndex < searchEnd; blockIndex++)
+		{
+			if (blockUsed[blockIndex])
+			{
+				runLength = 0;
+				continue;
+			}
+
+			if (runLength == 0)
+			{
+				runStart = blockIndex;
+			}
+
+			runLength++;
+			if (runLength == blockCount)
+			{
+				firstBlock = runStart;
+				break;
+			}
+		}
+	}
+
+	if (firstBlock >= 0)
+	{
+		int32 blockIndex = 0;
+
+		for (blockIndex = firstBlock; blockIndex < firstBlock + blockCount; blockIndex++)
+		{
+			blockUsed[blockIndex] = true;
+		}
+
+		WorkerTasksSharedState->taskCallStringNextBlock =
+			(firstBlock + blockCount) % totalBlockCount;
+	}
+
+	return firstBlock;
+}
+
+
 /*
  * TrackerCleanupJobDirectories cleans up all files in the job cache directory
  * as part of this process's start-up logic. The task tracker process manages
@@ -390,7 +572,14 @@ TrackerCleanupJobSchemas(void)
 		cleanupTask->assignedAt = HIGH_PRIORITY_TASK_TIME;
 		cleanupTask->taskStatus = TASK_ASSIGNED;
 
-		strlcpy(cleanupTask->taskCallString, JOB_SCHEMA_CLEANUP, TASK_CALL_STRING_SIZE);
+		if (!SetTaskCallString(cleanupTask, JOB_SCHEMA_CLEANUP))
+		{
+			RemoveWorkerTask(cleanupTask, WorkerTasksSharedState->taskHash);
+			ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+							errmsg("out of shared memory for task call strings"),
+							errhint("Try increasing citus.max_task_string_memory.")));
+		}
+
 		strlcpy(cleanupTask->databaseName, databaseName, NAMEDATALEN);
 
 		/* zero out all other fields */
@@ -454,35 +643,51 @@ TrackerRegisterShutDown(HTAB *WorkerTasksHash)
 	shutdownMarkerTask->taskStatus = TASK_SUCCEEDED;
 	shutdownMarkerTask->connectionId = INVALID_CONNECTION_ID;
 
+	WorkerTasksSharedState->taskTrackerLatch = NULL;
+
 	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
 }
 
 
-/* Sleeps either for the configured time or until a signal is received. */
+/*
+ * WakeupTaskTracker wakes up the task tracker, if it is running, so that it
+ * doesn't wait for the end of its current nap to look at the shared hash.
+ */
+void
+WakeupTaskTracker(void)
+{
+	Latch *taskTrackerLatch = WorkerTasksSharedState->taskTrackerLatch;
+
+	if (taskTrackerLatch != NULL)
+	{
+		SetLatch(taskTrackerLatch);
+	}
+}
+
+
+/*
+ * TrackerWait sleeps until a local backend running a task sends data, the
+ * task tracker is woken up by a task assignment or a signal, or the configured
+ * time passes. If tasks need attention right away, the function only checks
+ * the backends' sockets without sleeping.
+ */
 static void
-TrackerDelayLoop(void)
+TrackerWait(WaitInfo *waitInfo, bool tasksNeedAttention)
 {
-	const long SignalCheckInterval = 1000000L; /* check signal every second */
+	long timeout = TaskTrackerDelay;
 
-	/*
-	 * On some platforms, signals do not interrupt the sleep. To ensure we
-	 * respond promptly when someone signals us, we break down the sleep into
-	 * 1-second increments, and check for interrupts after each nap.
-	 */
-	long trackerDelay = TaskTrackerDelay * 1000L;
-	while (trackerDelay > (SignalCheckInterval - 1))
+	if (got_SIGHUP || got_SIGTERM)
 	{
-		if (got_SIGHUP || got_SIGTERM)
-		{
-			break;
-		}
-		pg_usleep(SignalCheckInterval);
-		trackerDelay -= SignalCheckInterval;
+		return;
 	}
-	if (!(got_SIGHUP || got_SIGTERM))
+
+	if (tasksNeedAttention)
 	{
-		pg_usleep(trackerDelay);
+		timeout = 0;
 	}
+
+	MultiClientResetWaitInfo(waitInfo);
+	MultiClientWaitWithTimeout(waitInfo, timeout);
 }
 
 
@@ -535,10 +740,45 @@ TaskTrackerShmemSize(void)
 	hashSize = hash_estimate_size(MaxTrackedTasksPerNode, sizeof(WorkerTask));
 	size = add_size(size, hashSize);
 
+	size = add_size(size, TaskCallStringArenaSize());
+	size = add_size(size, mul_size(TaskCallStringBlockCount(), sizeof(bool)));
+
 	return size;
 }
 
 
+/*
+ * TaskCallStringBlockCount returns the number of blocks in the string arena,
+ * as configured by citus.max_task_string_memory. By default, the arena fits
+ * a call string of the maximum length for each tracked task.
+ */
+static int32
+TaskCallStringBlockCount(void)
+{
+	Size arenaSize = 0;
+
+	if (MaxTaskStringMemory == -1)
+	{
+		arenaSize = mul_size(MaxTrackedTasksPerNode, TASK_CALL_STRING_SIZE);
+	}
+	else
+	{
+		arenaSize = (Size) MaxTaskStringMemory * 1024L;
+	}
+
+	/* block indexes are int32, shared memory runs out long before that */
+	return (int32) Min(arenaSize / TASK_CALL_STRING_BLOCK_SIZE, (Size) PG_INT32_MAX);
+}
+
+
+/* Returns the size of the string arena holding the tasks' call strings. */
+static Size
+TaskCallStringArenaSize(void)
+{
+	return mul_size(TaskCallStringBlockCount(), TASK_CALL_STRING_BLOCK_SIZE);
+}
+
+
 /* Initializes the shared memory used for keeping track of tasks. */
 static void
 TaskTrackerShmemInit(void)
@@ -588,6 +828,27 @@ TaskTrackerShmemInit(void)
 		LWLockRegisterTranche(WorkerTasksSharedState->taskHashTrancheId, tranche);
 		LWLockInitialize(&WorkerTasksSharedState->taskHashLock,
 						 WorkerTasksSharedState->taskHashTrancheId);
+
+		WorkerTasksSharedState->taskTrackerLatch = NULL;
+		WorkerTasksSharedState->taskStatusVersion = 0;
+
+		/* allocate the string arena, with all blocks free */
+		WorkerTasksSharedState->taskCallStringBlockCount = TaskCallStringBlockCount();
+		WorkerTasksSharedState->taskCallStringNextBlock = 0;
+		WorkerTasksSharedState->taskCallStringArena =
+			(char *) ShmemAlloc(TaskCallStringArenaSize());
+		WorkerTasksSharedState->taskCallStringBlockUsed =
+			(bool *) ShmemAlloc(TaskCallStringBlockCount() * sizeof(bool));
+
+		if (WorkerTasksSharedState->taskCallStringArena == NULL ||
+			WorkerTasksSharedState->taskCallStringBlockUsed == NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+							errmsg("out of shared memory")));
+		}
+
+		memset(WorkerTasksSharedState->taskCallStringBlockUsed, 0,
+			   TaskCallStringBlockCount() * sizeof(bool));
 	}
 
 	/*  allocate hash table */
@@ -823,6 +1084,7 @@ ScheduleWorkerTasks(HTAB *WorkerTasksHash, List *schedulableTaskList)
 			Assert(SchedulableTask(taskToSchedule));
 
 			taskToSchedule->taskStatus = TASK_SCHEDULED;
+			MarkTaskStatusChanged(taskToSchedule);
 		}
 		else
 		{
@@ -834,13 +1096,20 @@ ScheduleWorkerTasks(HTAB *WorkerTasksHash, List *schedulableTaskList)
 }
 
 
-/* Manages the scheduling and execution of all tasks in the shared hash. */
-static void
-ManageWorkerTasksHash(HTAB *WorkerTasksHash)
+/*
+ * ManageWorkerTasksHash manages the scheduling and execution of all tasks in
+ * the shared hash. The connections of tasks that wait for their local backend
+ * are registered with waitInfo, others are unregistered. The function returns
+ * whether any task should be looked at again without waiting, because it
+ * failed or because it finished and freed up room for another task.
+ */
+static bool
+ManageWorkerTasksHash(HTAB *WorkerTasksHash, WaitInfo *waitInfo)
 {
 	HASH_SEQ_STATUS status;
 	List *schedulableTaskList = NIL;
 	WorkerTask *currentTask = NULL;
+	bool tasksNeedAttention = false;
 
 	/* ask the scheduler if we have new tasks to schedule */
 	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_SHARED);
@@ -862,8 +1131,37 @@ ManageWorkerTasksHash(HTAB *WorkerTasksHash)
 	currentTask = (WorkerTask *) hash_seq_search(&status);
 	while (currentTask != NULL)
 	{
+		int32 previousConnectionId = currentTask->connectionId;
+		TaskStatus previousStatus = currentTask->taskStatus;
+
 		ManageWorkerTask(currentTask, WorkerTasksHash);
 
+		if (currentTask->taskStatus != previousStatus)
+		{
+			MarkTaskStatusChanged(currentTask);
+		}
+
+		if (previousConnectionId != INVALID_CONNECTION_ID &&
+			previousConnectionId != currentTask->connectionId)
+		{
+			MultiClientUnregisterWait(waitInfo, previousConnectionId);
+		}
+
+		/* running and canceled tasks wait for their backend to respond */
+		if (currentTask->connectionId != INVALID_CONNECTION_ID &&
+			(currentTask->taskStatus == TASK_RUNNING ||
+			 currentTask->taskStatus == TASK_CANCELED))
+		{
+			MultiClientRegisterWait(waitInfo, TASK_STATUS_SOCKET_READ,
+									currentTask->connectionId);
+		}
+
+		if (currentTask->taskStatus == TASK_FAILED ||
+			(previousStatus == TASK_RUNNING && currentTask->taskStatus != TASK_RUNNING))
+		{
+			tasksNeedAttention = true;
+		}
+
 		/*
 		 * Typically, we delete worker tasks in the task tracker protocol
 		 * process. This task however was canceled mid-query, and the protocol
@@ -878,6 +1176,8 @@ ManageWorkerTasksHash(HTAB *WorkerTasksHash)
 	}
 
 	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+
+	return tasksNeedAttention;
 }
 
 
@@ -909,7 +1209,7 @@ ManageWorkerTask(WorkerTask *workerTask, HTAB *WorkerTasksHash)
 			if (workerTask->connectionId != INVALID_CONNECTION_ID)
 			{
 				bool taskSent = MultiClientSendQuery(workerTask->connectionId,
-													 workerTask->taskCallString);
+													 TaskCallString(workerTask));
 				if (taskSent)
 				{
 					workerTask->taskStatus = TASK_RUNNING;
@@ -1055,8 +1355,11 @@ static void
 RemoveWorkerTask(WorkerTask *workerTask, HTAB *WorkerTasksHash)
 {
 	void *hashKey = (void *) workerTask;
+	WorkerTask *taskRemoved = NULL;
+
+	FreeTaskCallString(workerTask);
 
-	WorkerTask *taskRemoved = hash_search(WorkerTasksHash, hashKey, HASH_REMOVE, NULL);
+	taskRemoved = hash_search(WorkerTasksHash, hashKey, HASH_REMOVE, NULL);
 	if (taskRemoved == NULL)
 	{
 		ereport(FATAL, (errmsg("worker task hash corrupted")));
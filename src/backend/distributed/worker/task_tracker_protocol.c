@@ -32,6 +32,10 @@
 #include "storage/lwlock.h"
 #include "storage/pmsignal.h"
 #include "utils/builtins.h"
+#include "utils/tuplestore.h"
+
+
+#define TASK_STATUS_CHANGES_COLUMNS 4
 
 
 /* Local functions forward declarations */
@@ -45,6 +49,7 @@ static void CleanupTask(WorkerTask *workerTask);
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(task_tracker_assign_task);
 PG_FUNCTION_INFO_V1(task_tracker_task_status);
+PG_FUNCTION_INFO_V1(task_tracker_task_status_changes);
 PG_FUNCTION_INFO_V1(task_tracker_cleanup_job);
 
 
@@ -115,6 +120,9 @@ task_tracker_assign_task(PG_FUNCTION_ARGS)
 
 	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
 
+	/* have the task tracker schedule the task right away */
+	WakeupTaskTracker();
+
 	PG_RETURN_VOID();
 }
 
@@ -156,6 +164,110 @@ task_tracker_task_status(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * task_tracker_task_status_changes returns the job id, task id, status, and
+ * status version of all tasks of the given jobs whose status changed after the
+ * given version. The master node passes the highest version it has seen so far,
+ * and can thereby check the statuses of all its tasks with a single query.
+ */
+Datum
+task_tracker_task_status_changes(PG_FUNCTION_ARGS)
+{
+	ArrayType *jobIdArrayObject = PG_GETARG_ARRAYTYPE_P(0);
+	uint64 sinceVersion = (uint64) PG_GETARG_INT64(1);
+
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext perQueryContext = NULL;
+	MemoryContext oldContext = NULL;
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = NULL;
+	HASH_SEQ_STATUS status;
+	WorkerTask *currentTask = NULL;
+	bool randomAccess = true;
+	bool interTransactions = false;
+
+	Datum *jobIdDatumArray = DeconstructArrayObject(jobIdArrayObject);
+	int32 jobIdCount = ArrayObjectCount(jobIdArrayObject);
+
+	bool taskTrackerRunning = TaskTrackerRunning();
+	if (!taskTrackerRunning)
+	{
+		ereport(ERROR, (errcode(ERRCODE_CANNOT_CONNECT_NOW),
+						errmsg("the task tracker has been disabled or shut down")));
+	}
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (!rsinfo || !(rsinfo->allowedModes & SFRM_Materialize))
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not "
+						"allowed in this context")));
+	}
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		ereport(ERROR, (errmsg("return type must be a row type")));
+	}
+
+	perQueryContext = rsinfo->econtext->ecxt_per_query_memory;
+	oldContext = MemoryContextSwitchTo(perQueryContext);
+
+	tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
+	tupleStore = tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+
+	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_SHARED);
+
+	hash_seq_init(&status, WorkerTasksSharedState->taskHash);
+	while ((currentTask = (WorkerTask *) hash_seq_search(&status)) != NULL)
+	{
+		Datum values[TASK_STATUS_CHANGES_COLUMNS];
+		bool isNulls[TASK_STATUS_CHANGES_COLUMNS];
+		bool jobRequested = false;
+		int32 jobIdIndex = 0;
+
+		if (currentTask->statusVersion <= sinceVersion)
+		{
+			continue;
+		}
+
+		for (jobIdIndex = 0; jobIdIndex < jobIdCount; jobIdIndex++)
+		{
+			uint64 jobId = (uint64) DatumGetInt64(jobIdDatumArray[jobIdIndex]);
+			if (currentTask->jobId == jobId)
+			{
+				jobRequested = true;
+				break;
+			}
+		}
+
+		if (!jobRequested)
+		{
+			continue;
+		}
+
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = Int64GetDatum(currentTask->jobId);
+		values[1] = UInt32GetDatum(currentTask->taskId);
+		values[2] = UInt32GetDatum((uint32) currentTask->taskStatus);
+		values[3] = Int64GetDatum(currentTask->statusVersion);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupleStore;
+	rsinfo->setDesc = tupleDescriptor;
+
+	MemoryContextSwitchTo(oldContext);
+
+	PG_RETURN_VOID();
+}
+
+
 /*
  * task_tracker_cleanup_job finds all tasks for the given job, and cleans up
  * files, connections, and shared hash enties associated with these tasks.
@@ -191,6 +303,9 @@ task_tracker_cleanup_job(PG_FUNCTION_ARGS)
 
 	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
 
+	/* have the task tracker cancel the job's running tasks right away */
+	WakeupTaskTracker();
+
 	/*
 	 * We then delete the job directory and schema, if they exist. This cleans
 	 * up all intermediate files and tables allocated for the job. Note that the
@@ -316,7 +431,16 @@ CreateTask(uint64 jobId, uint32 taskId, char *taskCallString)
 	/* enter the worker task into shared hash and initialize the task */
 	workerTask = WorkerTasksHashEnter(jobId, taskId);
 	workerTask->assignedAt = assignmentTime;
-	strlcpy(workerTask->taskCallString, taskCallString, TASK_CALL_STRING_SIZE);
+
+	if (!SetTaskCallString(workerTask, taskCallString))
+	{
+		hash_search(WorkerTasksSharedState->taskHash, (void *) workerTask,
+					HASH_REMOVE, NULL);
+
+		ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+						errmsg("out of shared memory for task call strings"),
+						errhint("Try increasing citus.max_task_string_memory.")));
+	}
 
 	workerTask->taskStatus = TASK_ASSIGNED;
 	workerTask->connectionId = INVALID_CONNECTION_ID;
@@ -351,17 +475,28 @@ UpdateTask(WorkerTask *workerTask, char *taskCallString)
 	{
 		/* nothing to do */
 	}
-	else if (taskStatus == TASK_PERMANENTLY_FAILED)
-	{
-		strlcpy(workerTask->taskCallString, taskCallString, TASK_CALL_STRING_SIZE);
-		workerTask->failureCount = 0;
-		workerTask->taskStatus = TASK_ASSIGNED;
-	}
 	else
 	{
-		strlcpy(workerTask->taskCallString, taskCallString, TASK_CALL_STRING_SIZE);
+		if (!SetTaskCallString(workerTask, taskCallString))
+		{
+			ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+							errmsg("out of shared memory for task call strings"),
+							errhint("Try increasing citus.max_task_string_memory.")));
+		}
+
 		workerTask->failureCount = 0;
+
+		if (taskStatus == TASK_PERMANENTLY_FAILED)
+		{
+			workerTask->taskStatus = TASK_ASSIGNED;
+		}
 	}
+
+	/*
+	 * The master node assumes the task to be assigned after this call. We
+	 * therefore report the task's actual status again, even if it is unchanged.
+	 */
+	MarkTaskStatusChanged(workerTask);
 }
 
 
@@ -392,10 +527,13 @@ CleanupTask(WorkerTask *workerTask)
 								   workerTask->jobId, workerTask->taskId)));
 
 		workerTask->taskStatus = TASK_CANCEL_REQUESTED;
+		MarkTaskStatusChanged(workerTask);
 		return;
 	}
 
 	/* remove the task from the shared hash */
+	FreeTaskCallString(workerTask);
+
 	taskRemoved = hash_search(WorkerTasksSharedState->taskHash, hashKey, HASH_REMOVE,
 							  NULL);
 	if (taskRemoved == NULL)
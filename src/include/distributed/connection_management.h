@@ -64,6 +64,12 @@ typedef struct MultiConnection
 	/* time connection establishment was started, for timeout */
 	TimestampTz connectionStart;
 
+	/* is the connection accounted for in the shared connection statistics */
+	bool sharedStatsCounted;
+
+	/* is the connection kept open between transactions, as part of the pool */
+	bool idleInSharedPool;
+
 	/* membership in list of list of connections in ConnectionHashEntry */
 	dlist_node connectionNode;
 
@@ -75,6 +81,14 @@ typedef struct MultiConnection
 
 	/* list of all placements referenced by this connection */
 	dlist_head referencedPlacements;
+
+	/* named statements prepared on the connection, keyed by query string */
+	HTAB *preparedStatementHash;
+	struct MemoryContextData *preparedStatementContext;
+	uint64 preparedStatementGeneration;
+
+	/* cache key of the statement whose PREPARE is still in flight, if any */
+	char *pendingPreparedStatementKey;
 } MultiConnection;
 
 
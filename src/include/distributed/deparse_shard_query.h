@@ -20,7 +20,20 @@
 #include "nodes/pg_list.h"
 
 
+/* maximum number of plans whose rebuilt query strings are cached */
+#define MAX_DEPARSED_QUERY_CACHE_ENTRIES 1024
+
+/* consecutive misses after which a plan's query strings are no longer cached */
+#define MAX_DEPARSED_QUERY_CACHE_MISSES 3
+
+/* uncached executions after which caching a plan's query strings is retried */
+#define DEPARSED_QUERY_CACHE_RETRY_INTERVAL 64
+
+
 extern void RebuildQueryStrings(Query *originalQuery, List *taskList);
+extern void RebuildQueryStringsCached(uint64 planId, Query *originalQuery,
+									  List *taskList);
+extern void InvalidateDeparsedQueryCache(void);
 extern bool UpdateRelationToShardNames(Node *node, List *relationShardList);
 
 
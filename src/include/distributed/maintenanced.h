@@ -0,0 +1,43 @@
+/*-------------------------------------------------------------------------
+ *
+ * maintenanced.h
+ *	  Background worker run for each database that uses Citus.
+ *
+ * Copyright (c) 2017, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef MAINTENANCED_H
+#define MAINTENANCED_H
+
+#include "distributed/connection_management.h"
+
+
+/*
+ * PendingCommitPrepared describes a prepared transaction of a committed
+ * distributed transaction, that the maintenance daemon is to commit.
+ */
+typedef struct PendingCommitPrepared
+{
+	Oid databaseOid;
+	char nodeName[MAX_NODE_LENGTH];
+	int32 nodePort;
+	char userName[NAMEDATALEN];
+	char preparedName[NAMEDATALEN];
+} PendingCommitPrepared;
+
+
+/* config variables managed via guc.c */
+extern bool AsyncCommitPrepared;
+extern int Recover2PCInterval;
+
+
+extern void InitializeMaintenanceDaemon(void);
+extern void InitializeMaintenanceDaemonBackend(void);
+extern void StopMaintenanceDaemon(Oid databaseId);
+extern bool EnqueueCommitPrepared(MultiConnection *connection);
+extern void CitusMaintenanceDaemonMain(Datum main_arg);
+
+
+#endif /* MAINTENANCED_H */
@@ -83,17 +83,78 @@ typedef enum TaskExecutionStatus
 
 
 struct pollfd; /* forward declared, to avoid having to include poll.h */
+struct WaitEventSet; /* forward declared, to avoid having to include latch.h */
+struct WaitEvent;
+struct MemoryContextData;
+struct AttInMetadata;
+struct Tuplestorestate;
 
+
+/* ConnectionWaiter tracks what one registered connection is waiting for */
+typedef struct ConnectionWaiter
+{
+	TaskExecutionStatus waitStatus;
+	int waiterIndex;   /* position in WaitInfo's waiter list, or -1 */
+	int socket;
+	uint32 waitEvents; /* socket events we last listened for */
+	int eventPosition; /* position in the wait event set, or -1 */
+	bool ready;
+} ConnectionWaiter;
+
+
+/*
+ * WaitInfo keeps a registry of the connections an executor waits on. The
+ * registry persists for a whole job, so that between two waits only the
+ * connections whose wait condition changed need to be touched, and a wait
+ * reports back which connections actually became ready. On PostgreSQL 9.6
+ * the registry is backed by a WaitEventSet (and thus epoll where available);
+ * on older versions the poll() array is rebuilt from it before each wait.
+ */
 typedef struct WaitInfo
 {
 	int maxWaiters;
-	struct pollfd *pollfds;
 	int registeredWaiters;
 	bool haveReadyWaiter;
 	bool haveFailedWaiter;
+
+	/* registered connection state, indexed by connection id */
+	ConnectionWaiter *connectionWaiters;
+	int32 *waiterConnectionIds;
+
+	/* connections reported as ready by the most recent wait */
+	int32 *readyConnectionIds;
+	int readyConnectionCount;
+	bool processAllWaiters;
+
+	/* set if sockets were replaced or removed since the last wait */
+	bool waitersChanged;
+
+	struct pollfd *pollfds;
+	struct WaitEventSet *waitEventSet;
+	struct WaitEvent *occurredEvents;
+	int waitEventSetSize;
+	int waitEventCount;
+
+	struct MemoryContextData *memoryContext;
+	MemoryContextCallback cleanupCallback;
 } WaitInfo;
 
 
+/*
+ * TupleDestination describes where MultiClientReceiveTuples() stores the rows
+ * it reads from a connection. Tuples are built using the attribute input
+ * metadata, and appended to the tuple store. The tuple context is reset after
+ * each tuple, so that leaks in type input functions don't accumulate.
+ */
+typedef struct TupleDestination
+{
+	struct AttInMetadata *attributeInputMetadata;
+	struct Tuplestorestate *tupleStore;
+	struct MemoryContextData *tupleContext;
+	uint64 tupleCount;   /* number of tuples stored so far */
+} TupleDestination;
+
+
 /* Function declarations for executing client-side (libpq) logic. */
 extern int32 MultiClientConnect(const char *nodeName, uint32 nodePort,
 								const char *nodeDatabase, const char *nodeUser);
@@ -105,10 +166,14 @@ extern bool MultiClientConnectionUp(int32 connectionId);
 extern bool MultiClientExecute(int32 connectionId, const char *query, void **queryResult,
 							   int *rowCount, int *columnCount);
 extern bool MultiClientSendQuery(int32 connectionId, const char *query);
+extern bool MultiClientSendSingleRowQuery(int32 connectionId, const char *query);
 extern bool MultiClientCancel(int32 connectionId);
 extern ResultStatus MultiClientResultStatus(int32 connectionId);
 extern QueryStatus MultiClientQueryStatus(int32 connectionId);
 extern CopyStatus MultiClientCopyData(int32 connectionId, int32 fileDescriptor);
+extern CopyStatus MultiClientReceiveTuples(int32 connectionId,
+										   TupleDestination *tupleDestination,
+										   uint64 *tupleCount);
 extern bool MultiClientQueryResult(int32 connectionId, void **queryResult,
 								   int *rowCount, int *columnCount);
 extern BatchQueryStatus MultiClientBatchResult(int32 connectionId, void **queryResult,
@@ -122,7 +187,10 @@ extern void MultiClientResetWaitInfo(WaitInfo *waitInfo);
 extern void MultiClientFreeWaitInfo(WaitInfo *waitInfo);
 extern void MultiClientRegisterWait(WaitInfo *waitInfo, TaskExecutionStatus waitStatus,
 									int32 connectionId);
+extern void MultiClientUnregisterWait(WaitInfo *waitInfo, int32 connectionId);
+extern bool MultiClientWaitReady(WaitInfo *waitInfo, int32 connectionId);
 extern void MultiClientWait(WaitInfo *waitInfo);
+extern void MultiClientWaitWithTimeout(WaitInfo *waitInfo, long timeout);
 
 
 #endif /* MULTI_CLIENT_EXECUTOR_H */
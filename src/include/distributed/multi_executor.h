@@ -32,6 +32,13 @@ typedef struct CitusScanState
 	MultiExecutorType executorType;   /* distributed executor type */
 	bool finishedRemoteScan;          /* flag to check if remote scan is finished */
 	Tuplestorestate *tuplestorestate; /* tuple store to store distributed results */
+	RealTimeExecution *realTimeExecution; /* execution in progress when streaming */
+	int readPointer;                  /* tuple store read pointer when streaming */
+	bool randomAccess;                /* scan may move backwards or be rewound */
+	struct MultiConnection *streamingConnection; /* router rows are read from here */
+	struct pg_result *streamingResult; /* first result of a streaming router scan */
+	struct AttInMetadata *attributeInputMetadata; /* builds streamed router rows */
+	MemoryContext streamingContext;   /* holds the current streamed router row */
 } CitusScanState;
 
 
@@ -180,6 +180,7 @@ typedef struct Task
 
 	bool insertSelectQuery;
 	List *relationShardList;       /* only applies INSERT/SELECT tasks */
+	List *valuesRowIndexList;      /* only applies to multi-row INSERT tasks */
 } Task;
 
 
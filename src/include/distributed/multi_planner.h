@@ -20,6 +20,9 @@
 #define INVALID_JOB_ID 0
 #define INVALID_TASK_ID 0
 
+/* maximum number of deserialized distributed plans cached per backend */
+#define MAX_CACHED_MULTI_PLANS 1024
+
 
 typedef struct RelationRestrictionContext
 {
@@ -53,6 +56,8 @@ extern PlannedStmt * multi_planner(Query *parse, int cursorOptions,
 
 struct MultiPlan;
 extern struct MultiPlan * GetMultiPlan(CustomScan *node);
+extern void InvalidateMultiPlanCache(Oid relationId);
+extern void CleanUpMultiPlanCache(void);
 extern void multi_relation_restriction_hook(PlannerInfo *root, RelOptInfo *relOptInfo,
 											Index index, RangeTblEntry *rte);
 extern bool IsModifyCommand(Query *query);
@@ -34,11 +34,15 @@ typedef struct XactShardConnSet
 /* Config variables managed via guc.c */
 extern bool AllModificationsCommutative;
 extern bool EnableDeadlockPrevention;
+extern bool EnableLocalExecution;
+extern bool DeferRouterModifications;
+extern bool StreamRouterResults;
 
 extern void CitusModifyBeginScan(CustomScanState *node, EState *estate, int eflags);
 extern TupleTableSlot * RouterSingleModifyExecScan(CustomScanState *node);
 extern TupleTableSlot * RouterSelectExecScan(CustomScanState *node);
 extern TupleTableSlot * RouterMultiModifyExecScan(CustomScanState *node);
+extern void EndStreamingSelectTask(CitusScanState *scanState);
 
 extern int64 ExecuteModifyTasksWithoutResults(List *taskList);
 
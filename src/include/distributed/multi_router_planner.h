@@ -18,6 +18,7 @@
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_planner.h"
+#include "nodes/params.h"
 #include "nodes/parsenodes.h"
 
 
@@ -28,9 +29,11 @@
 #define CITUS_TABLE_ALIAS "citus_table_alias"
 
 extern bool EnableRouterExecution;
+extern bool EnableFastPathRouterPlanner;
 
 extern MultiPlan * CreateRouterPlan(Query *originalQuery, Query *query,
 									RelationRestrictionContext *restrictionContext);
+extern MultiPlan * CreateFastPathRouterPlan(Query *query, ParamListInfo boundParams);
 extern MultiPlan * CreateModifyPlan(Query *originalQuery, Query *query,
 									RelationRestrictionContext *restrictionContext);
 
@@ -43,6 +46,8 @@ extern bool InsertSelectQuery(Query *query);
 extern Oid ExtractFirstDistributedTableId(Query *query);
 extern RangeTblEntry * ExtractSelectRangeTableEntry(Query *query);
 extern RangeTblEntry * ExtractInsertRangeTableEntry(Query *query);
+extern RangeTblEntry * ExtractInsertValuesRangeTableEntry(Query *query);
+extern Query * InsertValuesSubsetQuery(Query *query, List *rowIndexList);
 extern void AddShardIntervalRestrictionToSelect(Query *subqery,
 												ShardInterval *shardInterval);
 extern ShardInterval * FastShardPruning(Oid distributedTableId, Datum partitionValue);
@@ -14,6 +14,7 @@
 #ifndef MULTI_SERVER_EXECUTOR_H
 #define MULTI_SERVER_EXECUTOR_H
 
+#include "distributed/multi_client_executor.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/task_tracker.h"
 #include "distributed/worker_manager.h"
@@ -22,6 +23,9 @@
 #define MAX_TASK_EXECUTION_FAILURES 3 /* allowed failure count for one task */
 #define MAX_TRACKER_FAILURE_COUNT 3   /* allowed failure count for one tracker */
 #define RESERVED_FD_COUNT 64           /* file descriptors unavailable to executor */
+#define INITIAL_WORKER_CONNECTION_LIMIT 2 /* connections per worker to start with */
+#define REAL_TIME_CONNECTION_POOL_DISABLED -1 /* each task opens its own connection */
+#define HEDGED_TASK_FILE_SUFFIX ".hedge" /* results of hedged task attempts */
 
 /* copy out query results */
 #define COPY_QUERY_TO_STDOUT_TEXT "COPY (%s) TO STDOUT"
@@ -32,7 +36,8 @@
 /* Task tracker executor related defines */
 #define TASK_ASSIGNMENT_QUERY "SELECT task_tracker_assign_task \
  ("UINT64_FORMAT ", %u, %s)"
-#define TASK_STATUS_QUERY "SELECT task_tracker_task_status("UINT64_FORMAT ", %u)"
+#define TASK_STATUS_CHANGES_QUERY "SELECT job_id, task_id, task_status, \
+ status_version FROM task_tracker_task_status_changes('{%s}', "UINT64_FORMAT ")"
 #define JOB_CLEANUP_QUERY "SELECT task_tracker_cleanup_job("UINT64_FORMAT ")"
 #define JOB_CLEANUP_TASK_ID INT_MAX
 
@@ -120,12 +125,18 @@ struct TaskExecution
 	TransmitExecStatus *transmitStatusArray;
 	int32 *connectionIdArray;
 	int32 *fileDescriptorArray;
+	bool *failedNodeArray;       /* placements on which an attempt failed */
 	TimestampTz connectStartTime;
+	TimestampTz retryTime;       /* earliest time to retry after a failure */
 	uint32 nodeCount;
 	uint32 currentNodeIndex;
 	uint32 querySourceNodeIndex; /* only applies to map fetch tasks */
 	int32 dataFetchTaskIndex;
 	uint32 failureCount;
+	uint64 storedTupleCount;     /* tuples stored in memory by current attempt */
+	TaskExecution *hedgeExecution; /* duplicate attempt on another placement */
+	bool hedgeAttempt;           /* whether this is a duplicate attempt */
+	bool hedged;                 /* whether a duplicate attempt was started */
 };
 
 
@@ -160,7 +171,7 @@ typedef struct TaskTracker
 
 	HTAB *taskStateHash;
 	List *assignedTaskList;
-	int32 currentTaskIndex;
+	uint64 statusVersion;           /* highest task status version seen */
 	bool connectionBusy;
 	TrackerTaskState *connectionBusyOnTask;
 } TaskTracker;
@@ -168,25 +179,61 @@ typedef struct TaskTracker
 
 /*
  * WorkerNodeState keeps state for a worker node. The real-time executor uses this to
- * keep track of the number of open connections to a worker node.
+ * keep track of the number of open connections to a worker node. Connections whose
+ * task completed are kept in the idle connection list, and are reused by the next
+ * task that runs on the worker. The connection limit starts small, and grows while
+ * tasks keep waiting for a connection to the worker.
  */
 typedef struct WorkerNodeState
 {
 	uint32 workerPort;
 	char workerName[WORKER_LENGTH];
 	uint32 openConnectionCount;
+	List *idleConnectionList;
+	uint32 connectionLimit;
+	TimestampTz connectionLimitChangeTime;
+	bool connectionLimitReached;
 } WorkerNodeState;
 
 
+/*
+ * RealTimeExecution keeps the state of one job's execution by the real-time
+ * executor, so that the execution can be advanced step by step.
+ */
+typedef struct RealTimeExecution
+{
+	Job *job;
+	TupleDestination *tupleDestination;
+	List *taskExecutionList;
+	HTAB *workerHash;
+	WaitInfo *waitInfo;
+	bool allTasksCompleted;
+	bool taskFailed;
+	uint32 failedTaskId;
+} RealTimeExecution;
+
+
 /* Config variable managed via guc.c */
 extern int RemoteTaskCheckInterval;
 extern int MaxAssignTaskBatchSize;
 extern int TaskExecutorType;
 extern bool BinaryMasterCopyFormat;
+extern bool RealTimeResultsInMemory;
+extern bool StreamRealTimeResults;
+extern int MaxRealTimeConnectionsPerWorker;
+extern bool CombineRealTimeTasks;
+extern int TaskHedgingCompletedPercentage;
 
 
 /* Function declarations for distributed execution */
-extern void MultiRealTimeExecute(Job *job);
+extern void MultiRealTimeExecute(Job *job, TupleDestination *tupleDestination);
+extern Job * CombineTasksPerWorker(Job *job);
+extern RealTimeExecution * BeginRealTimeExecution(Job *job,
+												  TupleDestination *tupleDestination);
+extern bool RealTimeExecutionStep(RealTimeExecution *execution);
+extern void RealTimeExecutionWait(RealTimeExecution *execution);
+extern bool RealTimeExecutionFinished(RealTimeExecution *execution);
+extern void EndRealTimeExecution(RealTimeExecution *execution);
 extern void MultiTaskTrackerExecute(Job *job);
 
 /* Function declarations common to more than one executor */
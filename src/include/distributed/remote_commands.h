@@ -19,9 +19,15 @@
 
 struct pg_result; /* target of the PGresult typedef */
 
+/* maximum number of statements prepared on a single connection */
+#define MAX_PREPARED_STATEMENTS_PER_CONNECTION 1024
+
 /* GUC, determining whether statements sent to remote nodes are logged */
 extern bool LogRemoteCommands;
 
+/* GUC, determining whether parameterized queries are prepared on remote nodes */
+extern bool EnableRemotePreparedStatements;
+
 
 /* simple helpers */
 extern bool IsResponseOK(struct pg_result *result);
@@ -41,11 +47,21 @@ extern int ExecuteOptionalRemoteCommand(MultiConnection *connection,
 										const char *command,
 										struct pg_result **result);
 extern int SendRemoteCommand(MultiConnection *connection, const char *command);
+extern int SendRemoteCommandBatch(MultiConnection *connection, const char *commandBatch);
 extern int SendRemoteCommandParams(MultiConnection *connection, const char *command,
 								   int parameterCount, const Oid *parameterTypes,
 								   const char *const *parameterValues);
+extern int SendRemoteCommandPrepared(MultiConnection *connection, const char *command,
+									 int parameterCount, const Oid *parameterTypes,
+									 const char *const *parameterValues);
 extern struct pg_result * GetRemoteCommandResult(MultiConnection *connection,
 												 bool raiseInterrupts);
+extern bool SendCancelationRequest(MultiConnection *connection);
+
+/* caching of statements prepared on remote nodes */
+extern void InvalidateRemotePreparedStatements(void);
+extern void ClearPreparedStatementCache(MultiConnection *connection);
+extern void ForgetPendingPreparedStatement(MultiConnection *connection);
 
 
 #endif /* REMOTE_COMMAND_H */
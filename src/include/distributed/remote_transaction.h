@@ -63,6 +63,21 @@ typedef struct RemoteTransaction
 
 	/* 2PC transaction name currently associated with connection */
 	char preparedName[NAMEDATALEN];
+
+	/* commands queued to be sent as one batch, see DeferRemoteTransactionCommand */
+	struct StringInfoData *deferredCommands;
+
+	/* number of statements in deferredCommands */
+	int deferredCommandCount;
+
+	/* results of deferred commands sent ahead of the current command */
+	int pipelinedResultCount;
+
+	/* last result returned by GetRemoteCommandResult is a failed deferred command's */
+	bool pipelinedCommandFailed;
+
+	/* batch of deferred commands has been sent, results not yet consumed */
+	bool deferredCommandsSent;
 } RemoteTransaction;
 
 
@@ -86,6 +101,16 @@ extern void RemoteTransactionAbort(struct MultiConnection *connection);
 /* start transaction if necessary */
 extern void RemoteTransactionBeginIfNecessary(struct MultiConnection *connection);
 extern void RemoteTransactionsBeginIfNecessary(List *connectionList);
+extern void RemoteTransactionsDeferBeginIfNecessary(List *connectionList);
+
+/* batching of commands within a remote transaction */
+extern void DeferRemoteTransactionCommand(struct MultiConnection *connection,
+										  const char *command);
+extern void StartRemoteTransactionFlush(struct MultiConnection *connection);
+extern void FinishRemoteTransactionFlush(struct MultiConnection *connection);
+extern void RemoteTransactionFlush(struct MultiConnection *connection);
+extern const char * RemoteTransactionPipelineCommand(struct MultiConnection *connection,
+													 const char *command);
 
 /* other public functionality */
 extern void MarkRemoteTransactionFailed(struct MultiConnection *connection,
@@ -102,6 +127,7 @@ extern void CloseRemoteTransaction(struct MultiConnection *connection);
 extern void ResetRemoteTransaction(struct MultiConnection *connection);
 
 /* perform handling for all in-progress transactions */
+extern void CoordinatedRemoteTransactionsFlush(void);
 extern void CoordinatedRemoteTransactionsPrepare(void);
 extern void CoordinatedRemoteTransactionsCommit(void);
 extern void CoordinatedRemoteTransactionsAbort(void);
@@ -0,0 +1,77 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_connection_stats.h
+ *   Accounting of connections to worker nodes across all backends
+ *
+ * Copyright (c) 2017, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARED_CONNECTION_STATS_H
+#define SHARED_CONNECTION_STATS_H
+
+#include "distributed/connection_management.h"
+#include "storage/lwlock.h"
+#include "utils/hsearch.h"
+
+
+/*
+ * SharedConnectionStatsHashKey identifies a node, regardless of the user and
+ * database connections to it are made as.
+ */
+typedef struct SharedConnectionStatsHashKey
+{
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+} SharedConnectionStatsHashKey;
+
+
+/*
+ * SharedConnectionStatsHashEntry keeps track of the connections that all
+ * backends on this node hold to a single node, which is what the node's
+ * max_connections limits. The ones that are not idle count towards the
+ * node's connection budget.
+ */
+typedef struct SharedConnectionStatsHashEntry
+{
+	SharedConnectionStatsHashKey key; /* hash key, zero padded */
+	int connectionCount;              /* connections currently open */
+	int idleConnectionCount;          /* connections kept open between transactions */
+	uint64 establishedCount;          /* connections established since startup */
+	uint64 reusedCount;               /* times an idle connection was reused */
+	uint64 discardedCount;            /* idle connections closed as the pool was full */
+} SharedConnectionStatsHashEntry;
+
+
+/*
+ * SharedConnectionStatsData contains the connection statistics shared between
+ * all backends.
+ */
+typedef struct SharedConnectionStatsData
+{
+	/* hash table mapping nodes to their connection statistics */
+	HTAB *connectionStatsHash;
+
+	/* lock protecting connectionStatsHash */
+	int connectionStatsTrancheId;
+	LWLockTranche connectionStatsLockTranche;
+	LWLock connectionStatsLock;
+} SharedConnectionStatsData;
+
+
+/* config variables managed via guc.c */
+extern int MaxIdleConnectionsPerNode;
+extern int MaxSharedConnectionsPerNode;
+
+
+extern void InitializeSharedConnectionStats(void);
+extern bool ReserveSharedConnection(const char *hostname, int32 port,
+									int ownConnectionCount);
+extern bool SharedConnectionBudgetExhausted(const char *hostname, int32 port);
+extern void SharedConnectionClosed(MultiConnection *connection);
+extern bool ReturnConnectionToSharedPool(MultiConnection *connection);
+extern void TakeConnectionFromSharedPool(MultiConnection *connection);
+
+
+#endif /* SHARED_CONNECTION_STATS_H */
@@ -15,6 +15,7 @@
 #ifndef TASK_TRACKER_H
 #define TASK_TRACKER_H
 
+#include "storage/latch.h"
 #include "storage/lwlock.h"
 #include "utils/hsearch.h"
 
@@ -25,6 +26,8 @@
 #define MAX_TASK_FAILURE_COUNT 2    /* allowed failure count for one task */
 #define LOCAL_HOST_NAME "localhost" /* connect to local backends using this name */
 #define TASK_CALL_STRING_SIZE 12288 /* max length of task call string */
+#define TASK_CALL_STRING_BLOCK_SIZE 128 /* allocation unit for task call strings */
+#define INVALID_TASK_CALL_STRING_BLOCK -1 /* task has no call string yet */
 #define TEMPLATE0_NAME "template0"  /* skip job schema cleanup for template0 */
 #define JOB_SCHEMA_CLEANUP "SELECT worker_cleanup_job_schema_cache()"
 
@@ -79,8 +82,10 @@ typedef struct WorkerTask
 	uint32 taskId;     /* task id; part of hash table key */
 	uint32 assignedAt; /* task assignment time in epoch seconds */
 
-	char taskCallString[TASK_CALL_STRING_SIZE]; /* query or function call string */
+	int32 taskCallStringBlock;    /* call string position in the string arena */
+	uint32 taskCallStringLength;  /* call string length, without terminator */
 	TaskStatus taskStatus;  /* task's current execution status */
+	uint64 statusVersion;   /* version at which the status last changed */
 	char databaseName[NAMEDATALEN];   /* name to use for local backend connection */
 	char userName[NAMEDATALEN]; /* user to use for local backend connection */
 	int32 connectionId;     /* connection id to local backend */
@@ -101,6 +106,26 @@ typedef struct WorkerTasksSharedStateData
 	int taskHashTrancheId;
 	LWLockTranche taskHashLockTranche;
 	LWLock taskHashLock;
+
+	/* latch of the running task tracker, set to wake it up; NULL if none */
+	Latch *taskTrackerLatch;
+
+	/*
+	 * Arena holding the tasks' query or function call strings, also protected
+	 * by taskHashLock. Each string takes up as many consecutive blocks as it
+	 * needs, so that the arena only has to be sized for the strings in use.
+	 */
+	char *taskCallStringArena;
+	bool *taskCallStringBlockUsed;
+	int32 taskCallStringBlockCount;
+	int32 taskCallStringNextBlock; /* where to start looking for free blocks */
+
+	/*
+	 * Last version given out to a task status change, also protected by
+	 * taskHashLock. The master node uses versions to only fetch the statuses
+	 * that changed since it last looked.
+	 */
+	uint64 taskStatusVersion;
 } WorkerTasksSharedStateData;
 
 
@@ -108,6 +133,7 @@ typedef struct WorkerTasksSharedStateData
 extern int TaskTrackerDelay;
 extern int MaxTrackedTasksPerNode;
 extern int MaxRunningTasksPerNode;
+extern int MaxTaskStringMemory;
 
 /* State shared by the task tracker and task tracker protocol functions */
 extern WorkerTasksSharedStateData *WorkerTasksSharedState;
@@ -116,9 +142,14 @@ extern WorkerTasksSharedStateData *WorkerTasksSharedState;
 /* Function declarations local to the worker module */
 extern WorkerTask * WorkerTasksHashEnter(uint64 jobId, uint32 taskId);
 extern WorkerTask * WorkerTasksHashFind(uint64 jobId, uint32 taskId);
+extern bool SetTaskCallString(WorkerTask *workerTask, const char *taskCallString);
+extern char * TaskCallString(WorkerTask *workerTask);
+extern void FreeTaskCallString(WorkerTask *workerTask);
+extern void MarkTaskStatusChanged(WorkerTask *workerTask);
 
 /* Function declarations for starting up and running the task tracker */
 extern void TaskTrackerRegister(void);
+extern void WakeupTaskTracker(void);
 
 
 #endif   /* TASK_TRACKER_H */
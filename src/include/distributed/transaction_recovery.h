@@ -11,9 +11,14 @@
 #ifndef TRANSACTION_RECOVERY_H
 #define TRANSACTION_RECOVERY_H
 
+#include "nodes/pg_list.h"
+
 
 /* Functions declarations for worker transactions */
 extern void LogTransactionRecord(int groupId, char *transactionName);
+extern void LogTransactionRecords(List *groupIdList, List *transactionNameList);
+extern int CommitPreparedTransactionList(List *pendingCommitList);
+extern int RecoverPreparedTransactions(void);
 
 
 #endif /* TRANSACTION_RECOVERY_H */
@@ -285,6 +285,13 @@ for my $port (@workerPorts)
 system("$bindir/initdb", ("--nosync", "-U", $user, "tmp_check/master/data")) == 0
     or die "Could not create master data directory";
 
+# Disable automatic 2PC recovery in the configuration file rather than on the
+# command line, so that tests can enable it with ALTER SYSTEM
+open(my $configFile, ">>", "tmp_check/master/data/postgresql.conf")
+    or die "Could not open master configuration file";
+print $configFile "citus.recover_2pc_interval = -1\n";
+close($configFile);
+
 for my $port (@workerPorts)
 {
     system("cp -a tmp_check/master/data tmp_check/worker.$port/data") == 0
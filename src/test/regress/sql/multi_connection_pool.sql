@@ -0,0 +1,118 @@
+--
+-- MULTI_CONNECTION_POOL
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 1420000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 1420000;
+
+
+-- Connections kept open between transactions are limited per node
+
+CREATE TABLE pool_test (id int, value text);
+SELECT master_create_distributed_table('pool_test', 'id', 'hash');
+SELECT master_create_worker_shards('pool_test', 1, 1);
+INSERT INTO pool_test VALUES (1, 'a'), (1, 'b');
+
+-- connections to workers are accounted for across sessions
+SELECT count(*) > 0 AS has_connections,
+	   bool_and(connection_count >= idle_connection_count) AS valid_stats
+FROM citus_connection_pool_stats();
+
+-- and summed up per worker node, without a budget by default
+SELECT count(*) > 0 AS has_connections,
+	   bool_and(connection_count >= 0 AND max_connection_count IS NULL) AS valid_usage
+FROM citus_node_connections;
+
+SELECT coalesce(sum(discarded_count), 0) AS discarded_before
+FROM citus_connection_pool_stats()
+WHERE node_port = :worker_1_port \gset
+
+SET citus.max_idle_connections_per_node TO 1;
+SHOW citus.max_idle_connections_per_node;
+
+-- Every streamed scan claims its connection until the scan ends, so the
+-- function below uses three connections to the same node at once.
+SET citus.stream_router_results TO on;
+
+CREATE FUNCTION count_over_three_connections() RETURNS bigint
+AS $$
+DECLARE
+	first_cursor NO SCROLL CURSOR FOR SELECT value FROM pool_test WHERE id = 1;
+	second_cursor NO SCROLL CURSOR FOR SELECT value FROM pool_test WHERE id = 1;
+	first_value text;
+	second_value text;
+	row_count bigint;
+BEGIN
+	OPEN first_cursor;
+	FETCH first_cursor INTO first_value;
+	OPEN second_cursor;
+	FETCH second_cursor INTO second_value;
+	SELECT count(*) INTO row_count FROM pool_test WHERE id = 1;
+	CLOSE second_cursor;
+	CLOSE first_cursor;
+	RETURN row_count;
+END;
+$$ LANGUAGE plpgsql;
+
+SELECT count_over_three_connections();
+
+-- only one of them is kept open at transaction end, the others are closed
+SELECT sum(idle_connection_count) <= 1 AS idle_within_cap,
+	   sum(discarded_count) - :discarded_before >= 2 AS closed_above_cap
+FROM citus_connection_pool_stats()
+WHERE node_port = :worker_1_port;
+
+-- the connection that was kept is used again
+SELECT sum(reused_count) AS reused_before
+FROM citus_connection_pool_stats()
+WHERE node_port = :worker_1_port \gset
+
+SELECT count(*) FROM pool_test WHERE id = 1;
+
+SELECT sum(reused_count) > :reused_before AS reused_idle_connection,
+	   sum(idle_connection_count) <= 1 AS idle_within_cap
+FROM citus_connection_pool_stats()
+WHERE node_port = :worker_1_port;
+
+RESET citus.max_idle_connections_per_node;
+SHOW citus.max_idle_connections_per_node;
+
+-- Connections in use are limited per node, across all sessions
+
+SET citus.max_shared_connections_per_node TO 2;
+SHOW citus.max_shared_connections_per_node;
+
+-- a session that needs more connections at once than the budget allows opens
+-- them anyway rather than waiting for itself
+SELECT count_over_three_connections();
+
+-- they are released when the transaction ends, and the idle connections kept
+-- for later transactions don't count towards the budget
+SELECT connection_count, max_connection_count
+FROM citus_node_connections WHERE node_port = :worker_1_port;
+
+CREATE TABLE budget_test (id int, value text);
+SELECT master_create_distributed_table('budget_test', 'id', 'hash');
+SELECT master_create_worker_shards('budget_test', 4, 1);
+INSERT INTO budget_test VALUES (1, 'a'), (2, 'b'), (3, 'c'), (4, 'd');
+
+-- real-time queries make do with a single connection per node
+SET citus.max_shared_connections_per_node TO 1;
+
+SELECT count(*) FROM budget_test;
+
+SELECT node_port, connection_count, max_connection_count
+FROM citus_node_connections
+WHERE node_port IN (:worker_1_port, :worker_2_port)
+ORDER BY node_port;
+
+RESET citus.max_shared_connections_per_node;
+SHOW citus.max_shared_connections_per_node;
+
+RESET citus.stream_router_results;
+
+DROP TABLE budget_test;
+
+DROP FUNCTION count_over_three_connections();
+DROP TABLE pool_test;
@@ -77,6 +77,11 @@ ALTER EXTENSION citus UPDATE TO '6.1-16';
 ALTER EXTENSION citus UPDATE TO '6.1-17';
 ALTER EXTENSION citus UPDATE TO '6.2-1';
 ALTER EXTENSION citus UPDATE TO '6.2-2';
+ALTER EXTENSION citus UPDATE TO '6.2-3';
+ALTER EXTENSION citus UPDATE TO '6.2-4';
+ALTER EXTENSION citus UPDATE TO '6.2-5';
+ALTER EXTENSION citus UPDATE TO '6.2-6';
+ALTER EXTENSION citus UPDATE TO '6.2-7';
 
 -- ensure no objects were created outside pg_catalog
 SELECT COUNT(*)
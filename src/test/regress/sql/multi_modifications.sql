@@ -147,9 +147,15 @@ DELETE FROM limit_orders WHERE id = 246 AND bidder_id = (random() * 1000);
 -- (the cast to timestamp is because the timestamp_eq_timestamptz operator is stable)
 DELETE FROM limit_orders WHERE id = 246 AND placed_at = current_timestamp::timestamp;
 
--- commands with multiple rows are unsupported
+-- multi-row commands need a partition value for each row
 INSERT INTO limit_orders VALUES (DEFAULT), (DEFAULT);
 
+-- multi-row commands are split across shards
+INSERT INTO limit_orders VALUES (12037, 'GOOG', 5634, '2001-04-16 03:37:28', 'buy', 0.50),
+                      (12038, 'GOOG', 5634, '2001-04-16 03:37:28', 'buy', 2.50),
+                      (12039, 'GOOG', 5634, '2001-04-16 03:37:28', 'buy', 1.50);
+SELECT id, limit_price FROM limit_orders WHERE id BETWEEN 12037 AND 12039 ORDER BY id;
+
 -- Who says that? :)
 -- INSERT ... SELECT ... FROM commands are unsupported
 -- INSERT INTO limit_orders SELECT * FROM limit_orders;
@@ -418,3 +424,46 @@ SELECT master_create_worker_shards('app_analytics_events', 4, 1);
 INSERT INTO app_analytics_events VALUES (DEFAULT, 101, 'Fauxkemon Geaux') RETURNING id;
 INSERT INTO app_analytics_events (app_id, name) VALUES (102, 'Wayz') RETURNING id;
 INSERT INTO app_analytics_events (app_id, name) VALUES (103, 'Mynt') RETURNING *;
+
+-- multi-row INSERTs evaluate defaults and volatile functions once per row
+INSERT INTO app_analytics_events VALUES (DEFAULT, 104, 'Wayz'), (DEFAULT, 105, 'Mynt'),
+                                        (DEFAULT, 106, 'Fauxkemon Geaux') RETURNING id, app_id;
+INSERT INTO app_analytics_events (name, app_id) VALUES ('Wayz', 107), ('Mynt', 108),
+                                                       ('Fauxkemon Geaux', 109) RETURNING id, app_id;
+SELECT count(*), count(DISTINCT id) FROM app_analytics_events;
+
+-- multi-row INSERTs return rows from all shards, grouped by shard
+CREATE TABLE multi_row_insert (key int PRIMARY KEY, value int);
+SELECT master_create_distributed_table('multi_row_insert', 'key', 'hash');
+SELECT master_create_worker_shards('multi_row_insert', 4, 1);
+
+INSERT INTO multi_row_insert VALUES (1, 10), (2, 20), (3, 30), (4, 40), (5, 50)
+RETURNING key, value;
+
+-- rows going to the same shard
+INSERT INTO multi_row_insert VALUES (7, 70), (3, 31) ON CONFLICT DO NOTHING;
+SELECT * FROM multi_row_insert WHERE key IN (3, 4, 7) ORDER BY key;
+
+INSERT INTO multi_row_insert VALUES (1, 11), (3, 32), (6, 60)
+ON CONFLICT (key) DO UPDATE SET value = EXCLUDED.value RETURNING key, value;
+
+-- parameters in the VALUES rows, including once the generic plan is considered
+PREPARE insert_two_rows(int, int, int, int) AS
+	INSERT INTO multi_row_insert VALUES ($1, $2), ($3, $4);
+EXECUTE insert_two_rows(11, 1, 12, 2);
+EXECUTE insert_two_rows(13, 3, 14, 4);
+EXECUTE insert_two_rows(15, 5, 16, 6);
+EXECUTE insert_two_rows(17, 7, 18, 8);
+EXECUTE insert_two_rows(19, 9, 20, 10);
+EXECUTE insert_two_rows(21, 11, 22, 12);
+SELECT * FROM multi_row_insert ORDER BY key;
+DEALLOCATE insert_two_rows;
+
+-- multi-row INSERTs into reference tables
+CREATE TABLE multi_row_reference (key int, value text);
+SELECT create_reference_table('multi_row_reference');
+INSERT INTO multi_row_reference VALUES (2, 'b'), (1, 'a'), (3, 'c') RETURNING *;
+SELECT * FROM multi_row_reference ORDER BY key;
+
+DROP TABLE multi_row_insert;
+DROP TABLE multi_row_reference;
@@ -53,6 +53,36 @@ BEGIN;
 UPDATE researchers SET name = 'John Backus' WHERE id = 1 AND lab_id = 1;
 ABORT;
 
+-- deferred modifications are sent with the next command on the connection
+SET citus.defer_router_modifications TO on;
+BEGIN;
+INSERT INTO labs VALUES (8, 'Xerox PARC');
+UPDATE labs SET name = 'Xerox Palo Alto Research Center' WHERE id = 8;
+SELECT name FROM labs WHERE id = 8;
+ABORT;
+
+SELECT count(*) FROM labs WHERE id = 8;
+
+-- deferred modifications left at commit are sent as one batch
+BEGIN;
+INSERT INTO labs VALUES (8, 'Xerox PARC');
+UPDATE labs SET name = 'Xerox Palo Alto Research Center' WHERE id = 8;
+COMMIT;
+
+SELECT name FROM labs WHERE id = 8;
+DELETE FROM labs WHERE id = 8;
+
+-- errors in deferred modifications surface at commit
+BEGIN;
+INSERT INTO labs VALUES (9, NULL);
+COMMIT;
+
+-- modifications of shards with multiple placements are not deferred
+BEGIN;
+UPDATE researchers SET name = 'John Backus' WHERE id = 1 AND lab_id = 1;
+COMMIT;
+RESET citus.defer_router_modifications;
+
 -- creating savepoints should work...
 BEGIN;
 INSERT INTO researchers VALUES (5, 3, 'Dennis Ritchie');
@@ -931,4 +961,45 @@ DROP TABLE reference_modifying_xacts, hash_modifying_xacts, hash_modifying_xacts
 	reference_failure_test, numbers_hash_failure_test;
 
 SELECT * FROM run_command_on_workers('DROP USER test_user');
-DROP USER test_user;
\ No newline at end of file
+DROP USER test_user;
+
+-- the BEGIN of each remote transaction is sent along with its first command
+CREATE TABLE pipelined_xacts (key int PRIMARY KEY, value int);
+SELECT master_create_distributed_table('pipelined_xacts', 'key', 'hash');
+SELECT master_create_worker_shards('pipelined_xacts', 2, 1);
+INSERT INTO pipelined_xacts VALUES (1, 10), (2, 20), (3, 30);
+
+BEGIN;
+SELECT master_modify_multiple_shards('UPDATE pipelined_xacts SET value = value + 1');
+SELECT master_modify_multiple_shards('DELETE FROM pipelined_xacts WHERE key = 3');
+COMMIT;
+SELECT * FROM pipelined_xacts ORDER BY key;
+
+BEGIN;
+ALTER TABLE pipelined_xacts ADD COLUMN note text;
+COMMIT;
+
+BEGIN;
+\copy pipelined_xacts (key, value) from stdin delimiter ','
+3,30
+4,40
+\.
+COMMIT;
+SELECT key, value FROM pipelined_xacts ORDER BY key;
+
+-- a failing deferred modification aborts the transaction when the next
+-- command is sent, without marking the placement invalid
+SET citus.defer_router_modifications TO on;
+BEGIN;
+INSERT INTO pipelined_xacts VALUES (1, 100);
+SELECT value FROM pipelined_xacts WHERE key = 1;
+ROLLBACK;
+RESET citus.defer_router_modifications;
+
+SELECT shardid, shardstate, nodeport
+FROM pg_dist_shard_placement JOIN pg_dist_shard USING (shardid)
+WHERE logicalrelid = 'pipelined_xacts'::regclass
+ORDER BY shardid;
+
+SELECT value FROM pipelined_xacts WHERE key = 1;
+DROP TABLE pipelined_xacts;
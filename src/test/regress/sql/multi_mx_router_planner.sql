@@ -657,3 +657,27 @@ INSERT INTO articles_hash_mx VALUES (51,  1, 'amateus', 1814);
 SELECT id
 	FROM articles_hash_mx
 	WHERE author_id = 1;
+
+-- router selects can be executed without a loopback connection, in which case
+-- the shard query runs in this backend
+SELECT pg_backend_pid() AS local_backend_pid \gset
+SELECT shardid, nodeport FROM pg_dist_shard_placement
+WHERE shardid IN (1220104, 1220105) ORDER BY shardid;
+
+SET citus.enable_local_execution TO on;
+
+-- the shard of author 1 has a placement on this node
+SELECT id, pg_backend_pid() = :local_backend_pid AS executed_locally
+	FROM articles_hash_mx
+	WHERE author_id = 1;
+
+-- the shard of author 2 only has a placement on the other worker
+SELECT id, pg_backend_pid() = :local_backend_pid AS executed_locally
+	FROM articles_hash_mx
+	WHERE author_id = 2;
+
+RESET citus.enable_local_execution;
+
+SELECT id, pg_backend_pid() = :local_backend_pid AS executed_locally
+	FROM articles_hash_mx
+	WHERE author_id = 1;
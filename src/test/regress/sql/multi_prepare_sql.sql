@@ -303,6 +303,42 @@ EXECUTE prepared_router_non_partition_column_select(40);
 EXECUTE prepared_router_non_partition_column_select(50);
 EXECUTE prepared_router_non_partition_column_select(60);
 
+-- check that parameterized router queries can be prepared on the workers
+SET citus.enable_remote_prepared_statements TO on;
+
+-- count the statements prepared on the worker connection used for key 0
+SELECT * FROM run_command_on_workers('CREATE FUNCTION remote_prepared_statement_count()
+RETURNS bigint AS $$
+	SELECT count(*) FROM pg_prepared_statements WHERE name LIKE ''citus_statement_%''
+$$ LANGUAGE sql')
+ORDER BY nodeport;
+CREATE FUNCTION remote_prepared_statement_count()
+RETURNS bigint AS $$
+	SELECT count(*) FROM pg_prepared_statements WHERE name LIKE 'citus_statement_%'
+$$ LANGUAGE sql;
+
+EXECUTE prepared_router_non_partition_column_select(10);
+EXECUTE prepared_router_non_partition_column_select(20);
+
+-- the statement is prepared once, and then reused
+SELECT remote_prepared_statement_count() FROM prepare_table WHERE key = 0 LIMIT 1;
+
+-- metadata changes deallocate the statements prepared on the workers
+UPDATE pg_dist_shard_placement SET shardstate = 1
+WHERE shardid IN (
+        SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'prepare_table'::regclass);
+
+EXECUTE prepared_router_non_partition_column_select(30);
+
+-- the stale statement was deallocated before the statement was prepared again
+SELECT remote_prepared_statement_count() FROM prepare_table WHERE key = 0 LIMIT 1;
+
+RESET citus.enable_remote_prepared_statements;
+
+SELECT * FROM run_command_on_workers('DROP FUNCTION remote_prepared_statement_count()')
+ORDER BY nodeport;
+DROP FUNCTION remote_prepared_statement_count();
+
 -- check real-time executor
 PREPARE prepared_real_time_non_partition_column_select(int) AS
 	SELECT
@@ -486,6 +522,107 @@ WHERE shardid IN (
 EXECUTE countsome; -- should indicate replanning
 EXECUTE countsome; -- no replanning
 
+-- check that the query strings rebuilt for a prepared modification with a
+-- mutable function are only reused while the function evaluates to the same
+-- value, including once the generic plan is cached
+CREATE TABLE prepare_func_table (key int, value int);
+SELECT master_create_distributed_table('prepare_func_table', 'key', 'hash');
+SELECT master_create_worker_shards('prepare_func_table', 4, 1);
+INSERT INTO prepare_func_table VALUES (1, 0), (2, 0), (3, 0);
+
+-- a local table on the master, so the function can only be evaluated there
+CREATE TABLE prepare_multiplier (multiplier int);
+INSERT INTO prepare_multiplier VALUES (1);
+CREATE FUNCTION current_prepare_multiplier() RETURNS int STABLE AS $$
+	SELECT multiplier FROM prepare_multiplier
+$$ LANGUAGE sql;
+
+PREPARE prepared_update_with_function(int, int) AS
+	UPDATE prepare_func_table SET value = $2 * current_prepare_multiplier()
+	WHERE key = $1;
+
+EXECUTE prepared_update_with_function(1, 10);
+EXECUTE prepared_update_with_function(2, 10);
+EXECUTE prepared_update_with_function(1, 20);
+EXECUTE prepared_update_with_function(1, 20);
+EXECUTE prepared_update_with_function(1, 20);
+EXECUTE prepared_update_with_function(1, 20);
+EXECUTE prepared_update_with_function(1, 20);
+SELECT * FROM prepare_func_table ORDER BY key;
+
+-- the function now evaluates to another value, so the strings are rebuilt
+UPDATE prepare_multiplier SET multiplier = 2;
+EXECUTE prepared_update_with_function(1, 20);
+EXECUTE prepared_update_with_function(3, 20);
+SELECT * FROM prepare_func_table ORDER BY key;
+
+EXECUTE prepared_update_with_function(2, 5);
+EXECUTE prepared_update_with_function(2, 5);
+UPDATE prepare_multiplier SET multiplier = 1;
+EXECUTE prepared_update_with_function(2, 5);
+SELECT * FROM prepare_func_table ORDER BY key;
+
+DEALLOCATE prepared_update_with_function;
+DROP FUNCTION current_prepare_multiplier();
+DROP TABLE prepare_multiplier;
+DROP TABLE prepare_func_table;
+
+-- check that cached distributed plans are not reused after DDL or after the
+-- shard placements of their relation changed
+CREATE TABLE prepare_ddl_table (key int, value int, other int);
+SELECT master_create_distributed_table('prepare_ddl_table', 'key', 'hash');
+SELECT master_create_worker_shards('prepare_ddl_table', 2, 2);
+INSERT INTO prepare_ddl_table VALUES (1, 10, 100), (2, 20, 200), (3, 30, 300);
+
+-- only read from the first worker for now
+UPDATE pg_dist_shard_placement SET shardstate = 3
+WHERE shardid IN (
+        SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'prepare_ddl_table'::regclass)
+    AND nodeport = :worker_2_port;
+
+PREPARE prepared_router_ddl AS
+	SELECT key, value, inet_server_port() = :worker_1_port AS on_worker_1
+	FROM prepare_ddl_table WHERE key = 1;
+PREPARE prepared_real_time_ddl AS
+	SELECT key, value FROM prepare_ddl_table ORDER BY key;
+
+EXECUTE prepared_router_ddl;
+EXECUTE prepared_router_ddl;
+EXECUTE prepared_router_ddl;
+EXECUTE prepared_real_time_ddl;
+EXECUTE prepared_real_time_ddl;
+EXECUTE prepared_real_time_ddl;
+
+-- drop and re-add a column between executions
+ALTER TABLE prepare_ddl_table DROP COLUMN other;
+EXECUTE prepared_router_ddl;
+EXECUTE prepared_real_time_ddl;
+ALTER TABLE prepare_ddl_table ADD COLUMN other int;
+SELECT master_modify_multiple_shards('UPDATE prepare_ddl_table SET value = value + 1');
+EXECUTE prepared_router_ddl;
+EXECUTE prepared_router_ddl;
+EXECUTE prepared_real_time_ddl;
+EXECUTE prepared_real_time_ddl;
+
+-- move the shards to the second worker
+SELECT master_copy_shard_placement(shardid, 'localhost', :worker_1_port, 'localhost', :worker_2_port)
+FROM pg_dist_shard_placement
+WHERE shardid IN (
+        SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'prepare_ddl_table'::regclass)
+    AND nodeport = :worker_2_port;
+UPDATE pg_dist_shard_placement SET shardstate = 3
+WHERE shardid IN (
+        SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'prepare_ddl_table'::regclass)
+    AND nodeport = :worker_1_port;
+EXECUTE prepared_router_ddl;
+EXECUTE prepared_router_ddl;
+EXECUTE prepared_real_time_ddl;
+EXECUTE prepared_real_time_ddl;
+
+DEALLOCATE prepared_router_ddl;
+DEALLOCATE prepared_real_time_ddl;
+DROP TABLE prepare_ddl_table;
+
 -- reset
 \set VERBOSITY default
 
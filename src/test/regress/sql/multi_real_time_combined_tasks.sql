@@ -0,0 +1,26 @@
+--
+-- MULTI_REAL_TIME_COMBINED_TASKS
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 480000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 480000;
+
+
+SET citus.task_executor_type TO 'real-time';
+
+-- Combine the tasks that run on the same worker into a single query
+
+SET citus.combine_real_time_tasks TO 'on';
+
+SELECT count(*) FROM lineitem;
+SELECT l_shipmode FROM lineitem WHERE l_partkey = 67310 OR l_partkey = 155190
+	ORDER BY l_shipmode;
+
+SET citus.real_time_results_in_memory TO 'on';
+
+SELECT count(*) FROM lineitem;
+SELECT avg(l_quantity) as average FROM lineitem;
+
+RESET citus.real_time_results_in_memory;
+RESET citus.combine_real_time_tasks;
@@ -0,0 +1,27 @@
+--
+-- MULTI_REAL_TIME_CONNECTION_POOL
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 470000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 470000;
+
+
+SET citus.task_executor_type TO 'real-time';
+
+-- Each task opens its own connection unless pooling is enabled
+
+SHOW citus.max_real_time_connections_per_worker;
+
+-- Run all tasks of a worker back to back over a single connection
+
+SET citus.max_real_time_connections_per_worker TO 1;
+
+SELECT count(*) FROM lineitem;
+
+SET citus.real_time_results_in_memory TO 'on';
+
+SELECT count(*) FROM lineitem;
+
+RESET citus.real_time_results_in_memory;
+RESET citus.max_real_time_connections_per_worker;
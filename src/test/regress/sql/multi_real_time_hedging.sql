@@ -0,0 +1,54 @@
+--
+-- MULTI_REAL_TIME_HEDGING
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 490000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 490000;
+
+
+SET citus.task_executor_type TO 'real-time';
+
+-- Hedge the tasks that are still running once some tasks completed
+
+SET citus.task_hedging_completed_percentage TO 1;
+
+SELECT count(*) FROM lineitem;
+SELECT l_shipmode FROM lineitem WHERE l_partkey = 67310 OR l_partkey = 155190
+	ORDER BY l_shipmode;
+
+SELECT hedges_won <= hedged_tasks AS valid_stats FROM citus_task_hedging_stats();
+
+-- The query below never completes on the first worker on its own. Greedy task
+-- assignment runs one task on each worker. Once the task on the second worker
+-- completed, the task still running on the first worker gets hedged on the
+-- second worker, and the hedge completes and cancels the straggler. The
+-- statement timeout only turns a broken hedge into an error instead of a hang.
+
+CREATE TABLE hedging_test (id integer);
+SELECT master_create_distributed_table('hedging_test', 'id', 'hash');
+SELECT master_create_worker_shards('hedging_test', 2, 2);
+
+INSERT INTO hedging_test VALUES (1), (2), (3), (4), (5), (6), (7), (8), (9), (10),
+	(11), (12), (13), (14), (15), (16), (17), (18), (19), (20);
+
+SET citus.task_hedging_completed_percentage TO 50;
+SET citus.task_assignment_policy TO 'greedy';
+SET statement_timeout TO '1min';
+
+SELECT hedged_tasks AS hedged_tasks_before, hedges_won AS hedges_won_before
+FROM citus_task_hedging_stats() \gset
+
+SELECT count(*) FROM hedging_test
+WHERE CASE WHEN inet_server_port() = :worker_1_port
+		   THEN pg_sleep(3600) IS NOT NULL ELSE true END;
+
+SELECT hedged_tasks - :hedged_tasks_before AS tasks_hedged,
+	   hedges_won - :hedges_won_before AS hedges_won
+FROM citus_task_hedging_stats();
+
+RESET statement_timeout;
+RESET citus.task_assignment_policy;
+RESET citus.task_hedging_completed_percentage;
+
+DROP TABLE hedging_test;
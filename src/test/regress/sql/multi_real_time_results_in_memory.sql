@@ -0,0 +1,27 @@
+--
+-- MULTI_REAL_TIME_RESULTS_IN_MEMORY
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 440000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 440000;
+
+
+-- Store real-time executor results in memory instead of job directory files
+
+SET citus.task_executor_type TO 'real-time';
+SET citus.real_time_results_in_memory TO 'on';
+
+SELECT count(*) FROM lineitem;
+SELECT avg(l_quantity) as average FROM lineitem;
+SELECT l_shipmode FROM lineitem WHERE l_partkey = 67310 OR l_partkey = 155190
+	ORDER BY l_shipmode;
+
+-- Check that the binary master copy format has no effect on in-memory results
+
+SET citus.binary_master_copy_format TO 'on';
+
+SELECT count(*) FROM lineitem;
+
+RESET citus.binary_master_copy_format;
+RESET citus.real_time_results_in_memory;
@@ -0,0 +1,27 @@
+--
+-- MULTI_REAL_TIME_STREAMING
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 460000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 460000;
+
+
+SET citus.task_executor_type TO 'real-time';
+
+-- Return rows as soon as tasks deliver them, and stop early once done
+
+SET citus.stream_real_time_results TO 'on';
+
+SELECT count(*) FROM lineitem;
+SELECT l_shipmode FROM lineitem WHERE l_partkey = 67310 OR l_partkey = 155190
+	ORDER BY l_shipmode;
+SELECT 1 AS one FROM lineitem LIMIT 3;
+
+BEGIN;
+DECLARE streaming_cursor CURSOR FOR SELECT 1 AS one FROM lineitem;
+FETCH 2 FROM streaming_cursor;
+CLOSE streaming_cursor;
+COMMIT;
+
+RESET citus.stream_real_time_results;
@@ -1051,6 +1051,44 @@ DROP OWNED BY router_user;
 DROP USER router_user;
 DROP TABLE failure_test;
 
+-- simple single-shard statements can skip the regular planner
+SET citus.enable_fast_path_router_planner TO on;
+SET client_min_messages TO 'DEBUG2';
+
+SELECT id, title FROM articles_hash WHERE author_id = 10::bigint ORDER BY id;
+
+PREPARE fast_path_count(bigint) AS
+	SELECT count(*) FROM articles_hash WHERE author_id = $1;
+EXECUTE fast_path_count(10);
+
+UPDATE articles_hash SET word_count = word_count + 1
+	WHERE author_id = 10::bigint AND id = 10 RETURNING id, word_count;
+
+DEALLOCATE fast_path_count;
+SET client_min_messages TO 'NOTICE';
+
+-- range distributed tables with overlapping shards are pruned regularly
+CREATE TABLE fast_path_range (id int, value text);
+SELECT master_create_distributed_table('fast_path_range', 'id', 'range');
+SELECT master_create_empty_shard('fast_path_range') AS fast_path_shard_a \gset
+SELECT master_create_empty_shard('fast_path_range') AS fast_path_shard_b \gset
+UPDATE pg_dist_shard SET shardminvalue = 100, shardmaxvalue = 200
+	WHERE shardid = :fast_path_shard_a;
+UPDATE pg_dist_shard SET shardminvalue = 1, shardmaxvalue = 20
+	WHERE shardid = :fast_path_shard_b;
+INSERT INTO fast_path_range VALUES (5, 'b');
+UPDATE pg_dist_shard SET shardminvalue = 1, shardmaxvalue = 10
+	WHERE shardid = :fast_path_shard_a;
+UPDATE pg_dist_shard SET shardminvalue = 11, shardmaxvalue = 20
+	WHERE shardid = :fast_path_shard_b;
+INSERT INTO fast_path_range VALUES (5, 'a');
+UPDATE pg_dist_shard SET shardminvalue = 1, shardmaxvalue = 20
+	WHERE shardid = :fast_path_shard_b;
+SELECT id, value FROM fast_path_range WHERE id = 5 ORDER BY value;
+DROP TABLE fast_path_range;
+
+RESET citus.enable_fast_path_router_planner;
+
 DROP FUNCTION author_articles_max_id();
 DROP FUNCTION author_articles_id_word_count();
 
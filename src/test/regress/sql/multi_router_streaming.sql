@@ -0,0 +1,48 @@
+--
+-- MULTI_ROUTER_STREAMING
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 1400000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 1400000;
+
+
+-- Return router select results as they arrive from the worker
+
+CREATE TABLE streaming_test (id int, value text);
+SELECT master_create_distributed_table('streaming_test', 'id', 'hash');
+SELECT master_create_worker_shards('streaming_test', 1, 1);
+INSERT INTO streaming_test VALUES (1, 'a'), (2, 'b'), (3, 'c');
+
+SET citus.stream_router_results TO on;
+
+SELECT id, value FROM streaming_test ORDER BY id;
+
+-- Stop reading after the first row. The worker would keep sending rows for
+-- a long time, unless the remote command is cancelled when the scan ends.
+-- Streaming requires a cursor which can't scroll backwards.
+CREATE FUNCTION first_streamed_row(OUT first_value int, OUT ended_early boolean)
+AS $$
+DECLARE
+	test_cursor NO SCROLL CURSOR FOR
+		SELECT generate_series(1, 100000000) FROM streaming_test WHERE id = 1;
+	start_time timestamptz := clock_timestamp();
+BEGIN
+	OPEN test_cursor;
+	FETCH test_cursor INTO first_value;
+	CLOSE test_cursor;
+	ended_early := clock_timestamp() - start_time < interval '10 seconds';
+END;
+$$ LANGUAGE plpgsql;
+
+SELECT * FROM first_streamed_row();
+
+-- the connection can be used again afterwards
+SELECT count(*) FROM streaming_test;
+SELECT * FROM first_streamed_row();
+SELECT id, value FROM streaming_test WHERE id = 2;
+
+RESET citus.stream_router_results;
+
+DROP FUNCTION first_streamed_row();
+DROP TABLE streaming_test;
@@ -81,5 +81,74 @@ SELECT count(*) FROM pg_dist_transaction;
 SELECT recover_prepared_transactions();
 SELECT count(*) FROM pg_dist_transaction;
 
+-- With async commit, the maintenance daemon commits the prepared transactions
+SET citus.async_commit_prepared TO on;
+SELECT master_modify_multiple_shards($$UPDATE test_recovery SET y = 'mars'$$);
+RESET citus.async_commit_prepared;
+
+-- updating the same rows waits until the prepared transactions are committed
+SELECT master_modify_multiple_shards($$UPDATE test_recovery SET y = 'venus' WHERE y = 'mars'$$);
+
+SELECT recover_prepared_transactions();
+SELECT count(*) FROM pg_dist_transaction;
+SELECT DISTINCT y FROM test_recovery;
+
+-- Transactions writing over a single connection commit without 2PC
+SET citus.shard_replication_factor TO 1;
+SET citus.shard_count TO 1;
+CREATE TABLE test_recovery_single (x text, y text);
+SELECT create_distributed_table('test_recovery_single', 'x');
+INSERT INTO test_recovery_single VALUES ('hello', 'world');
+SELECT recover_prepared_transactions();
+
+SELECT master_modify_multiple_shards($$UPDATE test_recovery_single SET y = 'moon'$$);
+
+SELECT count(*) FROM pg_dist_transaction;
+SELECT * FROM test_recovery_single;
+DROP TABLE test_recovery_single;
+
+-- The maintenance daemon recovers prepared transactions periodically
+\c - - - :worker_1_port
+CREATE TABLE recovery_wait (value int);
+
+BEGIN;
+LOCK TABLE recovery_wait IN SHARE MODE;
+CREATE TABLE should_abort_periodically (value int);
+PREPARE TRANSACTION 'citus_0_should_abort_periodically';
+
+BEGIN;
+LOCK TABLE recovery_wait IN SHARE MODE;
+CREATE TABLE should_commit_periodically (value int);
+PREPARE TRANSACTION 'citus_0_should_commit_periodically';
+
 \c - - - :master_port
+INSERT INTO pg_dist_transaction VALUES (1, 'citus_0_should_commit_periodically');
+
+ALTER SYSTEM SET citus.recover_2pc_interval TO '100ms';
+SELECT pg_reload_conf();
+
+-- the prepared transactions keep their locks until they are recovered
+\c - - - :worker_1_port
+SET lock_timeout TO '1min';
+BEGIN;
+LOCK TABLE recovery_wait;
+COMMIT;
+RESET lock_timeout;
+
+SELECT count(*) FROM pg_prepared_xacts WHERE gid LIKE 'citus_0_%_periodically';
+SELECT count(*) FROM pg_tables WHERE tablename = 'should_abort_periodically';
+SELECT count(*) FROM pg_tables WHERE tablename = 'should_commit_periodically';
+DROP TABLE should_commit_periodically;
+DROP TABLE recovery_wait;
+
+\c - - - :master_port
+SELECT recover_prepared_transactions();
+SELECT count(*) FROM pg_dist_transaction;
+
+ALTER SYSTEM RESET citus.recover_2pc_interval;
+SELECT pg_reload_conf();
+
+-- 0 does not disable recovery, -1 does
+ALTER SYSTEM SET citus.recover_2pc_interval TO 0;
+
 DROP TABLE test_recovery;
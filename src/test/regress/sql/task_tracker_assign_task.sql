@@ -35,6 +35,17 @@ SELECT pg_sleep(3.0);
 SELECT task_tracker_task_status(:JobId, :SimpleTaskId);
 SELECT task_tracker_task_status(:JobId, :RecoverableTaskId);
 
+-- The same statuses can be fetched for the whole job at once. Once we have
+-- seen the latest status version, there are no further changes to report.
+
+SELECT task_id, task_status
+FROM task_tracker_task_status_changes(ARRAY[:JobId]::bigint[], 0)
+ORDER BY task_id;
+
+SELECT COUNT(*) FROM task_tracker_task_status_changes(ARRAY[:JobId]::bigint[],
+	(SELECT max(status_version)
+	 FROM task_tracker_task_status_changes(ARRAY[:JobId]::bigint[], 0)));
+
 COPY :SimpleTaskTable FROM 'base/pgsql_job_cache/job_401010/task_101101';
 
 SELECT COUNT(*) FROM :SimpleTaskTable;